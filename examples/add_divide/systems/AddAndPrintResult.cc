@@ -27,29 +27,22 @@ using namespace systems;
 /////////////////////////////////////////////////
 void AddAndPrintResult::Init(ecs::QueryRegistrar &_registrar)
 {
-  ecs::EntityQuery query;
-
-  // Add components which are required
-  if (!query.AddComponent("gazebo::components::Triplet"))
+  // Called with every entity which has the required components
+  if (!_registrar.Register<gazebo::components::Triplet>(
+        std::bind(&AddAndPrintResult::Update, this, std::placeholders::_1,
+          std::placeholders::_2)))
+  {
     std::cerr << "Undefined component[gazebo::components::Triplet]\n";
-
-  _registrar.Register(query,
-      std::bind(&AddAndPrintResult::Update, this, std::placeholders::_1));
+  }
+  _registrar.Reads<gazebo::components::Triplet>();
 }
 
 /////////////////////////////////////////////////
-void AddAndPrintResult::Update(const ecs::EntityQuery &_query)
+void AddAndPrintResult::Update(ecs::EntityId _id,
+    const gazebo::components::Triplet &_numbers)
 {
-  ecs::Manager &mgr = this->Manager();
-  // Loop through all of the entities which have the required components
-  for (auto const &entityId : _query.EntityIds())
-  {
-    auto &entity = mgr.Entity(entityId);
-    auto numbers = entity.Component<gazebo::components::Triplet>();
-
-    std::cout << "Adding " << entityId << ":" <<
-      numbers->first + numbers->second + numbers->third << std::endl;
-  }
+  std::cout << "Adding " << _id << ":" <<
+    _numbers.first + _numbers.second + _numbers.third << std::endl;
 }
 
 IGN_COMMON_REGISTER_SINGLE_PLUGIN(gazebo::systems::AddAndPrintResult,
@@ -22,6 +22,12 @@
 
 namespace gazebo
 {
+  namespace components
+  {
+    /// \brief Forward Declaration
+    struct Triplet;
+  }
+
   namespace systems
   {
     /// \brief Forward Declaration
@@ -31,8 +37,11 @@ namespace gazebo
     {
       public: virtual void Init(ecs::QueryRegistrar &_registrar);
 
-      /// \brief callback for query results
-      public: void Update(const ecs::EntityQuery &_result);
+      /// \brief callback for each entity in the query results
+      /// \param[in] _id id of the entity
+      /// \param[in] _numbers the numbers to add
+      public: void Update(ecs::EntityId _id,
+                  const gazebo::components::Triplet &_numbers);
     };
   }
 }
@@ -32,6 +32,7 @@ void DivideAndPrintResult::Init(ecs::QueryRegistrar &_registrar)
   // Add components which are required
   if (!query.AddComponent("gazebo::components::Fraction"))
     std::cerr << "Undefined component[gazebo::components::Fraction]\n";
+  _registrar.Reads<components::Fraction>();
 
   _registrar.Register(query,
       std::bind(&DivideAndPrintResult::Update, this, std::placeholders::_1));
@@ -81,82 +81,49 @@ int main(int argc, char **argv)
       std::cerr << "Failed to load library " << libName << std::endl;
   }
 
-  // Create 25 sphere entities
-  for (int i = 0; i < 25; i++)
+  // Create 25 sphere entities with the same components at once
+  const std::size_t numSpheres = 25;
+  gazebo::ecs::EntityBatch spheres = manager.CreateEntities<
+    gazebo::components::Inertial,
+    gazebo::components::Geometry,
+    gazebo::components::WorldPose,
+    gazebo::components::WorldVelocity,
+    gazebo::components::Material>(numSpheres);
+  if (spheres.Size() != numSpheres)
   {
-    // Create the entity
-    gazebo::ecs::EntityId e = manager.CreateEntity();
-    gazebo::ecs::Entity &entity = manager.Entity(e);
-
-    // Give it components
+    std::cerr << "Failed to create sphere entities" << std::endl;
+  }
 
+  // Components of each type are in one array, in the same order as the ids
+  auto inertials = spheres.Components<gazebo::components::Inertial>();
+  auto geoms = spheres.Components<gazebo::components::Geometry>();
+  auto poses = spheres.Components<gazebo::components::WorldPose>();
+  auto vels = spheres.Components<gazebo::components::WorldVelocity>();
+  auto materials = spheres.Components<gazebo::components::Material>();
+  for (std::size_t i = 0; i < spheres.Size(); i++)
+  {
     // Inertial component
-    auto inertial = entity.AddComponent<gazebo::components::Inertial>();
-    if (inertial)
-    {
-      inertial->mass = ignition::math::Rand::DblUniform(0.1, 5.0);
-    }
-    else
-    {
-      std::cerr << "Failed to add inertial component to entity [" << e << "]"
-                << std::endl;
-    }
+    inertials[i].mass = ignition::math::Rand::DblUniform(0.1, 5.0);
 
     // Geometry component
-    auto geom = entity.AddComponent<gazebo::components::Geometry>();
-    if (geom)
-    {
-      geom->type = gazebo::components::Geometry::SPHERE;
-      geom->sphere.radius = ignition::math::Rand::DblUniform(0.1, 0.5);
-    }
-    else
-    {
-      std::cerr << "Failed to add geom component to entity [" << e << "]"
-                << std::endl;
-    }
+    geoms[i].type = gazebo::components::Geometry::SPHERE;
+    geoms[i].sphere.radius = ignition::math::Rand::DblUniform(0.1, 0.5);
 
     // World pose
-    auto pose = entity.AddComponent<gazebo::components::WorldPose>();
-    if (pose)
-    {
-      pose->position.X(ignition::math::Rand::DblUniform(-4.0, 4.0));
-      pose->position.Y(ignition::math::Rand::DblUniform(-4.0, 4.0));
-      pose->position.Z(ignition::math::Rand::DblUniform(-4.0, 4.0));
-    }
-    else
-    {
-      std::cerr << "Failed to add world pose component to entity [" << e << "]"
-                << std::endl;
-    }
+    poses[i].position.X(ignition::math::Rand::DblUniform(-4.0, 4.0));
+    poses[i].position.Y(ignition::math::Rand::DblUniform(-4.0, 4.0));
+    poses[i].position.Z(ignition::math::Rand::DblUniform(-4.0, 4.0));
 
     // World velocity
-    auto vel = entity.AddComponent<gazebo::components::WorldVelocity>();
-    if (vel)
-    {
-      vel->linear.X(ignition::math::Rand::DblUniform(-1.0, 1.0));
-      vel->linear.Y(ignition::math::Rand::DblUniform(-1.0, 1.0));
-      vel->linear.Z(ignition::math::Rand::DblUniform(-1.0, 1.0));
-    }
-    else
-    {
-      std::cerr << "Failed to add world velocity component to entity ["
-                << e << "]" << std::endl;
-    }
+    vels[i].linear.X(ignition::math::Rand::DblUniform(-1.0, 1.0));
+    vels[i].linear.Y(ignition::math::Rand::DblUniform(-1.0, 1.0));
+    vels[i].linear.Z(ignition::math::Rand::DblUniform(-1.0, 1.0));
 
     // Renderable
-    auto material = entity.AddComponent<gazebo::components::Material>();
-    if (material)
-    {
-      material->type = gazebo::components::Material::COLOR;
-      material->color.red = ignition::math::Rand::DblUniform(0.1, 1.0);
-      material->color.green = ignition::math::Rand::DblUniform(0.1, 1.0);
-      material->color.blue = ignition::math::Rand::DblUniform(0.1, 1.0);
-    }
-    else
-    {
-      std::cerr << "Failed to add Material component to entity ["
-                << e << "]" << std::endl;
-    }
+    materials[i].type = gazebo::components::Material::COLOR;
+    materials[i].color.red = ignition::math::Rand::DblUniform(0.1, 1.0);
+    materials[i].color.green = ignition::math::Rand::DblUniform(0.1, 1.0);
+    materials[i].color.blue = ignition::math::Rand::DblUniform(0.1, 1.0);
   }
 
   // Simulation loop
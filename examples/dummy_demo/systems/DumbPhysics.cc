@@ -56,9 +56,20 @@ void DumbPhysics::Init(ecs::QueryRegistrar &_registrar)
   if (!query.AddComponent("gazebo::components::WorldPose"))
     std::cerr << "Undefined component[gazebo::components::WorldPose]\n";
 
-  // Note that we add only the required components. This system will also make
-  // use of the Mass and WorldVelocity components if present, but these are
-  // optional
+  // This system will also make use of the Inertial and WorldVelocity
+  // components if present. They're returned with the results, but entities
+  // don't need them to match.
+  if (!query.Optional("gazebo::components::Inertial"))
+    std::cerr << "Undefined component[gazebo::components::Inertial]\n";
+  if (!query.Optional("gazebo::components::WorldVelocity"))
+    std::cerr << "Undefined component[gazebo::components::WorldVelocity]\n";
+
+  // Systems reading poses or velocities see them as of the last update,
+  // other systems writing them run before or after this one
+  _registrar.Reads<components::Geometry>();
+  _registrar.Reads<components::Inertial>();
+  _registrar.Writes<components::WorldPose>();
+  _registrar.Writes<components::WorldVelocity>();
 
   _registrar.Register(query,
       std::bind(&DumbPhysics::Update, this, std::placeholders::_1));
@@ -74,14 +85,30 @@ void DumbPhysics::Update(const ecs::EntityQuery &_result)
   // STEP 1 Loop through entities and update internal representation
   // This is where the effects of other systems get propagated to this one,
   // for example, if a pose is changed or a body is deleted through the GUI.
-  for (auto const &entityId : _result.EntityIds())
+  auto const &entityIds = _result.EntityIds();
+  auto const geometries = _result.Components<components::Geometry>();
+  auto const poses = _result.Components<components::WorldPose>();
+  // nullptr for entities without them
+  auto const velocities = _result.Components<components::WorldVelocity>();
+  for (std::size_t i = 0; i < entityIds.size(); ++i)
   {
-    // Get entity (should check if exists?)
-    auto &entity = mgr.Entity(entityId);
+    const ecs::EntityId entityId = entityIds[i];
 
     // Body is the internal representation of an entity in this system
     auto body = this->world.BodyById(entityId);
 
+    // Geometry or pose was removed from this entity by another system, or
+    // the entity was deleted. We remove the whole entity from this system,
+    // because we're not interested in entities without them.
+    if (!geometries[i] || !poses[i])
+    {
+      if (body)
+        this->world.RemoveBody(body->Id());
+      continue;
+    }
+
+    auto &entity = mgr.Entity(entityId);
+
     // Check if geometry has changed since last time step
     // We use the presence of this component to add/remove bodies in this system
     auto difference = entity.IsDifferent<components::Geometry>();
@@ -92,19 +119,11 @@ void DumbPhysics::Update(const ecs::EntityQuery &_result)
     {
       body = this->AddBody(entityId, entity);
     }
-    // Geometry component was removed from this entity by another system.
-    // We remove the whole entity from this system, because we're not
-    // interested in entities without a geometry.
-    else if (ecs::WAS_DELETED == difference && body)
-    {
-      this->world.RemoveBody(body->Id());
-    }
     // Another system modified the geometry
     // TODO How can we be sure it wasn't us who changed it?
     else if (ecs::WAS_MODIFIED == difference && body)
     {
-      auto const geom = entity.Component<components::Geometry>();
-      this->SyncInternalGeom(body, geom);
+      this->SyncInternalGeom(body, geometries[i]);
     }
     // Something went wrong
     else if (ecs::NO_DIFFERENCE != difference)
@@ -114,21 +133,14 @@ void DumbPhysics::Update(const ecs::EntityQuery &_result)
                 << "]" << std::endl;
     }
 
+    if (!body)
+      continue;
+
     // Sync other properties in case they've been changed by other systems
-    auto const pose = entity.Component<components::WorldPose>();
-    if (pose)
-      this->SyncInternalPose(body, pose);
-    else
-    {
-      std::cerr << "Entity [" << entityId
-                << "] missing required component WorldPose. "
-                << "Removing it from the world." << std::endl;
-      this->world.RemoveBody(body->Id());
-    }
+    this->SyncInternalPose(body, poses[i]);
 
-    auto const velocity = entity.Component<components::WorldVelocity>();
-    if (velocity)
-      this->SyncInternalVelocity(body, velocity);
+    if (velocities[i])
+      this->SyncInternalVelocity(body, velocities[i]);
   }
   this->diagnostics.StopTimer("Update Internal");
 
@@ -151,14 +163,21 @@ void DumbPhysics::Update(const ecs::EntityQuery &_result)
 
   this->diagnostics.StartTimer("UpdateExternal");
   // STEP 3 update the components with the results of the physics
-  for (auto const &entityId : _result.EntityIds())
+  // Bodies are only read, so entities can be updated in parallel
+  mgr.ParallelForEach(_result, [&](std::size_t _index)
   {
+    const ecs::EntityId entityId = entityIds[_index];
     dumb_physics::Body *body = this->world.BodyById(entityId);
 
     if (!body)
     {
-      std::cerr << "Null body for entity [" << entityId << "]" << std::endl;
-      continue;
+      // Removed from the world in step 1
+      if (geometries[_index] && poses[_index])
+      {
+        std::cerr << "Null body for entity [" << entityId << "]"
+                  << std::endl;
+      }
+      return;
     }
 
     auto &entity = mgr.Entity(entityId);
@@ -168,7 +187,7 @@ void DumbPhysics::Update(const ecs::EntityQuery &_result)
 
     auto worldVel = entity.ComponentMutable<components::WorldVelocity>();
     this->SyncExternalVelocity(body, worldVel);
-  }
+  });
   this->diagnostics.StopTimer("UpdateExternal");
 
   this->diagnostics.UpdateEnd();
@@ -43,6 +43,13 @@ void DummyRendering::Init(ecs::QueryRegistrar &_registrar)
   if (!query.AddComponent("gazebo::components::WorldPose"))
     std::cerr << "Undefined component[gazebo::components::WorldPose]\n";
 
+  // Only visit entities that changed, most of them don't
+  query.Reactive(true);
+
+  // Never modifies components, so it can run next to other readers
+  _registrar.Reads<components::Geometry>();
+  _registrar.Reads<components::Material>();
+  _registrar.Reads<components::WorldPose>();
 
   _registrar.Register(query, std::bind(&DummyRendering::Update, this,
         std::placeholders::_1));
@@ -59,43 +66,38 @@ void DummyRendering::Init(ecs::QueryRegistrar &_registrar)
 void DummyRendering::Update(const ecs::EntityQuery &_result)
 {
   auto &mgr = this->Manager();
-  auto const &currentTime = mgr.SimulationTime();
-  if (currentTime < this->nextRenderTime)
-  {
-    // Too early to publish
-    return;
-  }
-  double framerate = 30.0;
-  this->nextRenderTime += ignition::common::Time(1.0 / framerate);
 
-  for (auto const &entityId : _result.EntityIds())
+  // Keep the scene in sync every update, changes are lost otherwise
+  for (auto const &entityId : _result.RemovedEntityIds())
+    this->scene.RemoveObject(entityId);
+
+  for (auto const &entityId : _result.AddedEntityIds())
+    this->AddObjectToScene(mgr.Entity(entityId));
+
+  for (auto const &entityId : _result.ModifiedEntityIds())
   {
     auto &entity = mgr.Entity(entityId);
     auto difference_material = entity.IsDifferent<components::Material>();
     auto difference_geometry = entity.IsDifferent<components::Geometry>();
     auto difference_position = entity.IsDifferent<components::WorldPose>();
-    dummy_rendering::Object *obj = this->scene.GetById(entityId);
 
     const bool doDelete = ecs::WAS_DELETED == difference_material ||
       ecs::WAS_DELETED == difference_geometry ||
       ecs::WAS_DELETED == difference_position;
 
-    const bool doCreate = ecs::WAS_CREATED == difference_material ||
-      ecs::WAS_CREATED == difference_geometry ||
-      ecs::WAS_CREATED == difference_position;
-
+    // Removed and added back in one update counts as created
     const bool doModify = ecs::WAS_MODIFIED == difference_material ||
-      ecs::WAS_MODIFIED == difference_geometry;
+      ecs::WAS_MODIFIED == difference_geometry ||
+      ecs::WAS_CREATED == difference_material ||
+      ecs::WAS_CREATED == difference_geometry;
 
-    if (obj && doDelete)
+    if (doDelete)
     {
       this->RemoveObjectFromScene(entity);
+      continue;
     }
-    else if (obj == nullptr || doCreate)
-    {
-      this->AddObjectToScene(entity);
-    }
-    else if (doModify)
+
+    if (doModify)
     {
       this->RemoveObjectFromScene(entity);
       this->AddObjectToScene(entity);
@@ -107,6 +109,15 @@ void DummyRendering::Update(const ecs::EntityQuery &_result)
     }
   }
 
+  auto const &currentTime = mgr.SimulationTime();
+  if (currentTime < this->nextRenderTime)
+  {
+    // Too early to publish
+    return;
+  }
+  double framerate = 30.0;
+  this->nextRenderTime += ignition::common::Time(1.0 / framerate);
+
   this->PublishImages();
 }
 
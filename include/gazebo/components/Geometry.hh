@@ -66,7 +66,7 @@ namespace gazebo
       }
 
       /// \brief copy constructor
-      Geometry(const Geometry &_other)
+      Geometry(const Geometry &_other) : type(_other.type)
       {
         // Unions make things hard :(
         // Use placement new to invoke the right copy constructor
@@ -74,10 +74,13 @@ namespace gazebo
         {
           case SPHERE:
             new (&sphere) SphereProperties(_other.sphere);
+            break;
           case BOX:
             new (&box) BoxProperties(_other.box);
+            break;
           case CYLINDER:
             new (&cylinder) CylinderProperties(_other.cylinder);
+            break;
           default:
             break;
         }
@@ -90,10 +93,13 @@ namespace gazebo
         {
           case SPHERE:
             sphere.~SphereProperties();
+            break;
           case BOX:
             box.~BoxProperties();
+            break;
           case CYLINDER:
             cylinder.~CylinderProperties();
+            break;
           default:
             break;
         }
@@ -18,13 +18,17 @@
 #ifndef GAZEBO_ECS_COMPONENTFACTORY_HH_
 #define GAZEBO_ECS_COMPONENTFACTORY_HH_
 
-#include <functional>
+#include <atomic>
+#include <bitset>
+#include <cstring>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <new>
 #include <string>
+#include <type_traits>
 #include <typeinfo>
+#include <utility>
 #include <vector>
 
 namespace gazebo
@@ -37,101 +41,283 @@ namespace gazebo
     /// \brief Special value returned to say there is no component
     static const ComponentType NO_COMPONENT = -1;
 
+    /// \brief Max number of component types that can be registered
+    const int MAX_COMPONENT_TYPES = 256;
+
+    /// \brief A set of component types, one bit per ComponentType
+    typedef std::bitset<MAX_COMPONENT_TYPES> ComponentMask;
+
+    /// \brief Size of a cache line in bytes
+    const std::size_t CACHE_LINE_SIZE = 64;
+
     /// \brief forward declaration for friendship
     class ComponentFactory;
 
+    /// \brief Functions that work on components of one actual type
+    ///
+    /// Components that are trivially copyable and destructible are copied
+    /// and moved with memcpy, and destructing them does nothing.
+    template <typename T>
+    class ComponentFunctions
+    {
+      /// \brief True if T can be copied with memcpy and has no destructor
+      public: static const bool trivial =
+                std::is_trivially_copyable<T>::value &&
+                std::is_trivially_destructible<T>::value;
+
+      /// \brief Tag for the trivial or non-trivial implementation
+      private: typedef std::integral_constant<bool, trivial> Trivial;
+
+      /// \brief Construct a component in uninitialized memory
+      public: static void Construct(void *_location)
+              {
+                // placement new operator, doesn't allocate memory
+                new (_location) T();
+              }
+
+      /// \brief Construct components _stride bytes apart
+      public: static void ConstructMany(void *_first, std::size_t _count,
+                  std::size_t _stride)
+              {
+                char *location = static_cast<char *>(_first);
+                for (std::size_t i = 0; i < _count; ++i)
+                  new (location + i * _stride) T();
+              }
+
+      /// \brief Destruct a component without freeing memory
+      public: static void Destruct(void *_location)
+              {
+                DestructMany(_location, 1, sizeof(T), Trivial());
+              }
+
+      /// \brief Destruct components _stride bytes apart
+      public: static void DestructMany(void *_first, std::size_t _count,
+                  std::size_t _stride)
+              {
+                DestructMany(_first, _count, _stride, Trivial());
+              }
+
+      /// \brief Copy a component to uninitialized memory
+      public: static void Copy(void const *_from, void *_to)
+              {
+                CopyMany(_from, _to, 1, sizeof(T), Trivial());
+              }
+
+      /// \brief Copy components _stride bytes apart to uninitialized memory
+      public: static void CopyMany(void const *_from, void *_to,
+                  std::size_t _count, std::size_t _stride)
+              {
+                CopyMany(_from, _to, _count, _stride, Trivial());
+              }
+
+      /// \brief Copy the bytes of a component
+      public: static void ShallowCopy(void const *_from, void *_to)
+              {
+                std::memcpy(_to, _from, sizeof(T));
+              }
+
+      /// \brief Move a component to uninitialized memory, then destruct
+      /// the component left behind
+      public: static void Move(void *_from, void *_to)
+              {
+                MoveMany(_from, _to, 1, sizeof(T), Trivial());
+              }
+
+      /// \brief Move components _stride bytes apart to uninitialized memory,
+      /// then destruct the components left behind
+      public: static void MoveMany(void *_from, void *_to, std::size_t _count,
+                  std::size_t _stride)
+              {
+                MoveMany(_from, _to, _count, _stride, Trivial());
+              }
+
+      /// \brief Trivial components need no destructor
+      private: static void DestructMany(void *, std::size_t, std::size_t,
+                   std::true_type)
+              {
+              }
+
+      /// \brief Call the destructor of each component
+      private: static void DestructMany(void *_first, std::size_t _count,
+                   std::size_t _stride, std::false_type)
+              {
+                char *location = static_cast<char *>(_first);
+                for (std::size_t i = 0; i < _count; ++i)
+                  reinterpret_cast<T *>(location + i * _stride)->~T();
+              }
+
+      /// \brief Copy trivial components all at once, padding included
+      private: static void CopyMany(void const *_from, void *_to,
+                   std::size_t _count, std::size_t _stride, std::true_type)
+              {
+                if (_count)
+                  std::memcpy(_to, _from, (_count - 1) * _stride + sizeof(T));
+              }
+
+      /// \brief Copy components using their copy constructor
+      private: static void CopyMany(void const *_from, void *_to,
+                   std::size_t _count, std::size_t _stride, std::false_type)
+              {
+                const char *src = static_cast<const char *>(_from);
+                char *dst = static_cast<char *>(_to);
+                for (std::size_t i = 0; i < _count; ++i)
+                {
+                  new (dst + i * _stride) T(
+                      *reinterpret_cast<const T *>(src + i * _stride));
+                }
+              }
+
+      /// \brief Move trivial components all at once, padding included
+      private: static void MoveMany(void *_from, void *_to,
+                   std::size_t _count, std::size_t _stride, std::true_type)
+              {
+                if (_count)
+                  std::memcpy(_to, _from, (_count - 1) * _stride + sizeof(T));
+              }
+
+      /// \brief Move components using their move constructor, then end the
+      /// lifetime of the moved-from objects without freeing memory
+      private: static void MoveMany(void *_from, void *_to,
+                   std::size_t _count, std::size_t _stride, std::false_type)
+              {
+                char *src = static_cast<char *>(_from);
+                char *dst = static_cast<char *>(_to);
+                for (std::size_t i = 0; i < _count; ++i)
+                {
+                  T *component = reinterpret_cast<T *>(src + i * _stride);
+                  new (dst + i * _stride) T(std::move(*component));
+                  component->~T();
+                }
+              }
+    };
+
     /// \brief Holds information about a component type
+    ///
+    /// The functions are plain function pointers into ComponentFunctions,
+    /// so calling one is a single indirect call.
     class ComponentTypeInfo
     {
       /// \brief Constructs without allocating memory
-      public: std::function<void (void*)> constructor;
+      public: void (*constructor)(void *) = nullptr;
 
       /// \brief Destructs component without freeing memory
-      public: std::function<void (void*)> destructor;
+      public: void (*destructor)(void *) = nullptr;
 
       /// \brief Deep copies component from one memory location to another
-      public: std::function<void (void const *, void*)> deepCopier;
+      public: void (*deepCopier)(void const *, void *) = nullptr;
 
       /// \brief shallow copies component from one memory location to another
-      public: std::function<void (void const *, void*)> shallowCopier;
+      public: void (*shallowCopier)(void const *, void *) = nullptr;
+
+      /// \brief Moves a component to uninitialized memory, then destructs
+      /// the component left behind at the old location
+      public: void (*mover)(void *, void *) = nullptr;
+
+      /// \brief Constructs a number of components a stride apart
+      public: void (*constructMany)(void *, std::size_t, std::size_t) =
+              nullptr;
+
+      /// \brief Destructs a number of components a stride apart
+      public: void (*destructMany)(void *, std::size_t, std::size_t) =
+              nullptr;
+
+      /// \brief Deep copies a number of components a stride apart
+      public: void (*copyMany)(void const *, void *, std::size_t,
+                  std::size_t) = nullptr;
+
+      /// \brief Moves a number of components a stride apart, then destructs
+      /// the ones left behind
+      public: void (*moveMany)(void *, void *, std::size_t, std::size_t) =
+              nullptr;
+
+      /// \brief True if components can be copied with memcpy and destructing
+      /// them does nothing
+      public: bool trivial = false;
 
       /// \brief Size of an instantiated component in bytes
-      public: std::size_t size;
+      public: std::size_t size = 0;
+
+      /// \brief Alignment of a component in bytes
+      public: std::size_t alignment = 1;
+
+      /// \brief Distance in bytes between components stored in a pool
+      /// \remarks size, or size rounded up to whole cache lines if the type
+      ///   was registered with padding
+      public: std::size_t stride = 0;
 
       /// \brief Name of the component type
       public: std::string name;
 
       friend ComponentFactory;
 
+      /// \brief Get the info of an actual type
+      /// \param[in] _padToCacheLine true to give each component in a pool
+      ///   cache lines of its own
       private: template <typename T>
-              static ComponentTypeInfo From()
+              static ComponentTypeInfo From(bool _padToCacheLine)
               {
                 ComponentTypeInfo info;
-                info.constructor = [](void *_location)
-                {
-                  // placement new operator, doesn't allocate memory
-                  new (_location) T();
-                };
-
-                info.destructor = [](void *_location)
-                {
-                  // explicit call to destructor without freeing memory
-                  static_cast<T*>(_location)->~T();
-                };
+                info.constructor = &ComponentFunctions<T>::Construct;
+                info.destructor = &ComponentFunctions<T>::Destruct;
+                info.deepCopier = &ComponentFunctions<T>::Copy;
+                info.shallowCopier = &ComponentFunctions<T>::ShallowCopy;
+                info.mover = &ComponentFunctions<T>::Move;
+                info.constructMany = &ComponentFunctions<T>::ConstructMany;
+                info.destructMany = &ComponentFunctions<T>::DestructMany;
+                info.copyMany = &ComponentFunctions<T>::CopyMany;
+                info.moveMany = &ComponentFunctions<T>::MoveMany;
+                info.trivial = ComponentFunctions<T>::trivial;
 
                 // Store size so space can be allocated elsewhere
                 info.size = sizeof(T);
-
-                info.shallowCopier = [](void const *_from, void *_to)
-                {
-                  // Copy component from one location to another
-                  // info.size is enough info to do this operation, but making
-                  // a lambda for this allows the compiler to unroll the loop
-                  // completely
-                  for (int i = 0; i < sizeof(T); ++i)
-                  {
-                    static_cast<char*>(_to)[i] =
-                      static_cast<char const*>(_from)[i];
-                  }
-                };
-
-                info.deepCopier = [](void const *_from, void *_to)
-                {
-                  // Copy component from one location to another using its copy
-                  // constructor.
-                  const T *src = static_cast<const T *>(_from);
-                  new (_to) T(static_cast<const T &>(*src));
-                };
+                info.alignment = alignof(T);
+                if (_padToCacheLine && info.alignment < CACHE_LINE_SIZE)
+                  info.alignment = CACHE_LINE_SIZE;
+                // Round up so every component in a pool stays aligned
+                info.stride = (info.size + info.alignment - 1) /
+                  info.alignment * info.alignment;
                 return info;
               }
     };
 
     /// \brief A factor that registers and creates components.
+    ///
+    /// Looking up the ComponentType of an actual type doesn't lock. Each
+    /// type has a static slot that is filled in when the type is
+    /// registered, so after that Type<T>() is a single atomic load.
     class ComponentFactory
     {
       /// \brief Register a Component type with a name
       /// \param[in] _name Name(key) of the type to register.
-      /// \return True if the _name has not already been used.
+      /// \param[in] _padToCacheLine true to align components in their pool
+      /// to cache lines, so threads writing neighbours don't share a line
+      /// \return True if the _name has not already been used and fewer than
+      /// MAX_COMPONENT_TYPES types have been registered.
       /// \sa Create
       public: template <typename T>
-              static bool Register(const std::string &_name)
+              static bool Register(const std::string &_name,
+                  bool _padToCacheLine = false)
               {
                 bool success = false;
                 const std::size_t hash = typeid(T).hash_code();
 
                 std::lock_guard<std::mutex> lock(mtx);
                 if (typesByName.find(_name) == typesByName.end()
-                    && typesByHash.find(hash) == typesByHash.end())
+                    && typesByHash.find(hash) == typesByHash.end()
+                    && numTypes.load() < MAX_COMPONENT_TYPES)
                 {
-                  ComponentTypeInfo info = ComponentTypeInfo::From<T>();
+                  ComponentType id = numTypes.load();
+                  typeInfoById[id] = ComponentTypeInfo::From<T>(
+                      _padToCacheLine);
 
                   // Store name for debugging
-                  info.name = _name;
+                  typeInfoById[id].name = _name;
 
-                  ComponentType id = typeInfoById.size();
                   typesByName[_name] = id;
                   typesByHash[hash] = id;
-                  typeInfoById.push_back(info);
+                  // Publish the info before the type can be looked up
+                  numTypes.store(id + 1, std::memory_order_release);
+                  TypeSlot<T>::id.store(id, std::memory_order_release);
                   success = true;
                 }
                 return success;
@@ -148,29 +334,43 @@ namespace gazebo
               }
 
       /// \brief Return a ComponentType for a component by actual type
+      /// \returns the type, or NO_COMPONENT if T isn't registered
       public: template <typename T>
               static ComponentType Type()
               {
+                const ComponentType type =
+                  TypeSlot<T>::id.load(std::memory_order_acquire);
+                if (type != NO_COMPONENT)
+                  return type;
+
+                // A library with its own copy of the slot may have
+                // registered the type. Look it up once and remember it.
                 std::lock_guard<std::mutex> lock(mtx);
-                std::size_t hash = typeid(T).hash_code();
-                if (typesByHash.find(hash) != typesByHash.end())
-                  return typesByHash[hash];
+                auto iter = typesByHash.find(typeid(T).hash_code());
+                if (iter == typesByHash.end())
+                  return NO_COMPONENT;
+                TypeSlot<T>::id.store(iter->second, std::memory_order_release);
+                return iter->second;
               }
 
       /// \brief Get the full type information
-      /// TODO This isn't templated or inlined, it could be in a source file
+      /// \remarks Doesn't lock. The reference stays valid forever.
       public: static ComponentTypeInfo const & TypeInfo(ComponentType _type)
               {
-                std::lock_guard<std::mutex> lock(mtx);
-                if (_type >= 0 && _type < typeInfoById.size())
+                static const ComponentTypeInfo noInfo = ComponentTypeInfo();
+                if (_type >= 0 &&
+                    _type < numTypes.load(std::memory_order_acquire))
+                {
                   return typeInfoById[_type];
+                }
+                return noInfo;
               }
 
       public: static std::vector<ComponentType> Types()
               {
-                std::lock_guard<std::mutex> lock(mtx);
                 std::vector<ComponentType> knownTypes;
-                for (int i = 0; i < typeInfoById.size(); ++i)
+                const int count = numTypes.load(std::memory_order_acquire);
+                for (int i = 0; i < count; ++i)
                 {
                   knownTypes.push_back(i);
                 }
@@ -180,6 +380,14 @@ namespace gazebo
       /// \brief Lock for thread safety
       public: static std::mutex mtx;
 
+      /// \brief Where the ComponentType of an actual type is kept
+      private: template <typename T>
+               struct TypeSlot
+               {
+                 /// \brief The type, NO_COMPONENT until it is known
+                 static std::atomic<ComponentType> id;
+               };
+
       /// \brief Mapping of names to component type
       private: static std::map<std::string, ComponentType> typesByName;
 
@@ -188,9 +396,17 @@ namespace gazebo
 
       /// \brief Map ComponentType to type information
       ///
-      /// index is the same as ComponentType
-      private: static std::vector<ComponentTypeInfo> typeInfoById;
+      /// index is the same as ComponentType. A fixed array so entries never
+      /// move and can be read without locking.
+      private: static ComponentTypeInfo typeInfoById[MAX_COMPONENT_TYPES];
+
+      /// \brief Number of registered types
+      private: static std::atomic<int> numTypes;
     };
+
+    /////////////////////////////////////////////////
+    template <typename T>
+    std::atomic<ComponentType> ComponentFactory::TypeSlot<T>::id(NO_COMPONENT);
   }
 }
 
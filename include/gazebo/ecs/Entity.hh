@@ -26,8 +26,52 @@ namespace gazebo
   namespace ecs
   {
     /// \brief An entity is an id!
+    ///
+    /// The low ENTITY_INDEX_BITS bits are an index that gets recycled after
+    /// an entity is deleted. The bits above hold a generation that changes
+    /// every time the index is recycled, so a stale id held by a system
+    /// never refers to the entity that reused its index.
     typedef int EntityId;
 
+    /// \brief Number of bits in an EntityId that hold the index
+    const int ENTITY_INDEX_BITS = 20;
+
+    /// \brief Number of bits in an EntityId that hold the generation
+    /// \remarks The sign bit is unused so valid ids are never negative
+    const int ENTITY_GENERATION_BITS = 11;
+
+    /// \brief Mask for the index part of an EntityId
+    const EntityId ENTITY_INDEX_MASK = (1 << ENTITY_INDEX_BITS) - 1;
+
+    /// \brief Mask for the generation once shifted down to bit 0
+    const int ENTITY_GENERATION_MASK = (1 << ENTITY_GENERATION_BITS) - 1;
+
+    /// \brief Max number of entities that can exist at the same time
+    const int MAX_ENTITIES = 1 << ENTITY_INDEX_BITS;
+
+    /// \brief Get the recyclable index of an entity
+    /// \param[in] _id a valid entity id
+    inline int EntityIndex(EntityId _id)
+    {
+      return _id & ENTITY_INDEX_MASK;
+    }
+
+    /// \brief Get the generation of an entity
+    /// \param[in] _id a valid entity id
+    inline int EntityGeneration(EntityId _id)
+    {
+      return (_id >> ENTITY_INDEX_BITS) & ENTITY_GENERATION_MASK;
+    }
+
+    /// \brief Build an entity id from an index and generation
+    /// \param[in] _index index less than MAX_ENTITIES
+    /// \param[in] _generation generation, wraps at ENTITY_GENERATION_BITS
+    inline EntityId MakeEntityId(int _index, int _generation)
+    {
+      return ((_generation & ENTITY_GENERATION_MASK) << ENTITY_INDEX_BITS)
+        | (_index & ENTITY_INDEX_MASK);
+    }
+
     /// \brief Describes the changes to an entity or component
     enum Difference {
       NO_DIFFERENCE = 0,
@@ -45,6 +89,9 @@ namespace gazebo
     /// \brief Forward Declaration
     class EntityComponentDatabase;
 
+    /// \brief Forward Declaration
+    class EntityComponentDatabasePrivate;
+
     /// \brief A convenience class for working with entities
     class Entity
     {
@@ -136,6 +183,9 @@ namespace gazebo
 
       /// \brief friendship
       friend EntityComponentDatabase;
+
+      /// \brief friendship
+      friend EntityComponentDatabasePrivate;
     };
 
     static Entity EntityNull;
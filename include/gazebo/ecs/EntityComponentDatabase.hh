@@ -18,7 +18,9 @@
 #ifndef GAZEBO_ECS_ENTITYCOMPONENTDATABASE_HH_
 #define GAZEBO_ECS_ENTITYCOMPONENTDATABASE_HH_
 
+#include <cstddef>
 #include <memory>
+#include <vector>
 
 #include "gazebo/ecs/Entity.hh"
 #include "gazebo/ecs/ComponentFactory.hh"
@@ -33,13 +35,63 @@ namespace gazebo
     /// \brief Forward declaration
     class EntityComponentDatabasePrivate;
 
+    /// \brief Forward declaration
+    class EntityBatchPrivate;
+
     /// \brief Id of an EntityQuery
     using EntityQueryId = int64_t;
 
+    /// \brief Entities created together with the same components
+    ///
+    /// Returned by EntityComponentDatabase::CreateEntities(). The components
+    /// of each type are constructed back to back in one array, where they
+    /// can be initialized until the next Update() moves them into main
+    /// storage. The batch can't be used after that.
+    class EntityBatch
+    {
+      /// \brief Constructor, use EntityComponentDatabase::CreateEntities()
+      /// \param[in] _batch staged batch owned by the database
+      public: explicit EntityBatch(EntityBatchPrivate *_batch = nullptr);
+
+      /// \brief Get the number of entities created
+      /// \remarks Less than requested if the database ran out of ids
+      public: std::size_t Size() const;
+
+      /// \brief Get the id of an entity in the batch
+      /// \param[in] _index index less than Size()
+      public: EntityId Id(std::size_t _index) const;
+
+      /// \brief Get the components of one type by actual type
+      public: template <typename T>
+              T *Components() const
+              {
+                ComponentType type = ComponentFactory::Type<T>();
+                return static_cast<T *>(this->Components(type));
+              }
+
+      /// \brief Get the components of one type
+      /// \param[in] _type type of component
+      /// \returns pointer to an array of Size() components in the order of
+      ///   the ids, or nullptr if the batch doesn't have the type
+      public: void *Components(ComponentType _type) const;
+
+      /// \brief Staged batch owned by the database until the next Update()
+      private: EntityBatchPrivate *batch;
+    };
+
     /// \brief Stores and retrieves entities/components efficiently
     ///
     /// This class stores entities and components, and provides efficient
     /// queries for retrieving them.
+    ///
+    /// Between calls to Update() the stored components don't change, so any
+    /// number of threads may read them without locking. Changes made by a
+    /// thread are staged in buffers owned by that thread and merged on the
+    /// next Update(), which must not run at the same time as anything else.
+    ///
+    /// Modified components are double buffered. EntityComponentMutable()
+    /// returns the same copy to every caller until the next Update(), so
+    /// threads that modify the same component must not do it at once.
     class EntityComponentDatabase
     {
       /// \brief Constructor
@@ -49,17 +101,24 @@ namespace gazebo
       public: ~EntityComponentDatabase();
 
       /// \brief Add a query for entities
+      ///
+      /// Queries with the same terms share one id and one set of results.
+      /// Every AddQuery() must be matched by a RemoveQuery().
       /// \param[in] _query The query to add
       /// \returns The index of the query and boolean in a pair. The boolean
       /// is true if query was added, false if the query already existed.
       public: std::pair<EntityQueryId, bool> AddQuery(const EntityQuery &_query);
 
       /// \brief Get a query based on an index.
+      /// \remarks The reference stays valid until the query is removed
       /// \param[in] _index Index of the query.
-      /// \return The EntityQuery, or NULL_QUERY on error.
+      /// \return The EntityQuery, or EntityQueryNull on error.
       public: const EntityQuery &Query(const EntityQueryId _index) const;
 
       /// \brief Remove a query for entities
+      ///
+      /// The query is only removed once it has been removed as many times
+      /// as it was added. Ids of other queries don't change.
       /// \param[in,out] _id ID of the query to remove.
       /// \returns True if query was successfully removed
       public: bool RemoveQuery(const EntityQueryId _id);
@@ -68,6 +127,28 @@ namespace gazebo
       /// \brief returns an id for the entity, or NO_ENTITY on failure
       public: EntityId CreateEntity();
 
+      /// \brief Creates many entities with the same components by type
+      ///
+      /// Ex: db.CreateEntities<Pose, Velocity>(1000);
+      public: template <typename ...Ts>
+              EntityBatch CreateEntities(std::size_t _count)
+              {
+                std::vector<ComponentType> types{
+                  ComponentFactory::Type<Ts>()...};
+                return this->CreateEntities(_count, types);
+              }
+
+      /// \brief Creates many entities with the same components
+      ///
+      /// Ids are reserved at once and components are constructed in
+      /// contiguous arrays. The next Update() moves each array into its
+      /// pool and adds the entities to matching queries in one pass.
+      /// \param[in] _count number of entities to create
+      /// \param[in] _types types of components to give every entity
+      /// \returns the created entities, empty if a type is invalid
+      public: EntityBatch CreateEntities(std::size_t _count,
+                  const std::vector<ComponentType> &_types);
+
       /// \brief Deletes an existing entity
       /// \returns true iff the entity existed
       public: bool DeleteEntity(EntityId _id);
@@ -75,6 +156,36 @@ namespace gazebo
       /// \brief Database clears changed components
       public: void Update();
 
+      /// \brief Merge staged changes, except modified components that
+      ///   can be moved into place later
+      ///
+      /// Lets modified components be committed while other work runs, see
+      /// CommitModified(). A type is only deferred if none of its
+      /// components were added or removed this update.
+      /// \param[in] _defer types whose modified components may wait
+      /// \returns the types that were deferred. Until CommitModified() is
+      ///   called for each, their components and changes must not be
+      ///   accessed, and reactive queries with them aren't updated.
+      public: ComponentMask Update(const ComponentMask &_defer);
+
+      /// \brief Move a type's modified components deferred by the last
+      ///   Update() into place
+      ///
+      /// Reactive queries are committed by the call for the last deferred
+      /// type they have. Calls for different types may run at once.
+      /// \param[in] _type a deferred type
+      public: void CommitModified(ComponentType _type);
+
+      /// \brief Get the memory used by changes merged in the last Update()
+      /// \returns number of bytes staged by all threads
+      public: std::size_t StagingBytes() const;
+
+      /// \brief Get the memory kept for staging changes after the last
+      ///   Update(). Memory a burst of changes needed is freed once it
+      ///   hasn't been needed for a while.
+      /// \returns number of bytes held for all threads
+      public: std::size_t StagingCapacity() const;
+
       /// \brief Get an Entity instance by Id
       public: ::gazebo::ecs::Entity &Entity(EntityId _id) const;
 
@@ -87,6 +198,8 @@ namespace gazebo
               }
 
       /// \brief Add a new component to an entity
+      /// \remarks The component is moved into main storage on the next
+      ///   Update(), so the returned pointer is only valid until then.
       /// \returns pointer to component or nullptr if it already exists
       public: void *AddComponent(EntityId _id, ComponentType _type);
 
@@ -122,6 +235,9 @@ namespace gazebo
               }
 
       /// \brief Get a component that's on an entity for reading or writing
+      /// \remarks Changes become visible to readers on the next Update()
+      /// \returns pointer to a copy of the component, or nullptr if the
+      ///   entity doesn't have it
       public: void *EntityComponentMutable(EntityId _id, ComponentType _type);
 
       /// \brief Test if a component changed last timestep
@@ -135,6 +251,24 @@ namespace gazebo
       /// \brief Test if a component changed last timestep
       public: Difference IsDifferent(EntityId _id, ComponentType _type) const;
 
+      /// \brief Get entities whose component changed last timestep by type
+      public: template <typename T>
+              const std::vector<EntityId> &ChangedEntities() const
+              {
+                ComponentType type = ComponentFactory::Type<T>();
+                return this->ChangedEntities(type);
+              }
+
+      /// \brief Get entities whose component changed last timestep
+      ///
+      /// Lets a system visit only the entities it has to react to. Use
+      /// IsDifferent() to tell how each one changed.
+      /// \param[in] _type type of component
+      /// \returns ids of entities whose component was created, modified or
+      ///   removed, in no particular order. Valid until the next Update().
+      public: const std::vector<EntityId> &ChangedEntities(
+                  ComponentType _type) const;
+
       /// \brief Test hook for instantaneous query results
       public: void InstantQuery(EntityQuery &_query);
 
@@ -18,6 +18,7 @@
 #ifndef GAZEBO_ECS_ENTITYQUERY_HH_
 #define GAZEBO_ECS_ENTITYQUERY_HH_
 
+#include <cstddef>
 #include <memory>
 #include <vector>
 #include <set>
@@ -34,7 +35,97 @@ namespace gazebo
     /// \brief Forward declaration
     class EntityComponentDatabase;
 
+    /// \brief Forward declaration
+    class EntityComponentDatabasePrivate;
+
+    /// \brief Pointers to one type of component on every entity matching a
+    /// query, in the same order as EntityQuery::EntityIds()
+    template <typename T>
+    class ComponentSpan
+    {
+      /// \brief Constructor
+      /// \param[in] _pointers pointers to components
+      public: explicit ComponentSpan(
+                  const std::vector<void const *> &_pointers)
+              : pointers(&_pointers)
+              {
+              }
+
+      /// \brief Get the component of the entity at an index in the results
+      /// \param[in] _index index less than Size()
+      /// \returns pointer to component, or nullptr if the component was
+      ///   removed last update
+      public: T const *operator[](std::size_t _index) const
+              {
+                return static_cast<T const *>((*this->pointers)[_index]);
+              }
+
+      /// \brief Get the number of pointers in the span
+      public: std::size_t Size() const
+              {
+                return this->pointers->size();
+              }
+
+      /// \brief Pointers to components
+      private: const std::vector<void const *> *pointers;
+    };
+
+    /// \brief Components of one type on every entity matching a query, in
+    /// the same order as EntityQuery::EntityIds(), that can be modified
+    class MutableComponentSpan
+    {
+      /// \brief Constructor, use EntityQuery::ComponentsMutable()
+      /// \param[in] _query private data of the query with the results
+      /// \param[in] _column index of the type in the query's results
+      /// \param[in] _pointers pointers to components
+      private: MutableComponentSpan(EntityQueryPrivate *_query,
+                   std::size_t _column,
+                   const std::vector<void const *> &_pointers)
+               : query(_query), column(_column), pointers(&_pointers)
+               {
+               }
+
+      /// \brief Get a copy of the component of the entity at an index in
+      ///   the results that can be modified
+      ///
+      /// Like EntityComponentDatabase::EntityComponentMutable(), but the
+      /// component is found by its position in the pool instead of by
+      /// looking up the entity.
+      /// \param[in] _index index less than Size()
+      /// \returns pointer to the copy, or nullptr if the component was
+      ///   removed last update
+      public: void *Modify(std::size_t _index) const;
+
+      /// \brief Get the number of pointers in the span
+      public: std::size_t Size() const
+              {
+                return this->pointers->size();
+              }
+
+      /// \brief Private data of the query with the results
+      private: EntityQueryPrivate *query;
+
+      /// \brief Index of the type in the query's results
+      private: std::size_t column;
+
+      /// \brief Pointers to components
+      private: const std::vector<void const *> *pointers;
+
+      /// \brief friendship
+      private: friend class EntityQuery;
+    };
+
     /// \brief a Class for querying entities from a manager
+    ///
+    /// An entity matches if it has every component added with
+    /// AddComponent() and none added with Without(). Components added with
+    /// Optional() don't affect matching, but their pointers are in the
+    /// results like those of required components, nullptr where an entity
+    /// lacks them.
+    ///
+    /// A reactive query also lists how its results changed in the last
+    /// update, so a system can sync what changed without visiting every
+    /// entity.
     class EntityQuery
     {
       /// \brief Constructor
@@ -46,7 +137,6 @@ namespace gazebo
       /// \brief Return true if this is an empty/null entity query.
       public: bool IsNull();
 
-      // TODO templated version
       /// \brief Add a component based on a name.
       /// \param[in] _name Name of the component to add. This will look up
       /// the component in the ComponentFactory.
@@ -59,15 +149,84 @@ namespace gazebo
       /// \return True if the _type was successfully added.
       public: bool AddComponent(ComponentType _type);
 
+      /// \brief Add a component by type
+      public: template <typename T>
+              bool AddComponent()
+              {
+                return this->AddComponent(ComponentFactory::Type<T>());
+              }
+
+      /// \brief Only match entities that don't have a component
+      /// \param[in] _name Name of the component
+      /// \return True if the component was found in the ComponentFactory
+      ///   and isn't required by this query
+      public: bool Without(const std::string &_name);
+
+      /// \brief Only match entities that don't have a component
+      /// \param[in] _type Type of the component
+      /// \return True if the type is valid and isn't required by this query
+      public: bool Without(ComponentType _type);
+
+      /// \brief Only match entities that don't have a component by type
+      public: template <typename T>
+              bool Without()
+              {
+                return this->Without(ComponentFactory::Type<T>());
+              }
+
+      /// \brief Return a component with the results if an entity has it
+      /// \param[in] _name Name of the component
+      /// \return True if the component was found in the ComponentFactory
+      ///   and isn't excluded by this query
+      public: bool Optional(const std::string &_name);
+
+      /// \brief Return a component with the results if an entity has it
+      /// \param[in] _type Type of the component
+      /// \return True if the type is valid and isn't excluded by this query
+      public: bool Optional(ComponentType _type);
+
+      /// \brief Return a component with the results by type
+      public: template <typename T>
+              bool Optional()
+              {
+                return this->Optional(ComponentFactory::Type<T>());
+              }
+
       /// \brief Get the components that have been added to the query.
       /// \return A const reference to the set of components in this query.
       public: const std::set<ComponentType> &ComponentTypes() const;
 
+      /// \brief Get the components that have been added to the query.
+      /// \return A mask with a bit set for each component in this query.
+      public: const ComponentMask &Mask() const;
+
+      /// \brief Get the components entities must not have
+      /// \return A mask with a bit set for each excluded component
+      public: const ComponentMask &ExcludedMask() const;
+
+      /// \brief Get the components returned if entities have them
+      /// \return A const reference to the set of optional components
+      public: const std::set<ComponentType> &OptionalTypes() const;
+
+      /// \brief Track how the results change every update
+      /// \param[in] _reactive true to fill AddedEntityIds(),
+      ///   RemovedEntityIds() and ModifiedEntityIds()
+      public: void Reactive(bool _reactive);
+
+      /// \brief Get whether the query tracks how its results change
+      /// \return true if the query is reactive
+      public: bool Reactive() const;
+
       /// \brief Returns true if these are the same queries.
       /// \param[in] _rhs The right hand side argument.
-      /// \return True if this query matches _rhs.
+      /// \return True if this query has the same terms as _rhs, whatever
+      ///   their results are.
       public: bool operator==(const EntityQuery &_rhs) const;
 
+      /// \brief Get a hash of the terms of the query
+      /// \return a hash, equal for queries that compare equal
+      public: std::size_t Hash() const;
+
       /// \brief Add an entity.
       /// \param[in] _id Id of the entity to add.
       /// \return True if the entity was added.
@@ -79,17 +238,93 @@ namespace gazebo
       public: void RemoveEntity(const EntityId _id);
 
       /// \brief Get the entity ids that match this query.
-      /// \todo ordered results matching component placement in memory
-      /// \return The entities that match the components in this query.
-      public: const std::set<EntityId> &EntityIds() const;
+      /// \return The entities that match the components in this query,
+      /// sorted from smallest to largest id.
+      public: const std::vector<EntityId> &EntityIds() const;
+
+      /// \brief Get a number of entities whose components fit in cache
+      ///   together, to split the results into chunks
+      /// \return entities per chunk, at least 1
+      public: std::size_t ChunkSize() const;
+
+      /// \brief Get entities that started matching in the last update
+      /// \remarks Only filled by reactive queries. Handle
+      ///   RemovedEntityIds() first, an entity can be in both if it left
+      ///   and came back.
+      /// \return sorted ids that are now in EntityIds()
+      public: const std::vector<EntityId> &AddedEntityIds() const;
+
+      /// \brief Get entities that stopped matching in the last update
+      /// \remarks Only filled by reactive queries. Entities whose required
+      ///   components are removed stay in the results for one update, and
+      ///   are listed here when they leave.
+      /// \return sorted ids that are no longer in EntityIds()
+      public: const std::vector<EntityId> &RemovedEntityIds() const;
+
+      /// \brief Get entities whose required or optional components were
+      ///   created, modified or removed in the last update
+      /// \remarks Only filled by reactive queries. Entities in
+      ///   AddedEntityIds() aren't listed.
+      /// \return sorted ids that are in EntityIds()
+      public: const std::vector<EntityId> &ModifiedEntityIds() const;
+
+      /// \brief Get the components of the entities that match this query
+      /// \remarks Results maintained by the database are valid until its
+      ///   next update.
+      /// \return pointers to components in the same order as EntityIds(),
+      ///   or an empty span if T isn't a required or optional component of
+      ///   this query.
+      public: template <typename T>
+              ComponentSpan<T> Components() const
+              {
+                return ComponentSpan<T>(
+                    this->Components(ComponentFactory::Type<T>()));
+              }
+
+      /// \brief Get the components of the entities that match this query
+      /// \param[in] _type Type of component
+      /// \return pointers to components in the same order as EntityIds(),
+      ///   or an empty vector if _type isn't a required or optional
+      ///   component of this query.
+      public: const std::vector<void const *> &Components(
+                  ComponentType _type) const;
+
+      /// \brief Get the components of the entities that match this query
+      ///   so they can be modified
+      /// \param[in] _type Type of component
+      /// \return a span in the same order as EntityIds(), or an empty span
+      ///   if _type isn't a required or optional component of this query.
+      public: MutableComponentSpan ComponentsMutable(
+                  ComponentType _type) const;
 
       /// \brief Clear results of a query. This will keep the set of
       /// component, and clear the set of entities.
       private: void Clear();
 
+      /// \brief Add an entity on the next call to Commit()
+      /// \param[in] _id Id of the entity, it's fine to add it twice
+      private: void StageAddEntity(const EntityId _id);
+
+      /// \brief Remove an entity on the next call to Commit()
+      /// \param[in] _id Id of the entity, it's fine to remove it twice
+      private: void StageRemoveEntity(const EntityId _id);
+
+      /// \brief Apply staged changes in one pass
+      /// \remarks If an entity was staged more than once the last wins
+      /// \param[in] _update number of the database update the changes
+      ///   belong to. Lists of changes from other updates are forgotten.
+      private: void Commit(uint64_t _update);
+
+      /// \brief Get the types of the components in the results
+      /// \return required and optional types
+      private: const std::set<ComponentType> &ResultTypes() const;
+
       /// \brief friendship
       private: friend EntityComponentDatabase;
 
+      /// \brief friendship
+      private: friend EntityComponentDatabasePrivate;
+
       /// \brief Private data pointer
       private: std::shared_ptr<EntityQueryPrivate> dataPtr;
     };
@@ -18,16 +18,23 @@
 #ifndef GAZEBO_ECS_MANAGER_HH_
 #define GAZEBO_ECS_MANAGER_HH_
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <iostream>
 #include <set>
+#include <vector>
 
 #include <ignition/common/Time.hh>
 
 #include "gazebo/ecs/Componentizer.hh"
 #include "gazebo/ecs/Entity.hh"
+#include "gazebo/ecs/EntityComponentDatabase.hh"
+#include "gazebo/ecs/EntityQuery.hh"
 #include "gazebo/ecs/System.hh"
 #include "gazebo/ecs/ComponentFactory.hh"
+#include "gazebo/ecs/TaskScheduler.hh"
 
 
 namespace gazebo
@@ -37,11 +44,30 @@ namespace gazebo
     /// \brief Forward declare private data class.
     class ManagerPrivate;
 
+    /// \brief Forward declaration
+    class SpatialIndex;
+
     class Manager
     {
+      /// \brief Constructor, with TaskScheduler::DefaultThreadCount()
+      ///   worker threads
       public: Manager();
+
+      /// \brief Constructor
+      /// \param[in] _threads number of worker threads running systems
+      /// \param[in] _cpus CPUs to pin the workers to
+      /// \sa TaskScheduler::TaskScheduler()
+      public: explicit Manager(unsigned int _threads,
+                  const std::vector<int> &_cpus = std::vector<int>());
+
       public: ~Manager();
 
+      /// \brief Get the scheduler that runs systems
+      ///
+      /// Systems can spawn their own tasks on it and wait for them. The
+      /// waiting thread runs tasks meanwhile.
+      public: TaskScheduler &Scheduler();
+
       /// \brief Get the current simulation time
       public: const ignition::common::Time &SimulationTime() const;
 
@@ -66,6 +92,22 @@ namespace gazebo
       /// \brief Creates a new entity
       public: EntityId CreateEntity();
 
+      /// \brief Creates many entities with the same components by type
+      ///
+      /// Ex: auto batch = manager.CreateEntities<Pose, Velocity>(1000);
+      public: template <typename ...Ts>
+              EntityBatch CreateEntities(std::size_t _count)
+              {
+                std::vector<ComponentType> types{
+                  ComponentFactory::Type<Ts>()...};
+                return this->CreateEntities(_count, types);
+              }
+
+      /// \brief Creates many entities with the same components
+      /// \sa EntityComponentDatabase::CreateEntities()
+      public: EntityBatch CreateEntities(std::size_t _count,
+                  const std::vector<ComponentType> &_types);
+
       /// \brief Deletes the given entity
       public: bool DeleteEntity(EntityId _id);
 
@@ -80,6 +122,11 @@ namespace gazebo
 
       /// \brief Load a system
       ///
+      /// Systems run in parallel every update, except those that write
+      /// the same components, see QueryRegistrar::Writes(). Systems that
+      /// declare QueryRegistrar::UpdateEvery() or UpdateRate() are only
+      /// dispatched on the steps they're due.
+      ///
       /// Ex: sm->LoadSystem("my_system", std::move(aUniquePtrInstance))
       public: bool LoadSystem(const std::string &_name,
                   std::unique_ptr<System> _sys);
@@ -99,6 +146,35 @@ namespace gazebo
       /// Ex: sm->LoadComponentizer(std::move(aUniquePtrInstance))
       public: bool LoadComponentizer(std::unique_ptr<Componentizer> _cz);
 
+      /// \brief Commit modified components while systems run
+      ///
+      /// Off by default. When on, components that were only modified
+      /// last update are moved into place by tasks that run alongside
+      /// systems, instead of before any system starts. A system starts
+      /// once the types it declared and the types of its queries are
+      /// committed, so systems that don't need them overlap the commit.
+      /// The share of the database update that overlapped is published
+      /// with the diagnostics.
+      /// \remarks Only call between updates
+      /// \param[in] _pipelined true to turn it on
+      public: void Pipelined(bool _pipelined);
+
+      /// \brief Get whether modified components are committed while
+      ///   systems run
+      public: bool Pipelined() const;
+
+      /// \brief Keep a SpatialIndex of entities with WorldPose and
+      ///   Geometry components, updated before systems every update
+      /// \param[in] _cellSize width of a grid cell in meters
+      /// \return false if the index is already enabled, the cell size
+      ///   isn't positive, or the components aren't registered
+      public: bool EnableSpatialIndex(double _cellSize);
+
+      /// \brief Get the spatial index
+      /// \return the index, or nullptr if EnableSpatialIndex() wasn't
+      ///   called
+      public: const ecs::SpatialIndex *SpatialIndex() const;
+
       /// \brief Load a world from a file path
       /// \param[in] A path to a world file on the file system
       /// \returns true if the sdf is successfully parsed
@@ -114,17 +190,74 @@ namespace gazebo
 
       /// \brief Update everything once, then sleep to achieve a desired
       ///        real time factor.
-      /// \remark Even if this method is called in a tight loop simulation,time
-      //          will very slightly lag behind wall clock time. This is due to
-      //          the sleep time calculations not considering the time it takes
-      //          to calculate the amount of time to sleep before sleeping.
-      /// \param[in] _real_time_factor ratio of sim time to wall clock time
+      ///
+      /// Updates are paced against a schedule started by the first call
+      /// with this real time factor: each returns when the wall time for
+      /// its sim time is due. Updates that run late are made up by the
+      /// next ones returning early, up to 100 ms behind. The achieved and
+      /// target real time factors are published with the diagnostics.
+      /// \remark The schedule restarts when the factor changes, after
+      ///   UpdateOnce() or Step(), and when sim time is paused or jumps
+      /// \param[in] _realTimeFactor ratio of sim time to wall clock time,
+      ///   0 to update without sleeping
       public: void UpdateOnce(double _realTimeFactor);
 
+      /// \brief Update everything many times back to back, as fast as
+      ///   possible
+      ///
+      /// Nothing sleeps and the clock isn't read between updates.
+      /// Diagnostics are published for the last update only.
+      /// \param[in] _steps number of updates
+      public: void Step(uint64_t _steps);
+
       /// \brief Returns an entity instance with the given ID
       /// \returns Entity with id set to NO_ENTITY if entity does not exist
       public: gazebo::ecs::Entity &Entity(const EntityId _id) const;
 
+      /// \brief Get entities whose component changed last update by type
+      public: template <typename T>
+              const std::vector<EntityId> &ChangedEntities() const
+              {
+                ComponentType type = ComponentFactory::Type<T>();
+                return this->ChangedEntities(type);
+              }
+
+      /// \brief Get entities whose component changed last update
+      /// \sa EntityComponentDatabase::ChangedEntities()
+      public: const std::vector<EntityId> &ChangedEntities(
+                  ComponentType _type) const;
+
+      /// \brief Call a function for every entity in a query's results,
+      ///   spread over the worker threads
+      ///
+      /// The results are split into chunks of EntityQuery::ChunkSize()
+      /// entities. The calling thread and idle workers take chunks until
+      /// none are left, and the call returns when all are done.
+      /// EntityComponentMutable() and other staged changes are safe from
+      /// the function, every thread stages its own.
+      /// \param[in] _query results to iterate, usually given to a system
+      /// \param[in] _fn called with the index of each entity in
+      ///   _query.EntityIds(), from many threads at once
+      public: template <typename F>
+              void ParallelForEach(const EntityQuery &_query, F _fn)
+              {
+                this->ParallelForEachChunk(_query,
+                    [&_fn](std::size_t _begin, std::size_t _end)
+                    {
+                      for (std::size_t i = _begin; i < _end; ++i)
+                        _fn(i);
+                    });
+              }
+
+      /// \brief Call a function for every chunk of a query's results,
+      ///   spread over the worker threads
+      /// \sa ParallelForEach()
+      /// \param[in] _query results to iterate
+      /// \param[in] _fn called with the first index of a chunk in
+      ///   _query.EntityIds() and one past its last index
+      public: void ParallelForEachChunk(const EntityQuery &_query,
+                  const std::function<void(std::size_t, std::size_t)> &_fn);
+
       /// \brief Test hook for querying entities
       /// \remarks must not be called while database is being updated
       /// \param[in] _components List of component names to query
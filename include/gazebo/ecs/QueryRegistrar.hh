@@ -18,9 +18,12 @@
 #ifndef GAZEBO_ECS_QUERYREGISTRAR_HH_
 #define GAZEBO_ECS_QUERYREGISTRAR_HH_
 
+#include <array>
+#include <cstddef>
 #include <functional>
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include "gazebo/ecs/EntityQuery.hh"
 
@@ -40,7 +43,36 @@ namespace gazebo
     /// \brief forward declaration
     class QueryRegistrarPrivate;
 
+    /// \brief A list of indices known at compile time
+    template <std::size_t ...Is>
+    struct IndexSequence
+    {
+    };
+
+    /// \brief Makes IndexSequence<0, 1, ..., N - 1>
+    template <std::size_t N, std::size_t ...Is>
+    struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, Is...>
+    {
+    };
+
+    /// \brief Makes IndexSequence<0, 1, ..., N - 1>
+    template <std::size_t ...Is>
+    struct MakeIndexSequence<0, Is...>
+    {
+      /// \brief The sequence
+      typedef IndexSequence<Is...> type;
+    };
+
     /// \brief Used by an ecs::System to register callbacks for query results
+    ///
+    /// A system also declares here which components it reads and writes.
+    /// The manager runs systems in parallel unless both write the same
+    /// type of component, in which case the system loaded first runs
+    /// first. Readers aren't ordered after writers: modifications only
+    /// replace components next update, so every system reads them as they
+    /// were at the last update whatever order they run in. A system that
+    /// declares nothing is assumed to access everything, and doesn't run
+    /// in parallel with any other.
     class QueryRegistrar
     {
       public: QueryRegistrar();
@@ -52,9 +84,202 @@ namespace gazebo
       /// \param[in] _cb callback function
       public: void Register(const EntityQuery &_q, QueryCallback _cb);
 
+      /// \brief adds a query for entities with components of types Ts, and
+      ///   a function called with each of them every update
+      ///
+      /// Ex: _registrar.Register<Pose, Geometry>(
+      ///       [](EntityId _id, const Pose &_pose, const Geometry &_geom){});
+      ///
+      /// Types are looked up once here. Entities whose components were
+      /// removed last update are skipped.
+      /// \param[in] _fn called with an entity's id and its components
+      /// \return false if one of the types isn't registered
+      public: template <typename ...Ts, typename F>
+              bool Register(F _fn)
+              {
+                return this->RegisterRows<Ts...>(_fn,
+                    typename MakeIndexSequence<sizeof...(Ts)>::type());
+              }
+
+      /// \brief Like Register<Ts...>(), but the components can be modified
+      ///
+      /// The function gets copies of the components like
+      /// Entity::ComponentMutable() gives, which replace the components
+      /// next update.
+      /// \param[in] _fn called with an entity's id and its components
+      /// \return false if one of the types isn't registered
+      public: template <typename ...Ts, typename F>
+              bool RegisterMutable(F _fn)
+              {
+                return this->RegisterMutableRows<Ts...>(_fn,
+                    typename MakeIndexSequence<sizeof...(Ts)>::type());
+              }
+
       /// \brief Return the registered callbacks
       public: std::vector<QueryRegistration> Registrations() const;
 
+      /// \brief Declare that the system reads a type of component
+      /// \remarks Register<Ts...>() records that Ts are read, but only
+      ///   calls to Reads(), Writes() or DeclareNone() make the system
+      ///   declared
+      /// \param[in] _type type of the component
+      /// \return false if the type isn't valid
+      public: bool Reads(ComponentType _type);
+
+      /// \brief Declare that the system reads a type of component
+      public: template <typename T>
+              bool Reads()
+              {
+                return this->Reads(ComponentFactory::Type<T>());
+              }
+
+      /// \brief Declare that the system writes a type of component
+      /// \remarks RegisterMutable<Ts...>() records that Ts are written,
+      ///   but doesn't make the system declared either
+      /// \param[in] _type type of the component
+      /// \return false if the type isn't valid
+      public: bool Writes(ComponentType _type);
+
+      /// \brief Declare that the system writes a type of component
+      public: template <typename T>
+              bool Writes()
+              {
+                return this->Writes(ComponentFactory::Type<T>());
+              }
+
+      /// \brief Get the components the system declared it reads
+      /// \return A mask with a bit set for each type
+      public: const ComponentMask &ReadMask() const;
+
+      /// \brief Get the components the system declared it writes
+      /// \return A mask with a bit set for each type
+      public: const ComponentMask &WriteMask() const;
+
+      /// \brief Declare that the system accesses no components, so it
+      ///   doesn't wait for any other system
+      /// \remarks Reads() and Writes() can still add to the declaration
+      public: void DeclareNone();
+
+      /// \brief Get whether the system declared what it accesses
+      /// \return true if DeclareNone() was called, or Reads() or Writes()
+      ///   succeeded at least once
+      public: bool Declared() const;
+
+      /// \brief Declare that the system only updates every few steps
+      ///
+      /// The manager doesn't call the system's callbacks on other steps,
+      /// and spreads systems with the same period over different steps.
+      /// Reactive results only list the changes of the last step, so a
+      /// system that skips steps misses the changes in between.
+      /// \param[in] _steps number of steps between updates, 1 for every
+      /// \return false if _steps is 0
+      public: bool UpdateEvery(unsigned int _steps);
+
+      /// \brief Get the number of steps between updates of the system
+      /// \return 1 unless UpdateEvery() was called
+      public: unsigned int UpdateEvery() const;
+
+      /// \brief Declare how many times per second of sim time the system
+      ///   updates
+      ///
+      /// Turned into UpdateEvery() steps once the manager knows how much
+      /// sim time a step takes. Until then the system updates every step.
+      /// \param[in] _hz updates per second
+      /// \return false if _hz isn't positive
+      public: bool UpdateRate(double _hz);
+
+      /// \brief Get the updates per second declared with UpdateRate()
+      /// \return the rate, or 0 if none was declared
+      public: double UpdateRate() const;
+
+      /// \brief Record that the system accesses a type of component
+      ///   without making it declared, since its callbacks may access
+      ///   more than the types it registered for
+      /// \param[in] _type type of the component
+      /// \param[in] _write true if it's written, false if only read
+      private: void Accesses(ComponentType _type, bool _write);
+
+      /// \brief Make a query for entities with all of some components
+      /// \param[in] _types types of the components
+      /// \param[out] _query the query
+      /// \return false if one of the types isn't registered
+      private: static bool MakeQuery(const ComponentType *_types,
+                   std::size_t _count, EntityQuery &_query);
+
+      /// \brief Register<Ts...>() with an index for every type
+      private: template <typename ...Ts, typename F, std::size_t ...Is>
+               bool RegisterRows(F _fn, IndexSequence<Is...>)
+               {
+                 static_assert(sizeof...(Ts) > 0, "No component types");
+                 const std::array<ComponentType, sizeof...(Ts)> types{
+                   {ComponentFactory::Type<Ts>()...}};
+                 EntityQuery query;
+                 if (!MakeQuery(types.data(), types.size(), query))
+                   return false;
+                 for (ComponentType type : types)
+                   this->Accesses(type, false);
+
+                 this->Register(query,
+                     [types, _fn](const EntityQuery &_result) mutable
+                     {
+                       auto const &ids = _result.EntityIds();
+                       const std::array<void const * const *,
+                         sizeof...(Ts)> columns{
+                           {_result.Components(types[Is]).data()...}};
+                       for (std::size_t i = 0; i < ids.size(); ++i)
+                       {
+                         bool complete = true;
+                         for (void const * const *column : columns)
+                           complete = complete && column[i];
+                         if (complete)
+                         {
+                           _fn(ids[i],
+                               *static_cast<Ts const *>(columns[Is][i])...);
+                         }
+                       }
+                     });
+                 return true;
+               }
+
+      /// \brief RegisterMutable<Ts...>() with an index for every type
+      private: template <typename ...Ts, typename F, std::size_t ...Is>
+               bool RegisterMutableRows(F _fn, IndexSequence<Is...>)
+               {
+                 static_assert(sizeof...(Ts) > 0, "No component types");
+                 const std::array<ComponentType, sizeof...(Ts)> types{
+                   {ComponentFactory::Type<Ts>()...}};
+                 EntityQuery query;
+                 if (!MakeQuery(types.data(), types.size(), query))
+                   return false;
+                 for (ComponentType type : types)
+                   this->Accesses(type, true);
+
+                 this->Register(query,
+                     [types, _fn](const EntityQuery &_result) mutable
+                     {
+                       auto const &ids = _result.EntityIds();
+                       const std::array<void const * const *,
+                         sizeof...(Ts)> columns{
+                           {_result.Components(types[Is]).data()...}};
+                       // Pools are looked up once, rows by their slots
+                       const std::array<MutableComponentSpan,
+                         sizeof...(Ts)> spans{
+                           {_result.ComponentsMutable(types[Is])...}};
+                       for (std::size_t i = 0; i < ids.size(); ++i)
+                       {
+                         bool complete = true;
+                         for (void const * const *column : columns)
+                           complete = complete && column[i];
+                         if (complete)
+                         {
+                           _fn(ids[i],
+                               *static_cast<Ts *>(spans[Is].Modify(i))...);
+                         }
+                       }
+                     });
+                 return true;
+               }
+
       /// \brief private implementation
       private: std::shared_ptr<QueryRegistrarPrivate> dataPtr;
     };
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2017 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef GAZEBO_ECS_SPATIALINDEX_HH_
+#define GAZEBO_ECS_SPATIALINDEX_HH_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <ignition/math/Vector3.hh>
+
+#include "gazebo/ecs/Entity.hh"
+
+namespace gazebo
+{
+  namespace ecs
+  {
+    /// \brief Forward declaration
+    class EntityQuery;
+
+    /// \brief Forward declaration
+    class SpatialIndexPrivate;
+
+    /// \brief An entity hit by a ray
+    struct RayHit
+    {
+      /// \brief Id of the entity
+      EntityId id;
+
+      /// \brief Distance along the ray to the entity's bounds
+      double distance;
+    };
+
+    /// \brief Finds entities near a point or along a ray without visiting
+    ///   every entity
+    ///
+    /// Entities are bounded by spheres and kept in a loose uniform grid,
+    /// each in the cell holding its center. Spheres larger than a cell are
+    /// kept in a separate list that every query checks. Results are
+    /// computed against the bounding spheres, so they're exact for sphere
+    /// geometries and conservative for others.
+    ///
+    /// The manager keeps one up to date from WorldPose and Geometry
+    /// components, see Manager::EnableSpatialIndex(). Queries are const
+    /// and safe to make from many systems at once.
+    class SpatialIndex
+    {
+      /// \brief Constructor
+      /// \param[in] _cellSize width of a grid cell in meters, about the
+      ///   size of the entities works best
+      public: explicit SpatialIndex(double _cellSize);
+
+      /// \brief Destructor
+      public: ~SpatialIndex();
+
+      /// \brief Get the width of a grid cell
+      public: double CellSize() const;
+
+      /// \brief Get the number of entities in the index
+      public: std::size_t Size() const;
+
+      /// \brief Add an entity or move it if it's already in the index
+      /// \param[in] _id Id of the entity
+      /// \param[in] _center center of its bounding sphere
+      /// \param[in] _radius radius of its bounding sphere
+      public: void Set(EntityId _id,
+                  const ignition::math::Vector3d &_center, double _radius);
+
+      /// \brief Remove an entity
+      /// \param[in] _id Id of the entity
+      /// \return true if the entity was in the index
+      public: bool Remove(EntityId _id);
+
+      /// \brief Bring the index up to date with a query's last update
+      ///
+      /// The first call indexes every result, later calls only those
+      /// added, removed or modified.
+      /// \param[in] _result a reactive query requiring WorldPose and
+      ///   Geometry
+      public: void Update(const EntityQuery &_result);
+
+      /// \brief Get entities whose bounds touch a sphere
+      /// \param[in] _point center of the sphere
+      /// \param[in] _radius radius of the sphere
+      /// \return sorted ids
+      public: std::vector<EntityId> Within(
+                  const ignition::math::Vector3d &_point,
+                  double _radius) const;
+
+      /// \brief Get the entities whose bounds are closest to a point
+      /// \param[in] _point the point
+      /// \param[in] _count maximum number of entities to return
+      /// \return ids from closest to furthest, ties ordered by id
+      public: std::vector<EntityId> Nearest(
+                  const ignition::math::Vector3d &_point,
+                  std::size_t _count) const;
+
+      /// \brief Get the entities whose bounds a ray passes through
+      /// \param[in] _origin start of the ray
+      /// \param[in] _direction direction of the ray, need not be unit length
+      /// \param[in] _maxDistance ignore hits further than this
+      /// \return hits from closest to furthest, distance 0 for entities
+      ///   containing the origin
+      public: std::vector<RayHit> Raycast(
+                  const ignition::math::Vector3d &_origin,
+                  const ignition::math::Vector3d &_direction,
+                  double _maxDistance) const;
+
+      /// \brief No copy constructor
+      private: SpatialIndex(const SpatialIndex&) = delete;
+
+      /// \brief No copy assignment
+      private: SpatialIndex &operator=(const SpatialIndex&) = delete;
+
+      /// \brief Private data pointer
+      private: std::unique_ptr<SpatialIndexPrivate> dataPtr;
+    };
+  }
+}
+#endif
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2017 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef GAZEBO_ECS_TASKSCHEDULER_HH_
+#define GAZEBO_ECS_TASKSCHEDULER_HH_
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace gazebo
+{
+  namespace ecs
+  {
+    /// \brief Forward declaration
+    class TaskScheduler;
+
+    /// \brief Forward declaration
+    class TaskSchedulerPrivate;
+
+    /// \brief Tasks that are waited for together
+    class TaskGroup
+    {
+      /// \brief Constructor
+      public: TaskGroup() = default;
+
+      /// \brief Get whether every task spawned in the group has finished
+      public: bool Done() const
+              {
+                return this->pending.load(std::memory_order_acquire) == 0;
+              }
+
+      /// \brief No copy constructor
+      private: TaskGroup(const TaskGroup&) = delete;
+
+      /// \brief No copy assignment
+      private: TaskGroup &operator=(const TaskGroup&) = delete;
+
+      /// \brief Number of tasks spawned that haven't finished
+      private: std::atomic<std::size_t> pending{0};
+
+      /// \brief friendship
+      private: friend TaskSchedulerPrivate;
+
+      /// \brief friendship
+      private: friend TaskScheduler;
+    };
+
+    /// \brief Runs small tasks on a fixed set of threads
+    ///
+    /// Every worker thread has its own deque of tasks. A worker pushes
+    /// tasks it spawns on the back of its deque and takes them from the
+    /// back, so nested tasks run while their data is still in cache. Idle
+    /// workers steal from the front of other deques. Tasks spawned by
+    /// other threads go in a shared deque that's stolen from the same way.
+    ///
+    /// A thread waiting for a group runs tasks until the group is done
+    /// instead of sleeping, so tasks may spawn tasks and wait for them.
+    class TaskScheduler
+    {
+      /// \brief Constructor
+      /// \param[in] _threads number of worker threads. With none, tasks
+      ///   only run on threads calling Wait().
+      /// \param[in] _cpus CPUs to pin workers to, worker i to
+      ///   _cpus[i % _cpus.size()]. Empty to let them run anywhere.
+      ///   Only supported on Linux.
+      public: explicit TaskScheduler(unsigned int _threads,
+                  const std::vector<int> &_cpus = std::vector<int>());
+
+      /// \brief Destructor, joins the workers
+      /// \remarks Wait for every group first, unfinished tasks are dropped
+      public: ~TaskScheduler();
+
+      /// \brief Get a number of workers that leaves one core for the
+      ///   thread calling Wait()
+      /// \return one less than the number of cores, at least 1
+      public: static unsigned int DefaultThreadCount();
+
+      /// \brief Get the number of worker threads
+      public: unsigned int ThreadCount() const;
+
+      /// \brief Get whether the workers were pinned to CPUs
+      /// \return false if no CPUs were given or pinning failed
+      public: bool Pinned() const;
+
+      /// \brief Queue a task to run on any thread
+      /// \param[in] _group group the task belongs to, must outlive it
+      /// \param[in] _task function to call
+      public: void Spawn(TaskGroup &_group, std::function<void()> _task);
+
+      /// \brief Run tasks until every task in a group has finished
+      /// \param[in] _group the group
+      public: void Wait(TaskGroup &_group);
+
+      /// \brief No copy constructor
+      private: TaskScheduler(const TaskScheduler&) = delete;
+
+      /// \brief No copy assignment
+      private: TaskScheduler &operator=(const TaskScheduler&) = delete;
+
+      /// \brief Private data pointer
+      private: std::unique_ptr<TaskSchedulerPrivate> dataPtr;
+    };
+  }
+}
+#endif
@@ -59,6 +59,22 @@ namespace gazebo
       /// \param[in] _name Name of the timer to stop.
       public: void StopTimer(const std::string &_name);
 
+      /// \brief Report a value measured during this update
+      /// \remarks Published in the message header with the name as key
+      /// \param[in] _name Name of the value.
+      /// \param[in] _value The value.
+      public: void AddValue(const std::string &_name, double _value);
+
+      /// \brief Turn diagnostics off and on without losing the publisher
+      /// \remarks While off, every other method returns immediately
+      ///   without reading the clock
+      /// \param[in] _enabled false to turn diagnostics off
+      public: void Enabled(bool _enabled);
+
+      /// \brief Get whether diagnostics are on
+      /// \returns true if initialized and not turned off
+      public: bool Enabled() const;
+
       /// \brief private implementation
       private: std::shared_ptr<DiagnosticsManagerPrivate> dataPtr;
     };
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2017 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+#include "Arena.hh"
+
+using namespace gazebo::ecs;
+
+/////////////////////////////////////////////////
+Arena::Arena(std::size_t _blockSize, std::size_t _keepRounds)
+: blockSize(_blockSize),
+  blocksUsed(std::max(_keepRounds, std::size_t(1)), 0)
+{
+}
+
+/////////////////////////////////////////////////
+Arena::~Arena()
+{
+  for (auto const &block : this->blocks)
+    ::operator delete(block.data);
+}
+
+/////////////////////////////////////////////////
+void *Arena::Allocate(std::size_t _size, std::size_t _align)
+{
+  while (true)
+  {
+    if (this->current < this->blocks.size())
+    {
+      const Block &block = this->blocks[this->current];
+      const std::uintptr_t start =
+        reinterpret_cast<std::uintptr_t>(block.data);
+      const std::uintptr_t aligned =
+        (start + this->offset + _align - 1) & ~(std::uintptr_t(_align) - 1);
+      if (aligned + _size <= start + block.size)
+      {
+        this->offset = aligned + _size - start;
+        this->used += _size;
+        return reinterpret_cast<void *>(aligned);
+      }
+      // Doesn't fit, try the next block
+      ++this->current;
+      this->offset = 0;
+      continue;
+    }
+
+    // Out of blocks. Big allocations get a block of their own.
+    Block block;
+    block.size = _size + _align > this->blockSize ?
+      _size + _align : this->blockSize;
+    block.data = static_cast<char *>(::operator new(block.size));
+    this->blocks.push_back(block);
+  }
+}
+
+/////////////////////////////////////////////////
+void Arena::Reset()
+{
+  // Blocks are used in order, so this round needed a prefix of them
+  const std::size_t inUse = std::min(this->blocks.size(),
+      this->current + (this->offset > 0 ? 1 : 0));
+  this->blocksUsed[this->round] = inUse;
+  this->round = (this->round + 1) % this->blocksUsed.size();
+
+  const std::size_t keep = *std::max_element(this->blocksUsed.begin(),
+      this->blocksUsed.end());
+  for (std::size_t b = keep; b < this->blocks.size(); ++b)
+    ::operator delete(this->blocks[b].data);
+  if (keep < this->blocks.size())
+    this->blocks.resize(keep);
+
+  this->current = 0;
+  this->offset = 0;
+  this->used = 0;
+}
+
+/////////////////////////////////////////////////
+std::size_t Arena::BytesUsed() const
+{
+  return this->used;
+}
+
+/////////////////////////////////////////////////
+std::size_t Arena::Capacity() const
+{
+  std::size_t total = 0;
+  for (auto const &block : this->blocks)
+    total += block.size;
+  return total;
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2017 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef GAZEBO_ECS_ARENA_HH_
+#define GAZEBO_ECS_ARENA_HH_
+
+#include <cstddef>
+#include <vector>
+
+namespace gazebo
+{
+  namespace ecs
+  {
+    /// \brief Monotonic allocator for memory that is freed all at once
+    ///
+    /// Allocations bump a pointer through a list of blocks. Nothing is
+    /// freed until Reset(), which keeps the blocks for the next round, so
+    /// once the arena has grown to fit a round it stops calling malloc.
+    /// Blocks that none of the last few rounds needed are freed by Reset(),
+    /// so one burst doesn't hold on to its memory forever.
+    /// Not thread safe.
+    class Arena
+    {
+      /// \brief Constructor
+      /// \param[in] _blockSize Size of blocks allocated from the heap
+      /// \param[in] _keepRounds Number of rounds whose blocks are kept
+      public: explicit Arena(std::size_t _blockSize = 64 * 1024,
+                  std::size_t _keepRounds = 16);
+
+      /// \brief Destructor, frees all blocks
+      public: ~Arena();
+
+      /// \brief Allocate memory
+      /// \param[in] _size number of bytes
+      /// \param[in] _align alignment, must be a power of 2
+      /// \returns pointer to memory valid until Reset()
+      public: void *Allocate(std::size_t _size, std::size_t _align);
+
+      /// \brief Make all memory available again, freeing blocks beyond the
+      ///   most any of the last rounds used
+      public: void Reset();
+
+      /// \brief Get the number of bytes allocated since the last Reset()
+      public: std::size_t BytesUsed() const;
+
+      /// \brief Get the number of bytes of blocks held by the arena
+      public: std::size_t Capacity() const;
+
+      /// \brief No copy constructor
+      private: Arena(const Arena&) = delete;
+
+      /// \brief No copy assignment
+      private: Arena &operator=(const Arena&) = delete;
+
+      /// \brief A chunk of memory from the heap
+      private: struct Block
+               {
+                 /// \brief Start of the block
+                 char *data;
+
+                 /// \brief Size of the block in bytes
+                 std::size_t size;
+               };
+
+      /// \brief Blocks in the order they are used
+      private: std::vector<Block> blocks;
+
+      /// \brief Size of blocks allocated from the heap
+      private: std::size_t blockSize;
+
+      /// \brief Index of the block being allocated from
+      private: std::size_t current = 0;
+
+      /// \brief Offset of the next free byte in the current block
+      private: std::size_t offset = 0;
+
+      /// \brief Bytes allocated since the last Reset()
+      private: std::size_t used = 0;
+
+      /// \brief Number of blocks used by each of the last rounds, oldest
+      ///   overwritten first
+      private: std::vector<std::size_t> blocksUsed;
+
+      /// \brief Index in blocksUsed of the round in progress
+      private: std::size_t round = 0;
+    };
+
+    /// \brief Standard library allocator backed by an Arena
+    template <typename T>
+    class ArenaAllocator
+    {
+      /// \brief Type being allocated
+      public: typedef T value_type;
+
+      /// \brief Constructor
+      /// \param[in] _arena Arena to allocate from
+      public: explicit ArenaAllocator(Arena *_arena)
+              : arena(_arena)
+              {
+              }
+
+      /// \brief Converting constructor needed by containers
+      public: template <typename U>
+              ArenaAllocator(const ArenaAllocator<U> &_other)
+              : arena(_other.arena)
+              {
+              }
+
+      /// \brief Allocate memory for objects
+      /// \param[in] _count number of objects
+      public: T *allocate(std::size_t _count)
+              {
+                return static_cast<T *>(
+                    this->arena->Allocate(_count * sizeof(T), alignof(T)));
+              }
+
+      /// \brief Does nothing, the arena frees memory on Reset()
+      public: void deallocate(T *, std::size_t)
+              {
+              }
+
+      /// \brief Arena to allocate from
+      public: Arena *arena;
+    };
+
+    /// \brief Allocators are equal if they use the same arena
+    template <typename T, typename U>
+    bool operator==(const ArenaAllocator<T> &_a, const ArenaAllocator<U> &_b)
+    {
+      return _a.arena == _b.arena;
+    }
+
+    /// \brief Allocators are equal if they use the same arena
+    template <typename T, typename U>
+    bool operator!=(const ArenaAllocator<T> &_a, const ArenaAllocator<U> &_b)
+    {
+      return _a.arena != _b.arena;
+    }
+  }
+}
+
+#endif
@@ -25,4 +25,6 @@ std::map<std::string, ComponentType> ComponentFactory::typesByName;
 
 std::map<std::size_t, ComponentType> ComponentFactory::typesByHash;
 
-std::vector<ComponentTypeInfo> ComponentFactory::typeInfoById;
+ComponentTypeInfo ComponentFactory::typeInfoById[MAX_COMPONENT_TYPES];
+
+std::atomic<int> ComponentFactory::numTypes(0);
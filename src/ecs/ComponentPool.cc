@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) 2017 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#include "ComponentPool.hh"
+
+using namespace gazebo::ecs;
+
+/// \brief The slot has no modified copy
+static const uint8_t CLEAN = 0;
+
+/// \brief A thread is making the modified copy
+static const uint8_t COPYING = 1;
+
+/// \brief The modified copy can be used
+static const uint8_t READY = 2;
+
+/// \brief Number of slots tracked by one word of the dirty bitset
+static const std::size_t BITS_PER_WORD = 64;
+
+/////////////////////////////////////////////////
+/// \brief Allocate memory with an alignment larger than operator new gives
+/// \param[in] _size number of bytes
+/// \param[in] _alignment alignment, a power of 2
+/// \returns memory to be freed with AlignedFree()
+static char *AlignedAlloc(std::size_t _size, std::size_t _alignment)
+{
+  // Room to align the start and to remember where the allocation begins
+  char *raw = static_cast<char *>(
+      ::operator new(_size + _alignment + sizeof(void *)));
+  std::uintptr_t start = reinterpret_cast<std::uintptr_t>(raw) +
+    sizeof(void *);
+  start = (start + _alignment - 1) & ~(std::uintptr_t(_alignment) - 1);
+  char *aligned = reinterpret_cast<char *>(start);
+  reinterpret_cast<void **>(aligned)[-1] = raw;
+  return aligned;
+}
+
+/////////////////////////////////////////////////
+/// \brief Free memory from AlignedAlloc()
+/// \param[in] _memory memory to free, may be nullptr
+static void AlignedFree(char *_memory)
+{
+  if (_memory)
+    ::operator delete(reinterpret_cast<void **>(_memory)[-1]);
+}
+
+/////////////////////////////////////////////////
+ComponentPool::ComponentPool(ComponentType _type)
+: type(_type), info(ComponentFactory::TypeInfo(_type))
+{
+  // The stride is a multiple of the alignment, so with an aligned buffer
+  // every component is aligned
+  this->stride = this->info.stride;
+}
+
+/////////////////////////////////////////////////
+ComponentPool::~ComponentPool()
+{
+  // Modifications that were never committed are moved in first
+  this->CommitModified();
+
+  this->info.destructMany(this->data, this->ids.size(), this->stride);
+  AlignedFree(this->data);
+  AlignedFree(this->next.load());
+}
+
+/////////////////////////////////////////////////
+ComponentType ComponentPool::Type() const
+{
+  return this->type;
+}
+
+/////////////////////////////////////////////////
+std::size_t ComponentPool::Size() const
+{
+  return this->ids.size();
+}
+
+/////////////////////////////////////////////////
+void *ComponentPool::Insert(EntityId _id, void *_component)
+{
+  const std::size_t index = EntityIndex(_id);
+  if (_id < 0 || (index < this->sparse.size() && this->sparse[index] >= 0))
+    return nullptr;
+
+  if (this->ids.size() == this->capacity)
+    this->Reserve(this->capacity ? this->capacity * 2 : 16);
+
+  if (index >= this->sparse.size())
+    this->sparse.resize(index + 1, -1);
+
+  const std::size_t slot = this->ids.size();
+  void *location = this->At(slot);
+  this->info.mover(_component, location);
+  this->ids.push_back(_id);
+  this->sparse[index] = slot;
+  ++this->version;
+  this->movedIds.push_back(_id);
+  this->MarkChanged(_id, WAS_CREATED);
+  return location;
+}
+
+/////////////////////////////////////////////////
+bool ComponentPool::InsertMany(const EntityId *_ids, void *_components,
+    std::size_t _count)
+{
+  for (std::size_t i = 0; i < _count; ++i)
+  {
+    const std::size_t index = EntityIndex(_ids[i]);
+    if (_ids[i] < 0 ||
+        (index < this->sparse.size() && this->sparse[index] >= 0))
+    {
+      return false;
+    }
+  }
+
+  const std::size_t first = this->ids.size();
+  if (first + _count > this->capacity)
+    this->Reserve(std::max(first + _count, this->capacity * 2));
+
+  // The components are packed, in the pool they may be padded
+  if (this->stride == this->info.size)
+  {
+    this->info.moveMany(_components, this->At(first), _count, this->stride);
+  }
+  else
+  {
+    for (std::size_t i = 0; i < _count; ++i)
+    {
+      this->info.mover(static_cast<char *>(_components) + i * this->info.size,
+          this->At(first + i));
+    }
+  }
+  for (std::size_t i = 0; i < _count; ++i)
+  {
+    const std::size_t index = EntityIndex(_ids[i]);
+    if (index >= this->sparse.size())
+      this->sparse.resize(index + 1, -1);
+    this->sparse[index] = first + i;
+    this->ids.push_back(_ids[i]);
+    this->movedIds.push_back(_ids[i]);
+    this->MarkChanged(_ids[i], WAS_CREATED);
+  }
+  ++this->version;
+  return true;
+}
+
+/////////////////////////////////////////////////
+bool ComponentPool::Erase(EntityId _id)
+{
+  const int slot = this->Slot(_id);
+  if (slot < 0)
+    return false;
+
+  const std::size_t last = this->ids.size() - 1;
+  this->info.destructor(this->At(slot));
+  if (static_cast<std::size_t>(slot) != last)
+  {
+    // Fill the hole with the last component to keep the pool dense
+    this->info.mover(this->At(last), this->At(slot));
+    this->ids[slot] = this->ids[last];
+    this->sparse[EntityIndex(this->ids[slot])] = slot;
+    this->movedIds.push_back(this->ids[slot]);
+  }
+  this->ids.pop_back();
+  this->sparse[EntityIndex(_id)] = -1;
+  ++this->version;
+  this->movedIds.push_back(_id);
+  this->MarkChanged(_id, WAS_DELETED);
+  return true;
+}
+
+/////////////////////////////////////////////////
+void ComponentPool::Reserve(std::size_t _count)
+{
+  if (_count <= this->capacity)
+    return;
+
+  char *newData = AlignedAlloc(_count * this->stride, this->info.alignment);
+  this->info.moveMany(this->data, newData, this->ids.size(), this->stride);
+  AlignedFree(this->data);
+
+  // Only called during an update after modifications have been committed,
+  // so the modified copies hold nothing
+  if (this->next.load())
+  {
+    AlignedFree(this->next.load());
+    this->next.store(AlignedAlloc(_count * this->stride,
+          this->info.alignment));
+  }
+
+  std::unique_ptr<std::atomic<uint8_t>[]> newStates(
+      new std::atomic<uint8_t>[_count]);
+  for (std::size_t i = 0; i < _count; ++i)
+    newStates[i].store(CLEAN, std::memory_order_relaxed);
+  this->states = std::move(newStates);
+
+  const std::size_t words = (_count + BITS_PER_WORD - 1) / BITS_PER_WORD;
+  std::unique_ptr<std::atomic<uint64_t>[]> newDirty(
+      new std::atomic<uint64_t>[words]);
+  for (std::size_t i = 0; i < words; ++i)
+    newDirty[i].store(0, std::memory_order_relaxed);
+  this->dirty = std::move(newDirty);
+
+  this->data = newData;
+  this->capacity = _count;
+  this->ids.reserve(_count);
+  ++this->version;
+  this->ClearMoves();
+}
+
+/////////////////////////////////////////////////
+void *ComponentPool::Modify(std::size_t _slot)
+{
+  char *copies = this->next.load(std::memory_order_acquire);
+  if (!copies)
+  {
+    // First modification of any component of this type
+    char *fresh = AlignedAlloc(this->capacity * this->stride,
+        this->info.alignment);
+    if (this->next.compare_exchange_strong(copies, fresh,
+          std::memory_order_acq_rel, std::memory_order_acquire))
+    {
+      copies = fresh;
+    }
+    else
+    {
+      AlignedFree(fresh);
+    }
+  }
+
+  void *copy = copies + _slot * this->stride;
+  std::atomic<uint8_t> &state = this->states[_slot];
+  uint8_t expected = CLEAN;
+  if (state.compare_exchange_strong(expected, COPYING,
+        std::memory_order_acquire))
+  {
+    this->info.deepCopier(this->At(_slot), copy);
+    this->dirty[_slot / BITS_PER_WORD].fetch_or(
+        uint64_t(1) << (_slot % BITS_PER_WORD), std::memory_order_relaxed);
+    this->anyModified.store(true, std::memory_order_relaxed);
+    state.store(READY, std::memory_order_release);
+  }
+  else
+  {
+    // Another thread is copying it
+    while (state.load(std::memory_order_acquire) != READY)
+      std::this_thread::yield();
+  }
+  return copy;
+}
+
+/////////////////////////////////////////////////
+void ComponentPool::CommitModified()
+{
+  char *copies = this->next.load();
+  if (!copies || !this->anyModified.exchange(false))
+    return;
+
+  const std::size_t words = (this->capacity + BITS_PER_WORD - 1) /
+    BITS_PER_WORD;
+  for (std::size_t w = 0; w < words; ++w)
+  {
+    uint64_t bits = this->dirty[w].exchange(0, std::memory_order_relaxed);
+    std::size_t bit = 0;
+    while (bits)
+    {
+      // Runs of set bits from lowest to highest, so slots are visited in
+      // order and neighbours are committed together
+      while (!(bits & (uint64_t(1) << bit)))
+        ++bit;
+      std::size_t end = bit;
+      while (end < BITS_PER_WORD && (bits & (uint64_t(1) << end)))
+      {
+        bits &= ~(uint64_t(1) << end);
+        ++end;
+      }
+      this->CommitRun(w * BITS_PER_WORD + bit, end - bit);
+      bit = end;
+    }
+  }
+}
+
+/////////////////////////////////////////////////
+void ComponentPool::CommitRun(std::size_t _first, std::size_t _count)
+{
+  char *copies = this->next.load();
+  const std::size_t size = this->ids.size();
+  const std::size_t inPool = _first >= size ? 0 :
+    std::min(_count, size - _first);
+
+  // Move in place so pointers to the components stay valid
+  if (this->info.trivial)
+  {
+    std::memcpy(this->At(_first), copies + _first * this->stride,
+        inPool * this->stride);
+  }
+  else
+  {
+    for (std::size_t slot = _first; slot < _first + inPool; ++slot)
+    {
+      this->info.destructor(this->At(slot));
+      this->info.mover(copies + slot * this->stride, this->At(slot));
+    }
+  }
+
+  // Copies of components that were removed since they were modified
+  this->info.destructMany(copies + (_first + inPool) * this->stride,
+      _count - inPool, this->stride);
+
+  for (std::size_t slot = _first; slot < _first + _count; ++slot)
+  {
+    if (slot < size)
+      this->MarkChanged(this->ids[slot], WAS_MODIFIED);
+    this->states[slot].store(CLEAN, std::memory_order_relaxed);
+  }
+}
+
+/////////////////////////////////////////////////
+void ComponentPool::ClearChanges()
+{
+  for (EntityId id : this->changedIds)
+    this->changes[EntityIndex(id)] = ChangeRecord();
+  this->changedIds.clear();
+}
+
+/////////////////////////////////////////////////
+void ComponentPool::MarkChanged(EntityId _id, Difference _difference)
+{
+  const std::size_t index = EntityIndex(_id);
+  if (index >= this->changes.size())
+    this->changes.resize(index + 1);
+
+  ChangeRecord &record = this->changes[index];
+  if (record.id != _id)
+  {
+    record.id = _id;
+    this->changedIds.push_back(_id);
+  }
+  // Removed and added again in one update counts as added
+  record.difference = _difference;
+}
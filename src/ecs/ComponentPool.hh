@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) 2017 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef GAZEBO_ECS_COMPONENTPOOL_HH_
+#define GAZEBO_ECS_COMPONENTPOOL_HH_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "gazebo/ecs/ComponentFactory.hh"
+#include "gazebo/ecs/Entity.hh"
+
+namespace gazebo
+{
+  namespace ecs
+  {
+    /// \brief Densely packed storage for all components of one type
+    ///
+    /// Components live in one contiguous buffer aligned for their type, and
+    /// padded to cache lines if the type was registered that way. A sparse
+    /// array maps an entity's index to a slot in the buffer, and a dense
+    /// array maps a slot back to the EntityId that owns it, so lookups,
+    /// inserts and removals are O(1). Lookups with a stale id whose index has been recycled find
+    /// nothing. The pool is only modified by EntityComponentDatabase::Update(),
+    /// so pointers handed out between updates stay valid until then.
+    ///
+    /// Modifications are double buffered. Next to the current components
+    /// is a second buffer with the same layout. The first Modify() of a
+    /// component since the last update copies it into the second buffer,
+    /// and CommitModified() moves it back. Until then readers see the
+    /// component as it was at the last update.
+    ///
+    /// The pool also remembers which components were created, modified or
+    /// removed by the last update. Looking one up is O(1), and forgetting
+    /// them costs as much as there were changes.
+    class ComponentPool
+    {
+      /// \brief Constructor
+      /// \param[in] _type The type of component stored in this pool
+      public: explicit ComponentPool(ComponentType _type);
+
+      /// \brief Destructor, destructs all components still in the pool
+      public: ~ComponentPool();
+
+      /// \brief Get the type of component stored in this pool
+      public: ComponentType Type() const;
+
+      /// \brief Get the number of components in the pool
+      public: std::size_t Size() const;
+
+      /// \brief Get a number that changes whenever components move
+      /// \remarks Pointers to components are still valid if it hasn't
+      ///   changed, unless the component itself was removed
+      public: uint64_t Version() const
+              {
+                return this->version;
+              }
+
+      /// \brief Get the version from which MovedIds() lists every move
+      /// \remarks Pointers handed out at an older version must all be
+      ///   found again
+      public: uint64_t MovedSince() const
+              {
+                return this->movedSince;
+              }
+
+      /// \brief Get entities whose component was inserted, moved or
+      ///   erased since MovedSince()
+      /// \returns ids in the order their components moved
+      public: const std::vector<EntityId> &MovedIds() const
+              {
+                return this->movedIds;
+              }
+
+      /// \brief Forget moves, called at the start of an update
+      public: void ClearMoves()
+              {
+                this->movedIds.clear();
+                this->movedSince = this->version;
+              }
+
+      /// \brief Get the slot holding an entity's component
+      /// \param[in] _id Id of the entity
+      /// \returns slot index or -1 if the entity has no component here
+      public: int Slot(EntityId _id) const
+              {
+                const std::size_t index = EntityIndex(_id);
+                if (_id >= 0 && index < this->sparse.size())
+                {
+                  const int slot = this->sparse[index];
+                  if (slot >= 0 && this->ids[slot] == _id)
+                    return slot;
+                }
+                return -1;
+              }
+
+      /// \brief Get a component by entity
+      /// \param[in] _id Id of the entity
+      /// \returns pointer to the component or nullptr if there is none
+      public: void *Find(EntityId _id) const
+              {
+                const int slot = this->Slot(_id);
+                if (slot < 0)
+                  return nullptr;
+                return this->data + slot * this->stride;
+              }
+
+      /// \brief Get a component by slot
+      /// \param[in] _slot a slot index less than Size()
+      public: void *At(std::size_t _slot) const
+              {
+                return this->data + _slot * this->stride;
+              }
+
+      /// \brief Get the slot of a component in the pool
+      /// \param[in] _component pointer returned by At() or Find()
+      public: std::size_t SlotOf(void const *_component) const
+              {
+                return (static_cast<char const *>(_component) - this->data) /
+                  this->stride;
+              }
+
+      /// \brief Get the entity owning a slot
+      /// \param[in] _slot a slot index less than Size()
+      public: EntityId IdAt(std::size_t _slot) const
+              {
+                return this->ids[_slot];
+              }
+
+      /// \brief Move a constructed component into the pool
+      /// \param[in] _id Id of the entity that owns the component
+      /// \param[in,out] _component Component to move into the pool. It is
+      ///   destructed but its memory is not freed.
+      /// \returns pointer to the component in the pool, or nullptr if the
+      ///   entity's index already has a component in this pool. The
+      ///   component is not moved in that case.
+      public: void *Insert(EntityId _id, void *_component);
+
+      /// \brief Move components stored back to back into the pool
+      /// \param[in] _ids Ids of the entities that own the components
+      /// \param[in,out] _components Components stored back to back to
+      ///   move into the pool. They're destructed but their memory is not
+      ///   freed.
+      /// \param[in] _count number of components
+      /// \returns false if an entity's index already has a component in
+      ///   this pool, in which case nothing is moved
+      public: bool InsertMany(const EntityId *_ids, void *_components,
+                  std::size_t _count);
+
+      /// \brief Destruct an entity's component and remove it from the pool
+      ///
+      /// The last component in the pool is moved into the freed slot, both
+      /// entities are listed in MovedIds()
+      /// \param[in] _id Id of the entity
+      /// \returns true if the entity had a component in this pool
+      public: bool Erase(EntityId _id);
+
+      /// \brief Make sure there is room for at least _count components
+      ///
+      /// If the storage grows every component moves, so moves listed
+      /// before are forgotten
+      /// \param[in] _count number of components
+      public: void Reserve(std::size_t _count);
+
+      /// \brief Get a copy of a component that can be modified
+      ///
+      /// Safe to call from many threads at once. Every call for the same
+      /// slot until the next CommitModified() returns the same copy.
+      /// \param[in] _slot a slot index less than Size()
+      /// \returns pointer to the copy
+      public: void *Modify(std::size_t _slot);
+
+      /// \brief Get whether any component was modified since the last
+      ///   CommitModified()
+      public: bool HasModified() const
+              {
+                return this->anyModified.load(std::memory_order_relaxed);
+              }
+
+      /// \brief Replace components with their modified copies
+      public: void CommitModified();
+
+      /// \brief Get how an entity's component changed last update
+      /// \param[in] _id Id of the entity
+      /// \returns the change, or NO_DIFFERENCE if it didn't change
+      public: Difference Change(EntityId _id) const
+              {
+                const std::size_t index = EntityIndex(_id);
+                if (_id >= 0 && index < this->changes.size() &&
+                    this->changes[index].id == _id)
+                {
+                  return this->changes[index].difference;
+                }
+                return NO_DIFFERENCE;
+              }
+
+      /// \brief Get entities whose component changed last update
+      /// \returns ids in the order they changed, removed components
+      ///   included
+      public: const std::vector<EntityId> &ChangedIds() const
+              {
+                return this->changedIds;
+              }
+
+      /// \brief Forget all changes, called at the start of an update
+      public: void ClearChanges();
+
+      /// \brief Replace a run of components with their modified copies
+      /// \param[in] _first first slot of the run
+      /// \param[in] _count number of slots in the run
+      private: void CommitRun(std::size_t _first, std::size_t _count);
+
+      /// \brief Remember that a component changed
+      /// \param[in] _id Id of the entity
+      /// \param[in] _difference how it changed
+      private: void MarkChanged(EntityId _id, Difference _difference);
+
+      /// \brief No copy constructor
+      private: ComponentPool(const ComponentPool&) = delete;
+
+      /// \brief No copy assignment
+      private: ComponentPool &operator=(const ComponentPool&) = delete;
+
+      /// \brief Type of the stored components
+      private: ComponentType type;
+
+      /// \brief Type info of the stored components
+      private: const ComponentTypeInfo &info;
+
+      /// \brief Distance in bytes between two components
+      private: std::size_t stride;
+
+      /// \brief Contiguous component storage
+      private: char *data = nullptr;
+
+      /// \brief Number of components the storage can hold
+      private: std::size_t capacity = 0;
+
+      /// \brief EntityId owning each slot, index is the slot
+      private: std::vector<EntityId> ids;
+
+      /// \brief Slot of each entity's component, index is the entity index
+      private: std::vector<int> sparse;
+
+      /// \brief Incremented when components are added, moved or removed
+      private: uint64_t version = 0;
+
+      /// \brief Version when movedIds started
+      private: uint64_t movedSince = 0;
+
+      /// \brief Entities whose component moved since movedSince
+      private: std::vector<EntityId> movedIds;
+
+      /// \brief Modified copies of components, allocated on first use
+      private: std::atomic<char *> next{nullptr};
+
+      /// \brief State of each slot's modified copy
+      /// \remarks one of CLEAN, COPYING or READY, index is the slot
+      private: std::unique_ptr<std::atomic<uint8_t>[]> states;
+
+      /// \brief One bit per slot set when its component is modified
+      private: std::unique_ptr<std::atomic<uint64_t>[]> dirty;
+
+      /// \brief Set when any bit in dirty is
+      private: std::atomic<bool> anyModified{false};
+
+      /// \brief How a component changed last update
+      private: struct ChangeRecord
+               {
+                 /// \brief Entity that owned the component
+                 EntityId id = NO_ENTITY;
+
+                 /// \brief What happened to it
+                 Difference difference = NO_DIFFERENCE;
+               };
+
+      /// \brief Changes last update, index is the entity index
+      private: std::vector<ChangeRecord> changes;
+
+      /// \brief Entities with an entry in changes
+      private: std::vector<EntityId> changedIds;
+    };
+  }
+}
+
+#endif
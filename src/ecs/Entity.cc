@@ -58,6 +58,7 @@ Entity &Entity::operator=(Entity &&_entity)
 {
   this->dataPtr = std::move(_entity.dataPtr);
   _entity.dataPtr.reset(new EntityPrivate());
+  return *this;
 }
 
 /////////////////////////////////////////////////
@@ -16,73 +16,341 @@
 */
 
 #include <algorithm>
-#include <assert.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <new>
 #include <set>
+#include <thread>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "gazebo/ecs/EntityComponentDatabase.hh"
 #include "gazebo/ecs/EntityQuery.hh"
-
+#include "Arena.hh"
+#include "ComponentPool.hh"
+#include "EntityQueryPrivate.hh"
 
 using namespace gazebo::ecs;
 
 typedef std::pair<EntityId, ComponentType> StorageKey;
 
-class gazebo::ecs::EntityComponentDatabasePrivate
+/// \brief Vector whose memory comes from an Arena
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+/// \brief Map whose memory comes from an Arena
+template <typename K, typename V>
+using ArenaMap = std::map<K, V, std::less<K>,
+      ArenaAllocator<std::pair<const K, V> > >;
+
+/// \brief Number of entity slots allocated at a time
+static const int SLOT_BLOCK_SIZE = 1024;
+
+/// \brief Max number of slot blocks
+static const int MAX_SLOT_BLOCKS = MAX_ENTITIES / SLOT_BLOCK_SIZE;
+
+/// \brief Storage for one entity index
+struct EntitySlot
+{
+  /// \brief Id of the entity using this slot, or NO_ENTITY if it is free
+  std::atomic<EntityId> id{NO_ENTITY};
+
+  /// \brief Generation given to the next entity created in this slot
+  int generation = 0;
+
+  /// \brief Next index in the free list, or -1 at the end of the list
+  /// \remarks only written by Update() while no entities are being created
+  int nextFree = -1;
+
+  /// \brief Number of updates the database had when the entity was created
+  uint64_t createdAt = 0;
+
+  /// \brief True if the entity is to be deleted next update
+  std::atomic<bool> deleting{false};
+
+  /// \brief Types of components the entity has in main storage
+  ComponentMask components;
+
+  /// \brief Types of components removed last update
+  /// \remarks queries keep matching these for one more update
+  ComponentMask removed;
+
+  /// \brief instance of the entity
+  Entity entity;
+};
+
+/// \brief Entities created together, merged into main storage next update
+/// \remarks Lives in the arena of a staging along with its arrays
+class gazebo::ecs::EntityBatchPrivate
 {
-  /// \brief entities that are to be created next update
-  public: std::vector<EntityId> toCreateEntities;
+  /// \brief Ids of the created entities
+  public: EntityId *ids = nullptr;
+
+  /// \brief Number of created entities
+  public: std::size_t count = 0;
+
+  /// \brief Types of components every entity gets
+  public: ComponentMask mask;
+
+  /// \brief Number of component types
+  public: std::size_t numTypes = 0;
+
+  /// \brief Component types in ascending order
+  public: ComponentType *types = nullptr;
+
+  /// \brief Array of count components for each type
+  public: char **components = nullptr;
+};
+
+/// \brief A reactive query waiting for deferred types to be committed
+struct DeferredQuery
+{
+  /// \brief The query
+  EntityQuery *query = nullptr;
+
+  /// \brief Deferred types the query has components of
+  ComponentMask types;
+
+  /// \brief Number of those types not yet committed
+  std::atomic<std::size_t> pending{0};
+};
+
+/////////////////////////////////////////////////
+/// \brief Changes made by one thread, merged into main storage next update
+struct Staging
+{
+  /// \brief Constructor, makes containers use the arena
+  Staging()
+  : toDeleteEntities(ArenaAllocator<EntityId>(&arena)),
+    toAddComponents(std::less<StorageKey>(),
+        ArenaAllocator<StorageKey>(&arena)),
+    toRemoveComponents(ArenaAllocator<StorageKey>(&arena)),
+    toCreateBatches(ArenaAllocator<EntityBatchPrivate *>(&arena))
+  {
+  }
+
+  /// \brief Forget all changes and make their memory available again
+  /// \remarks Components must have been moved or destructed already
+  void Reset()
+  {
+    // Swapping with empty containers drops their arena memory
+    ArenaVector<EntityId>(ArenaAllocator<EntityId>(&this->arena)).swap(
+        this->toDeleteEntities);
+    ArenaMap<StorageKey, char*>(std::less<StorageKey>(),
+        ArenaAllocator<StorageKey>(&this->arena)).swap(this->toAddComponents);
+    ArenaVector<StorageKey>(ArenaAllocator<StorageKey>(&this->arena)).swap(
+        this->toRemoveComponents);
+    ArenaVector<EntityBatchPrivate *>(
+        ArenaAllocator<EntityBatchPrivate *>(&this->arena)).swap(
+        this->toCreateBatches);
+    this->arena.Reset();
+  }
+
+  /// \brief Memory for staged changes and the containers indexing them
+  /// \remarks Declared first so it outlives the containers
+  Arena arena;
 
   /// \brief entities that are to be deleted next update
-  public: std::set<EntityId> toDeleteEntities;
+  ArenaVector<EntityId> toDeleteEntities;
 
   /// \brief components that are to be created next update
-  public: std::map<StorageKey, char*> toAddComponents;
-
-  /// \brief components that are to be modified next update
-  public: std::map<StorageKey, char*> toModifyComponents;
+  ArenaMap<StorageKey, char*> toAddComponents;
 
   /// \brief components that are to be deleted next update
-  public: std::vector<StorageKey> toRemoveComponents;
+  /// \remarks may contain duplicates, they're skipped during the update
+  ArenaVector<StorageKey> toRemoveComponents;
+
+  /// \brief entities created in batches, their components are created
+  ///   next update
+  ArenaVector<EntityBatchPrivate *> toCreateBatches;
+};
+
+/// \brief The staging a thread used last
+struct StagingCache
+{
+  /// \brief Serial number of the database that owns the staging
+  uint64_t serial = 0;
+
+  /// \brief Staging of this thread in that database
+  Staging *staging = nullptr;
+};
+
+/// \brief Lets a thread find its staging without locking
+static thread_local StagingCache tlStagingCache;
+
+/// \brief Serial number given to the next database
+/// \remarks Addresses can be reused, serial numbers can't
+static std::atomic<uint64_t> nextDatabaseSerial{1};
+
+class gazebo::ecs::EntityComponentDatabasePrivate
+{
+  /// \brief Constructor
+  public: EntityComponentDatabasePrivate();
+
+  /// \brief Destructor, frees entity slots
+  public: ~EntityComponentDatabasePrivate();
+
+  /// \brief Serial number used to find per thread staging
+  public: const uint64_t serial = nextDatabaseSerial.fetch_add(1);
+
+  /// \brief Staging of each thread that has changed something
+  public: std::vector<std::unique_ptr<Staging> > stagings;
+
+  /// \brief Staging for each thread that has changed something
+  public: std::unordered_map<std::thread::id, Staging *> threadStagings;
+
+  /// \brief Mutex used when a thread stages its first change
+  public: std::mutex stagingMtx;
+
+  /// \brief Bytes of staged changes merged by the last update
+  public: std::size_t stagingBytes = 0;
+
+  /// \brief Bytes of memory kept for staging after the last update
+  public: std::size_t stagingCapacity = 0;
 
   /// \brief components that were deleted before this update
+  /// \remarks they're also flagged in the removed mask of their entity
   public: std::vector<StorageKey> removedComponents;
 
-  /// \brief instances of entities
-  public: std::vector<Entity> entities;
+  /// \brief Entity slots allocated in blocks that never move
+  /// \remarks A fixed table so slots can be found without locking while
+  ///   another thread allocates a new block
+  public: std::atomic<EntitySlot *> slotBlocks[MAX_SLOT_BLOCKS];
+
+  /// \brief Number of indices that have ever been handed out
+  public: std::atomic<int> slotCount{0};
 
-  /// \brief deleted entity ids that can be reused
-  public: std::set<EntityId> freeIds;
+  /// \brief Mutex used when allocating a block of slots
+  public: std::mutex slotBlockMtx;
+
+  /// \brief First index of an intrusive list of reusable slots
+  /// \remarks Popped without locking by CreateEntity(), pushed only by
+  ///   Update(). Since nothing is pushed while entities are created a popped
+  ///   index can't come back onto the list, so there's no ABA problem.
+  public: std::atomic<int> freeHead{-1};
 
   /// \brief deleted entity ids that can't yet be reused
-  public: std::set<EntityId> deletedIds;
+  public: std::vector<EntityId> deletedIds;
+
+  /// \brief Number of times Update() has been called
+  public: uint64_t updateCount = 0;
 
-  // TODO better storage of components
-  // Map EntityId/ComponentType pair to an index in this->components
-  public: std::map<StorageKey, int> componentIndices;
-  public: std::vector<char*> components;
-  // Map EntityId/ComponentType pair to the state of a component
-  public: std::map<StorageKey, Difference> differences;
+  /// \brief Reactive queries left uncommitted by the last Update()
+  public: std::vector<std::unique_ptr<DeferredQuery> > deferredQueries;
+
+  /// \brief Component storage, one pool per component type
+  /// \remarks index is the ComponentType, null until the type is first used
+  public: std::vector<std::unique_ptr<ComponentPool> > pools;
+
+  /// \brief Get the pool for a type if it exists
+  /// \returns pointer to pool or nullptr if no component has that type
+  public: ComponentPool *Pool(ComponentType _type) const;
+
+  /// \brief Get the pool for a type, creating it if needed
+  public: ComponentPool &PoolOrCreate(ComponentType _type);
+
+  /// \brief Get the slot for an index
+  /// \returns pointer to slot or nullptr if it hasn't been allocated
+  public: EntitySlot *Slot(int _index) const;
+
+  /// \brief Get a slot for a new entity
+  /// \returns index of the slot, or -1 if there are too many entities
+  public: int AllocateSlot();
+
+  /// \brief Allocate many entity slots
+  /// \param[out] _indices indices of the allocated slots
+  /// \param[in] _count number of slots wanted
+  /// \returns number of slots allocated, less than _count if out of slots
+  public: std::size_t AllocateSlots(int *_indices, std::size_t _count);
+
+  /// \brief Reserve brand new slot indices without ever counting past
+  ///   MAX_ENTITIES, so concurrent readers of slotCount stay in bounds
+  /// \param[in] _wanted number of indices wanted
+  /// \param[out] _first first index reserved
+  /// \returns number of indices reserved, less than _wanted if out of slots
+  public: int ReserveSlots(int _wanted, int &_first);
+
+  /// \brief Make sure the block holding a slot exists
+  /// \param[in] _index index of the slot
+  public: void AllocateSlotBlock(int _index);
+
+  /// \brief Make a new entity visible in an allocated slot
+  /// \param[in] _database database the entity belongs to
+  /// \param[in] _index index of the slot
+  /// \returns id of the new entity
+  public: EntityId PublishEntity(EntityComponentDatabase *_database,
+              int _index);
+
+  /// \brief Move the components of a batch into main storage
+  /// \param[in] _batch batch whose components are moved or destructed
+  public: void MergeBatch(EntityBatchPrivate &_batch);
+
+  /// \brief Get the staging of the calling thread
+  public: Staging &LocalStaging();
+
+  /// \brief Flag a component for removal next update
+  /// \returns true if the entity has the component
+  public: bool StageRemoval(Staging &_staging, EntityId _id,
+              ComponentType _type);
 
   /// \brief update queries because this entity's components have changed
   public: void UpdateQueries(EntityId _id);
 
+  /// \brief Apply staged changes to a query's results and point them at
+  ///   the components in main storage
+  /// \param[in] _update number of the update being committed
+  public: void CommitQuery(EntityQuery &_query, uint64_t _update) const;
+
   /// \brief return true iff the entity exists
   public: bool EntityExists(EntityId _id) const;
 
-  /// \brief check if an entity has these components
-  /// \returns true iff entity has all components in the set
-  public: bool EntityMatches(EntityId _id,
-              const std::set<ComponentType> &_types) const;
+  /// \brief check if an entity belongs in the results of a query
+  /// \param[in] _query query whose terms are checked
+  /// \returns true iff entity has all required components, or had them
+  ///   before the last update, and has none of the excluded ones
+  public: bool EntityMatches(EntityId _id, const EntityQuery &_query) const;
+
+  /// \brief A query and the number of times it was added
+  public: struct QueryEntry
+          {
+            /// \brief The query and its results
+            EntityQuery query;
+
+            /// \brief AddQuery() calls not matched by RemoveQuery()
+            int refCount = 0;
+          };
 
   /// \brief Queries on this manager
-  public: std::vector<EntityQuery> queries;
+  /// \remarks index is the EntityQueryId, nullptr once removed. Ids are
+  ///   not reused.
+  public: std::vector<std::unique_ptr<QueryEntry> > queries;
 
-  /// \brief mutex used for thread safety
-  /// \remarks TODO thread safety without locking everything
-  public: std::mutex mtx;
+  /// \brief Queries that haven't been removed, in order of id
+  public: std::vector<EntityQuery *> liveQueries;
+
+  /// \brief Ids of live queries by EntityQuery::Hash()
+  public: std::unordered_multimap<std::size_t, EntityQueryId> queryIds;
 };
 
+/////////////////////////////////////////////////
+EntityComponentDatabasePrivate::EntityComponentDatabasePrivate()
+{
+  for (auto &block : this->slotBlocks)
+    block.store(nullptr, std::memory_order_relaxed);
+}
+
+/////////////////////////////////////////////////
+EntityComponentDatabasePrivate::~EntityComponentDatabasePrivate()
+{
+  for (auto &block : this->slotBlocks)
+    delete [] block.load(std::memory_order_relaxed);
+}
+
 /////////////////////////////////////////////////
 EntityComponentDatabase::EntityComponentDatabase()
 : dataPtr(new EntityComponentDatabasePrivate)
@@ -92,42 +360,29 @@ EntityComponentDatabase::EntityComponentDatabase()
 /////////////////////////////////////////////////
 EntityComponentDatabase::~EntityComponentDatabase()
 {
-  // Call destructor on the components
-  for (auto const &kv : this->dataPtr->componentIndices)
-  {
-    const ComponentType &type = kv.first.second;
-    const int index = kv.second;
-
-    char *storage = this->dataPtr->components[index];
-    void *data = static_cast<void*>(storage);
-
-    ComponentTypeInfo info = ComponentFactory::TypeInfo(type);
-    info.destructor(data);
-    delete [] storage;
-  }
-
-  // Destruct modified components that never made it to to main storage
-  for (auto const &kv : this->dataPtr->toModifyComponents)
+  // Components in main storage are destructed by their pools
+  for (auto const &staging : this->dataPtr->stagings)
   {
-    const ComponentType &type = kv.first.second;
-    char *storage = kv.second;
-    void *data = static_cast<void*>(storage);
-
-    ComponentTypeInfo info = ComponentFactory::TypeInfo(type);
-    info.destructor(data);
-    delete [] storage;
-  }
+    // Destruct added components that never made it to to main storage
+    for (auto const &kv : staging->toAddComponents)
+    {
+      const ComponentType &type = kv.first.second;
+      char *storage = kv.second;
+      void *data = static_cast<void*>(storage);
 
-  // Destruct added components that never made it to to main storage
-  for (auto const &kv : this->dataPtr->toAddComponents)
-  {
-    const ComponentType &type = kv.first.second;
-    char *storage = kv.second;
-    void *data = static_cast<void*>(storage);
+      ComponentFactory::TypeInfo(type).destructor(data);
+    }
 
-    ComponentTypeInfo info = ComponentFactory::TypeInfo(type);
-    info.destructor(data);
-    delete [] storage;
+    // Destruct components of batches that were never merged
+    for (EntityBatchPrivate *batch : staging->toCreateBatches)
+    {
+      for (std::size_t t = 0; t < batch->numTypes; ++t)
+      {
+        const ComponentTypeInfo &info =
+          ComponentFactory::TypeInfo(batch->types[t]);
+        info.destructMany(batch->components[t], batch->count, info.size);
+      }
+    }
   }
 }
 
@@ -137,12 +392,16 @@ std::pair<EntityQueryId, bool> EntityComponentDatabase::AddQuery(
 {
   bool isDuplicate = false;
   EntityQueryId result = -1;
-  for (size_t i = 0; i < this->dataPtr->queries.size(); ++i)
+  const std::size_t hash = _query.Hash();
+  auto range = this->dataPtr->queryIds.equal_range(hash);
+  for (auto iter = range.first; iter != range.second; ++iter)
   {
-    if (this->dataPtr->queries[i] == _query)
+    auto &entry = this->dataPtr->queries[iter->second];
+    if (entry->query == _query)
     {
-      result = i;
-      // Already have this query, bail
+      // Already have this query, share its results
+      result = iter->second;
+      ++entry->refCount;
       isDuplicate = true;
       break;
     }
@@ -150,20 +409,30 @@ std::pair<EntityQueryId, bool> EntityComponentDatabase::AddQuery(
 
   if (!isDuplicate)
   {
-    auto const types = _query.ComponentTypes();
-    this->dataPtr->queries.push_back(_query);
-    result = this->dataPtr->queries.size() - 1;
-    auto &nonConstQuery = this->dataPtr->queries.back();
-    for (int id = 0; id < this->dataPtr->entities.size(); ++id)
+    std::unique_ptr<EntityComponentDatabasePrivate::QueryEntry> entry(
+        new EntityComponentDatabasePrivate::QueryEntry);
+    entry->query = _query;
+    entry->refCount = 1;
+    result = this->dataPtr->queries.size();
+    auto &nonConstQuery = entry->query;
+    this->dataPtr->queries.push_back(std::move(entry));
+    this->dataPtr->liveQueries.push_back(&nonConstQuery);
+    this->dataPtr->queryIds.insert(std::make_pair(hash, result));
+    const int numSlots = this->dataPtr->slotCount.load();
+    for (int index = 0; index < numSlots; ++index)
     {
+      EntitySlot *slot = this->dataPtr->Slot(index);
+      if (!slot)
+        continue;
+      EntityId id = slot->id.load(std::memory_order_acquire);
       // Check that entity is added and has the required components
-      if (!std::binary_search(this->dataPtr->toCreateEntities.begin(),
-            this->dataPtr->toCreateEntities.end(), id) &&
-            this->dataPtr->EntityMatches(id, types))
+      if (id != NO_ENTITY && slot->createdAt != this->dataPtr->updateCount &&
+          this->dataPtr->EntityMatches(id, nonConstQuery))
       {
-        nonConstQuery.AddEntity(id);
+        nonConstQuery.StageAddEntity(id);
       }
     }
+    this->dataPtr->CommitQuery(nonConstQuery, this->dataPtr->updateCount);
   }
 
   return {result, !isDuplicate};
@@ -172,60 +441,228 @@ std::pair<EntityQueryId, bool> EntityComponentDatabase::AddQuery(
 /////////////////////////////////////////////////
 bool EntityComponentDatabase::RemoveQuery(const EntityQueryId _id)
 {
-  if (_id >= 0 && _id < this->dataPtr->queries.size())
+  if (_id < 0 ||
+      static_cast<std::size_t>(_id) >= this->dataPtr->queries.size() ||
+      !this->dataPtr->queries[_id])
   {
-    this->dataPtr->queries.erase(this->dataPtr->queries.begin() + _id);
-    return true;
+    return false;
   }
 
-  return false;
+  auto &entry = this->dataPtr->queries[_id];
+  if (--entry->refCount > 0)
+    return true;
+
+  // Other queries keep their ids
+  auto &live = this->dataPtr->liveQueries;
+  live.erase(std::find(live.begin(), live.end(), &entry->query));
+  auto range = this->dataPtr->queryIds.equal_range(entry->query.Hash());
+  for (auto iter = range.first; iter != range.second; ++iter)
+  {
+    if (iter->second == _id)
+    {
+      this->dataPtr->queryIds.erase(iter);
+      break;
+    }
+  }
+  entry.reset();
+  return true;
 }
 
 /////////////////////////////////////////////////
 EntityId EntityComponentDatabase::CreateEntity()
 {
-  std::lock_guard<std::mutex> lock(this->dataPtr->mtx);
-  EntityId id;
-  if (!this->dataPtr->freeIds.empty())
+  const int index = this->dataPtr->AllocateSlot();
+  if (index < 0)
+    return NO_ENTITY;
+  return this->dataPtr->PublishEntity(this, index);
+}
+
+/////////////////////////////////////////////////
+EntityBatch EntityComponentDatabase::CreateEntities(std::size_t _count,
+    const std::vector<ComponentType> &_types)
+{
+  ComponentMask mask;
+  for (ComponentType type : _types)
   {
-    // Reuse the smallest deleted EntityId
-    id = *(this->dataPtr->freeIds.begin());
-    this->dataPtr->freeIds.erase(this->dataPtr->freeIds.begin());
-    this->dataPtr->entities[id] = std::move(gazebo::ecs::Entity(this, id));
+    if (type < 0 || type >= MAX_COMPONENT_TYPES)
+      return EntityBatch();
+    mask.set(type);
   }
-  else
+  if (_count == 0)
+    return EntityBatch();
+
+  Staging &staging = this->dataPtr->LocalStaging();
+  Arena &arena = staging.arena;
+
+  // Everything about the batch lives in the arena until next update
+  EntityBatchPrivate *batch = new (arena.Allocate(sizeof(EntityBatchPrivate),
+        alignof(EntityBatchPrivate))) EntityBatchPrivate;
+  int *indices = static_cast<int *>(arena.Allocate(_count * sizeof(int),
+        alignof(int)));
+  batch->ids = static_cast<EntityId *>(arena.Allocate(
+        _count * sizeof(EntityId), alignof(EntityId)));
+  batch->count = this->dataPtr->AllocateSlots(indices, _count);
+  for (std::size_t i = 0; i < batch->count; ++i)
+    batch->ids[i] = this->dataPtr->PublishEntity(this, indices[i]);
+
+  batch->mask = mask;
+  batch->numTypes = mask.count();
+  batch->types = static_cast<ComponentType *>(arena.Allocate(
+        batch->numTypes * sizeof(ComponentType), alignof(ComponentType)));
+  batch->components = static_cast<char **>(arena.Allocate(
+        batch->numTypes * sizeof(char *), alignof(char *)));
+  std::size_t t = 0;
+  for (ComponentType type = 0; type < MAX_COMPONENT_TYPES; ++type)
   {
-    // Create a brand new Id
-    id = this->dataPtr->entities.size();
-    this->dataPtr->entities.push_back(
-        std::move(gazebo::ecs::Entity(this, id)));
+    if (!mask.test(type))
+      continue;
+    const ComponentTypeInfo &info = ComponentFactory::TypeInfo(type);
+    // Packed like an array of the actual type, unlike the pool
+    char *storage = static_cast<char *>(arena.Allocate(
+          batch->count * info.size, info.alignment));
+    info.constructMany(storage, batch->count, info.size);
+    batch->types[t] = type;
+    batch->components[t] = storage;
+    ++t;
   }
+
+  staging.toCreateBatches.push_back(batch);
+  return EntityBatch(batch);
+}
+
+/////////////////////////////////////////////////
+EntityId EntityComponentDatabasePrivate::PublishEntity(
+    EntityComponentDatabase *_database, int _index)
+{
+  // Nobody else can see this slot until its id is published
+  EntitySlot *slot = this->Slot(_index);
+  EntityId id = MakeEntityId(_index, slot->generation);
+  slot->entity = std::move(gazebo::ecs::Entity(_database, id));
   // mark this entity as being created
-  this->dataPtr->toCreateEntities.push_back(id);
-  std::sort(this->dataPtr->toCreateEntities.begin(),
-      this->dataPtr->toCreateEntities.end());
+  slot->createdAt = this->updateCount;
+  slot->deleting.store(false, std::memory_order_relaxed);
+  slot->components.reset();
+  slot->removed.reset();
+  slot->id.store(id, std::memory_order_release);
   return id;
 }
 
+/////////////////////////////////////////////////
+int EntityComponentDatabasePrivate::AllocateSlot()
+{
+  // Reuse a deleted index
+  int index = this->freeHead.load(std::memory_order_acquire);
+  while (index >= 0 && !this->freeHead.compare_exchange_weak(index,
+        this->Slot(index)->nextFree, std::memory_order_acq_rel,
+        std::memory_order_acquire))
+  {
+  }
+  if (index >= 0)
+    return index;
+
+  // Create a brand new index
+  if (this->ReserveSlots(1, index) == 0)
+    return -1;
+
+  this->AllocateSlotBlock(index);
+  return index;
+}
+
+/////////////////////////////////////////////////
+std::size_t EntityComponentDatabasePrivate::AllocateSlots(int *_indices,
+    std::size_t _count)
+{
+  // Reuse deleted indices first
+  std::size_t allocated = 0;
+  while (allocated < _count)
+  {
+    int index = this->freeHead.load(std::memory_order_acquire);
+    while (index >= 0 && !this->freeHead.compare_exchange_weak(index,
+          this->Slot(index)->nextFree, std::memory_order_acq_rel,
+          std::memory_order_acquire))
+    {
+    }
+    if (index < 0)
+      break;
+    _indices[allocated++] = index;
+  }
+  if (allocated == _count)
+    return allocated;
+
+  // Reserve the rest of the indices at once
+  const std::size_t wanted = std::min<std::size_t>(_count - allocated,
+      MAX_ENTITIES);
+  int first = 0;
+  const int reserved = this->ReserveSlots(static_cast<int>(wanted), first);
+  const int last = first + reserved;
+
+  for (int index = first; index < last; ++index)
+  {
+    if (index % SLOT_BLOCK_SIZE == 0 || index == first)
+      this->AllocateSlotBlock(index);
+    _indices[allocated++] = index;
+  }
+  return allocated;
+}
+
+/////////////////////////////////////////////////
+int EntityComponentDatabasePrivate::ReserveSlots(int _wanted, int &_first)
+{
+  int count = this->slotCount.load();
+  int reserved = 0;
+  do
+  {
+    reserved = std::min(_wanted, MAX_ENTITIES - count);
+    if (reserved <= 0)
+      return 0;
+  } while (!this->slotCount.compare_exchange_weak(count, count + reserved));
+  _first = count;
+  return reserved;
+}
+
+/////////////////////////////////////////////////
+void EntityComponentDatabasePrivate::AllocateSlotBlock(int _index)
+{
+  std::atomic<EntitySlot *> &block =
+    this->slotBlocks[_index / SLOT_BLOCK_SIZE];
+  if (!block.load(std::memory_order_acquire))
+  {
+    std::lock_guard<std::mutex> lock(this->slotBlockMtx);
+    if (!block.load(std::memory_order_relaxed))
+      block.store(new EntitySlot[SLOT_BLOCK_SIZE], std::memory_order_release);
+  }
+}
+
+/////////////////////////////////////////////////
+EntitySlot *EntityComponentDatabasePrivate::Slot(int _index) const
+{
+  EntitySlot *block = this->slotBlocks[_index / SLOT_BLOCK_SIZE].load(
+      std::memory_order_acquire);
+  if (!block)
+    return nullptr;
+  return block + (_index % SLOT_BLOCK_SIZE);
+}
+
 /////////////////////////////////////////////////
 bool EntityComponentDatabase::DeleteEntity(EntityId _id)
 {
-  std::lock_guard<std::mutex> lock(this->dataPtr->mtx);
   bool success = false;
   if (this->dataPtr->EntityExists(_id))
   {
     // check if it has already been marked for deletion
-    if (this->dataPtr->toDeleteEntities.find(_id) ==
-          this->dataPtr->toDeleteEntities.end())
+    EntitySlot *slot = this->dataPtr->Slot(EntityIndex(_id));
+    if (!slot->deleting.exchange(true))
     {
-      std::vector<ComponentType> knownTypes = ComponentFactory::Types();
-      for (const ComponentType type : knownTypes)
+      Staging &staging = this->dataPtr->LocalStaging();
+      // Only types that have a pool can have a component on this entity
+      for (auto const &pool : this->dataPtr->pools)
       {
-        this->RemoveComponent(_id, type);
+        if (pool)
+          this->dataPtr->StageRemoval(staging, _id, pool->Type());
       }
 
       // Add this to a list of entities to delete
-      this->dataPtr->toDeleteEntities.insert(_id);
+      staging.toDeleteEntities.push_back(_id);
     }
     success = true;
   }
@@ -236,9 +673,8 @@ bool EntityComponentDatabase::DeleteEntity(EntityId _id)
 /////////////////////////////////////////////////
 gazebo::ecs::Entity &EntityComponentDatabase::Entity(EntityId _id) const
 {
-  std::lock_guard<std::mutex> lock(this->dataPtr->mtx);
   if (this->dataPtr->EntityExists(_id))
-    return this->dataPtr->entities[_id];
+    return this->dataPtr->Slot(EntityIndex(_id))->entity;
   else
   {
     return EntityNull;
@@ -248,23 +684,25 @@ gazebo::ecs::Entity &EntityComponentDatabase::Entity(EntityId _id) const
 /////////////////////////////////////////////////
 void *EntityComponentDatabase::AddComponent(EntityId _id, ComponentType _type)
 {
-  std::lock_guard<std::mutex> lock(this->dataPtr->mtx);
   void *component = nullptr;
   StorageKey key = std::make_pair(_id, _type);
-  // if component has not been added already
-  if (this->dataPtr->componentIndices.find(key) ==
-      this->dataPtr->componentIndices.end() &&
-      this->dataPtr->toAddComponents.find(key) ==
-      this->dataPtr->toAddComponents.end())
+  ComponentPool *pool = this->dataPtr->Pool(_type);
+  if (!this->dataPtr->EntityExists(_id) || (pool && pool->Find(_id)))
+    return component;
+
+  Staging &staging = this->dataPtr->LocalStaging();
+  // if component has not been added already by this thread
+  if (staging.toAddComponents.find(key) == staging.toAddComponents.end())
   {
     // Allocate memory and call constructor
-    ComponentTypeInfo info = ComponentFactory::TypeInfo(_type);
-    // TODO store components of same type in adjacent memory
-    char *storage = new char[info.size];
+    const ComponentTypeInfo &info = ComponentFactory::TypeInfo(_type);
+    // Constructed here, moved into the component's pool next update
+    char *storage = static_cast<char *>(staging.arena.Allocate(info.size,
+          info.alignment));
     component = static_cast<void *>(storage);
     info.constructor(component);
 
-    this->dataPtr->toAddComponents[key] = storage;
+    staging.toAddComponents[key] = storage;
   }
 
   return component;
@@ -272,41 +710,60 @@ void *EntityComponentDatabase::AddComponent(EntityId _id, ComponentType _type)
 
 /////////////////////////////////////////////////
 bool EntityComponentDatabase::RemoveComponent(EntityId _id, ComponentType _type)
+{
+  ComponentPool *pool = this->dataPtr->Pool(_type);
+  if (!pool || !pool->Find(_id))
+    return false;
+  return this->dataPtr->StageRemoval(this->dataPtr->LocalStaging(), _id,
+      _type);
+}
+
+/////////////////////////////////////////////////
+bool EntityComponentDatabasePrivate::StageRemoval(Staging &_staging,
+    EntityId _id, ComponentType _type)
 {
   bool success = false;
-  StorageKey key = std::make_pair(_id, _type);
-  auto kvIter = this->dataPtr->componentIndices.find(key);
-  if (kvIter != this->dataPtr->componentIndices.end())
+  ComponentPool *pool = this->Pool(_type);
+  if (pool && pool->Find(_id))
   {
-    // Check if it has already been removed
-    if (!std::binary_search(this->dataPtr->toRemoveComponents.begin(),
-          this->dataPtr->toRemoveComponents.end(), key))
-    {
-      // Flag this for removal
-      this->dataPtr->toRemoveComponents.push_back(key);
-      std::sort(this->dataPtr->toRemoveComponents.begin(),
-          this->dataPtr->toRemoveComponents.end());
-    }
+    // Flag this for removal. Removing twice is harmless, the update skips
+    // components that are already gone, so there's no need to search here.
+    _staging.toRemoveComponents.push_back(std::make_pair(_id, _type));
     success = true;
   }
 
   return success;
 }
 
+/////////////////////////////////////////////////
+Staging &EntityComponentDatabasePrivate::LocalStaging()
+{
+  StagingCache &cache = tlStagingCache;
+  if (cache.serial != this->serial)
+  {
+    // First change by this thread since it last used another database
+    std::lock_guard<std::mutex> lock(this->stagingMtx);
+    Staging *&staging = this->threadStagings[std::this_thread::get_id()];
+    if (!staging)
+    {
+      this->stagings.emplace_back(new Staging);
+      staging = this->stagings.back().get();
+    }
+    cache.serial = this->serial;
+    cache.staging = staging;
+  }
+  return *cache.staging;
+}
+
 /////////////////////////////////////////////////
 void const *EntityComponentDatabase::EntityComponent(EntityId _id,
     ComponentType _type) const
 {
-  std::lock_guard<std::mutex> lock(this->dataPtr->mtx);
+  // Main storage doesn't change until Update(), so no locking is needed
   void const *component = nullptr;
-  StorageKey key = std::make_pair(_id, _type);
-  if (this->dataPtr->componentIndices.find(key) !=
-      this->dataPtr->componentIndices.end())
-  {
-    auto index = this->dataPtr->componentIndices[key];
-    char *data = this->dataPtr->components[index];
-    component = static_cast<void const *>(data);
-  }
+  ComponentPool *pool = this->dataPtr->Pool(_type);
+  if (pool)
+    component = pool->Find(_id);
   return component;
 }
 
@@ -314,89 +771,89 @@ void const *EntityComponentDatabase::EntityComponent(EntityId _id,
 void *EntityComponentDatabase::EntityComponentMutable(EntityId _id,
     ComponentType _type)
 {
-  std::lock_guard<std::mutex> lock(this->dataPtr->mtx);
   void *component = nullptr;
-  StorageKey key = std::make_pair(_id, _type);
-  auto compIter = this->dataPtr->componentIndices.find(key);
-  if (compIter != this->dataPtr->componentIndices.end())
+  ComponentPool *pool = this->dataPtr->Pool(_type);
+  const int slot = pool ? pool->Slot(_id) : -1;
+  if (slot >= 0)
   {
-    auto modIter = this->dataPtr->toModifyComponents.find(key);
-    if (modIter != this->dataPtr->toModifyComponents.end())
-    {
-      // Already been modified, return pointer to new storage
-      char *storage = modIter->second;
-      component = static_cast<void *>(storage);
-    }
-    else
-    {
-      char const *readOnlyStorage = this->dataPtr->components[compIter->second];
-      void const *readOnlyComp = static_cast<void const *>(readOnlyStorage);
-      // create temporary storage for the updated data
-      ComponentTypeInfo info = ComponentFactory::TypeInfo(_type);
-      char *storage = new char[info.size];
-      component = static_cast<void *>(storage);
-      info.deepCopier(readOnlyComp, component);
-      this->dataPtr->toModifyComponents[key] = storage;
-    }
+    // Copied on the first call this step, moved into place next update
+    component = pool->Modify(slot);
   }
   return component;
 }
 
 /////////////////////////////////////////////////
 bool EntityComponentDatabasePrivate::EntityMatches(EntityId _id,
-    const std::set<ComponentType> &_types) const
+    const EntityQuery &_query) const
 {
-  bool found = true;
-  for (auto const &type : _types)
-  {
-    StorageKey key = std::make_pair(_id, type);
-    if (this->componentIndices.find(key) == this->componentIndices.end() &&
-        std::find(this->removedComponents.begin(),
-          this->removedComponents.end(), key) == this->removedComponents.end())
-    {
-      found = false;
-      break;
-    }
-  }
-  return found;
+  if (!this->EntityExists(_id))
+    return false;
+  EntitySlot *slot = this->Slot(EntityIndex(_id));
+  return (_query.Mask() & ~(slot->components | slot->removed)).none() &&
+    (_query.ExcludedMask() & slot->components).none();
 }
 
 /////////////////////////////////////////////////
 void EntityComponentDatabasePrivate::UpdateQueries(EntityId _id)
 {
-  for (auto &query : this->queries)
+  EntitySlot *slot = this->Slot(EntityIndex(_id));
+  for (EntityQuery *query : this->liveQueries)
   {
-    if (this->EntityMatches(_id, query.ComponentTypes()))
-      query.AddEntity(_id);
+    if (this->EntityMatches(_id, *query))
+      query->StageAddEntity(_id);
+    else if ((query->ExcludedMask() & slot->components).any())
+      query->StageRemoveEntity(_id);
   }
 }
 
+/////////////////////////////////////////////////
+void EntityComponentDatabasePrivate::CommitQuery(EntityQuery &_query,
+    uint64_t _update) const
+{
+  _query.Commit(_update);
+  std::vector<ComponentPool *> queryPools;
+  for (ComponentType type : _query.ResultTypes())
+    queryPools.push_back(this->Pool(type));
+  _query.dataPtr->UpdateComponents(queryPools);
+}
+
 //////////////////////////////////////////////////
 void EntityComponentDatabase::InstantQuery(EntityQuery &_query)
 {
-  for (const gazebo::ecs::Entity &entity : this->dataPtr->entities)
+  const int numSlots = this->dataPtr->slotCount.load();
+  for (int index = 0; index < numSlots; ++index)
   {
-    if (this->dataPtr->EntityMatches(entity.Id(), _query.ComponentTypes()))
-      _query.AddEntity(entity.Id());
+    EntitySlot *slot = this->dataPtr->Slot(index);
+    EntityId id = slot ? slot->id.load(std::memory_order_acquire) : NO_ENTITY;
+    if (id != NO_ENTITY &&
+        this->dataPtr->EntityMatches(id, _query))
+    {
+      _query.StageAddEntity(id);
+    }
   }
+  this->dataPtr->CommitQuery(_query, this->dataPtr->updateCount);
 }
 
 /////////////////////////////////////////////////
 bool EntityComponentDatabasePrivate::EntityExists(EntityId _id) const
 {
-  // True if the vector is big enough to have used this id
-  bool isWithinRange = _id >= 0 && _id < this->entities.size();
-  bool isNotDeleted = this->freeIds.find(_id) == this->freeIds.end() &&
-    this->deletedIds.find(_id) == this->deletedIds.end();
-  return isWithinRange && isNotDeleted;
+  if (_id < 0)
+    return false;
+  // A stale id has the generation of an entity that has been deleted
+  EntitySlot *slot = this->Slot(EntityIndex(_id));
+  return slot && slot->id.load(std::memory_order_acquire) == _id;
 }
 
 /////////////////////////////////////////////////
 const EntityQuery &EntityComponentDatabase::Query(
     const EntityQueryId _index) const
 {
-  if (_index >= 0 && _index < this->dataPtr->queries.size())
-    return this->dataPtr->queries[_index];
+  if (_index >= 0 &&
+      static_cast<std::size_t>(_index) < this->dataPtr->queries.size() &&
+      this->dataPtr->queries[_index])
+  {
+    return this->dataPtr->queries[_index]->query;
+  }
   return EntityQueryNull;
 }
 
@@ -404,110 +861,349 @@ const EntityQuery &EntityComponentDatabase::Query(
 Difference EntityComponentDatabase::IsDifferent(EntityId _id,
     ComponentType _type) const
 {
-  Difference d = NO_DIFFERENCE;
-  StorageKey key = std::make_pair(_id, _type);
-  auto iter = this->dataPtr->differences.find(key);
-  if (iter != this->dataPtr->differences.end())
-  {
-    d = iter->second;
-  }
-  return d;
+  ComponentPool const *pool = this->dataPtr->Pool(_type);
+  if (pool)
+    return pool->Change(_id);
+  return NO_DIFFERENCE;
+}
+
+/////////////////////////////////////////////////
+const std::vector<EntityId> &EntityComponentDatabase::ChangedEntities(
+    ComponentType _type) const
+{
+  static const std::vector<EntityId> noEntities;
+  ComponentPool const *pool = this->dataPtr->Pool(_type);
+  if (pool)
+    return pool->ChangedIds();
+  return noEntities;
 }
 
 /////////////////////////////////////////////////
 void EntityComponentDatabase::Update()
 {
-  // Deleted ids can be reused after one update.
-  this->dataPtr->freeIds.insert(this->dataPtr->deletedIds.begin(),
-      this->dataPtr->deletedIds.end());
+  this->Update(ComponentMask());
+}
+
+/////////////////////////////////////////////////
+ComponentMask EntityComponentDatabase::Update(const ComponentMask &_defer)
+{
+  auto &stagings = this->dataPtr->stagings;
+
+  // Only components that are just modified can wait. Adding and removing
+  // moves them, which needs the modified copies in place first.
+  ComponentMask deferred;
+  this->dataPtr->deferredQueries.clear();
+  if (_defer.any())
+  {
+    ComponentMask moved;
+    for (auto const &staging : stagings)
+    {
+      for (StorageKey key : staging->toRemoveComponents)
+        moved.set(key.second);
+      for (auto const &kv : staging->toAddComponents)
+        moved.set(kv.first.second);
+      for (EntityBatchPrivate *batch : staging->toCreateBatches)
+        moved |= batch->mask;
+    }
+    for (auto const &pool : this->dataPtr->pools)
+    {
+      if (pool && _defer.test(pool->Type()) && !moved.test(pool->Type()) &&
+          pool->HasModified())
+      {
+        deferred.set(pool->Type());
+      }
+    }
+  }
+
+  // Deleted ids can be reused after one update. Push the largest first so
+  // the smallest index of the batch is reused first.
+  std::sort(this->dataPtr->deletedIds.begin(),
+      this->dataPtr->deletedIds.end(), std::greater<EntityId>());
+  for (EntityId id : this->dataPtr->deletedIds)
+  {
+    const int index = EntityIndex(id);
+    this->dataPtr->Slot(index)->nextFree = this->dataPtr->freeHead.load();
+    this->dataPtr->freeHead.store(index, std::memory_order_release);
+  }
+  this->dataPtr->deletedIds.clear();
 
   // Move toDeleteEntities to deletedIds, effectively deleting them
-  this->dataPtr->deletedIds = std::move(this->dataPtr->toDeleteEntities);
+  for (auto const &staging : stagings)
+  {
+    for (EntityId id : staging->toDeleteEntities)
+    {
+      EntitySlot *slot = this->dataPtr->Slot(EntityIndex(id));
+      slot->generation = (EntityGeneration(id) + 1) & ENTITY_GENERATION_MASK;
+      slot->deleting.store(false, std::memory_order_relaxed);
+      slot->id.store(NO_ENTITY, std::memory_order_release);
+      this->dataPtr->deletedIds.push_back(id);
+    }
+  }
 
-  this->dataPtr->differences.clear();
+  // Pools record what happens to their components from here on. Modified
+  // components are moved in place.
+  for (auto const &pool : this->dataPtr->pools)
+  {
+    if (!pool)
+      continue;
+    // Queries have caught up with last update's moves, deferred types too
+    pool->ClearMoves();
+    if (deferred.test(pool->Type()))
+      continue;
+    pool->ClearChanges();
+    pool->CommitModified();
+  }
 
-  // Modify components
-  for (auto const &kv : this->dataPtr->toModifyComponents)
+  // Remove the components for real
+  std::vector<StorageKey> justRemoved;
+  for (auto const &staging : stagings)
   {
-    StorageKey key = kv.first;
-    this->dataPtr->differences[key] = WAS_MODIFIED;
-    ComponentTypeInfo info = ComponentFactory::TypeInfo(key.second);
+    for (StorageKey key : staging->toRemoveComponents)
+    {
+      // Pool destructs the component and fills the hole with its last one.
+      // It does nothing if the component was flagged for removal twice.
+      if (this->dataPtr->Pool(key.second)->Erase(key.first))
+      {
+        EntitySlot *slot = this->dataPtr->Slot(EntityIndex(key.first));
+        slot->components.reset(key.second);
+        slot->removed.set(key.second);
+        justRemoved.push_back(key);
+
+        // Entities may match queries that excluded the component
+        for (EntityQuery *query : this->dataPtr->liveQueries)
+        {
+          if (query->ExcludedMask().test(key.second) &&
+              this->dataPtr->EntityMatches(key.first, *query))
+          {
+            query->StageAddEntity(key.first);
+          }
+        }
+      }
+    }
+  }
 
-    // Get pointer to temporary storage with modifications
-    char *modifiedStorage = kv.second;
+  // Update queries with components removed more than 1 update ago
+  // Entities removed earlier are gone, so their slots can't be reused yet
+  for (StorageKey key : this->dataPtr->removedComponents)
+  {
+    this->dataPtr->Slot(EntityIndex(key.first))->removed.reset(key.second);
+    for (EntityQuery *query : this->dataPtr->liveQueries)
+    {
+      // The component may have been added back since
+      if (query->Mask().test(key.second) &&
+          !this->dataPtr->EntityMatches(key.first, *query))
+      {
+        query->StageRemoveEntity(key.first);
+      }
+    }
+  }
+  this->dataPtr->removedComponents = std::move(justRemoved);
 
-    // Get pointer to component in main storage
-    auto mainIdx = this->dataPtr->componentIndices[key];
-    char *mainStorage = this->dataPtr->components[mainIdx];
+  // Move components of entities created in batches into main storage.
+  // They go before single components, so a batch wins over AddComponent().
+  for (auto const &staging : stagings)
+  {
+    for (EntityBatchPrivate *batch : staging->toCreateBatches)
+      this->dataPtr->MergeBatch(*batch);
+  }
 
-    // destruct old component in main storage
-    info.destructor(static_cast<void *>(modifiedStorage));
+  // Update querys with added components. If more than one thread added the
+  // same component the first staging merged wins.
+  for (auto const &staging : stagings)
+  {
+    for (auto kv : staging->toAddComponents)
+    {
+      char *storage = kv.second;
+      StorageKey key = kv.first;
+      EntityId id = key.first;
+      // Move to main storage, skipping it if the entity was deleted in the
+      // same step or another thread added the component first
+      if (this->dataPtr->EntityExists(id) &&
+          this->dataPtr->PoolOrCreate(key.second).Insert(id,
+            static_cast<void *>(storage)))
+      {
+        this->dataPtr->Slot(EntityIndex(id))->components.set(key.second);
+        this->dataPtr->UpdateQueries(id);
+      }
+      else
+      {
+        ComponentFactory::TypeInfo(key.second).destructor(storage);
+      }
+    }
+  }
 
-    // Copy modified component to main storage
-    info.shallowCopier(static_cast<const void *>(modifiedStorage),
-        static_cast<void *>(mainStorage));
+  // All staged changes are merged, recycle their memory
+  this->dataPtr->stagingBytes = 0;
+  this->dataPtr->stagingCapacity = 0;
+  for (auto const &staging : stagings)
+  {
+    this->dataPtr->stagingBytes += staging->arena.BytesUsed();
+    staging->Reset();
+    this->dataPtr->stagingCapacity += staging->arena.Capacity();
+  }
 
-    // Free space used for modified component
-    delete [] modifiedStorage;
+  // Merge all changes to query results at once. Reactive queries list the
+  // modified components, so they wait for deferred types.
+  for (EntityQuery *query : this->dataPtr->liveQueries)
+  {
+    ComponentMask types;
+    if (deferred.any() && query->Reactive())
+    {
+      for (ComponentType type : query->ResultTypes())
+      {
+        if (deferred.test(type))
+          types.set(type);
+      }
+    }
+    if (types.none())
+    {
+      this->dataPtr->CommitQuery(*query, this->dataPtr->updateCount);
+      continue;
+    }
+    std::unique_ptr<DeferredQuery> waiting(new DeferredQuery);
+    waiting->query = query;
+    waiting->types = types;
+    waiting->pending = types.count();
+    this->dataPtr->deferredQueries.push_back(std::move(waiting));
   }
-  this->dataPtr->toModifyComponents.clear();
 
-  // Remove the components for real
-  for (StorageKey key : this->dataPtr->toRemoveComponents)
+  // Incrementing this effectively creates entities
+  ++this->dataPtr->updateCount;
+  return deferred;
+}
+
+/////////////////////////////////////////////////
+void EntityComponentDatabase::CommitModified(ComponentType _type)
+{
+  ComponentPool *pool = this->dataPtr->Pool(_type);
+  if (!pool)
+    return;
+  pool->ClearChanges();
+  pool->CommitModified();
+
+  // The last type a query waits for commits it
+  for (auto const &waiting : this->dataPtr->deferredQueries)
   {
-    int index = this->dataPtr->componentIndices.find(key)->second;
-    // call destructor
-    void *component = nullptr;
-    ComponentTypeInfo info = ComponentFactory::TypeInfo(key.second);
-    char *storage = this->dataPtr->components[index];
-    component = static_cast<void *>(storage);
-    info.destructor(component);
+    if (waiting->types.test(_type) &&
+        waiting->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+      this->dataPtr->CommitQuery(*waiting->query,
+          this->dataPtr->updateCount - 1);
+    }
+  }
+}
 
-    this->dataPtr->differences[key] = WAS_DELETED;
+/////////////////////////////////////////////////
+void EntityComponentDatabasePrivate::MergeBatch(EntityBatchPrivate &_batch)
+{
+  bool allExist = true;
+  for (std::size_t i = 0; i < _batch.count && allExist; ++i)
+    allExist = this->EntityExists(_batch.ids[i]);
 
-    delete [] storage;
-    this->dataPtr->components.erase(this->dataPtr->components.begin() + index);
-    this->dataPtr->componentIndices.erase(key);
-    // Update the indexes beyond
-    for (auto &kvIter : this->dataPtr->componentIndices)
+  for (std::size_t t = 0; t < _batch.numTypes; ++t)
+  {
+    const ComponentType type = _batch.types[t];
+    const ComponentTypeInfo &info = ComponentFactory::TypeInfo(type);
+    ComponentPool &pool = this->PoolOrCreate(type);
+    // Move the whole array at once unless some entities were deleted
+    if (allExist && pool.InsertMany(_batch.ids, _batch.components[t],
+          _batch.count))
     {
-      int &otherIndex = kvIter.second;
-      if (otherIndex > index)
-        --otherIndex;
+      continue;
+    }
+
+    pool.Reserve(std::max(pool.Size() + _batch.count, 2 * pool.Size()));
+    for (std::size_t i = 0; i < _batch.count; ++i)
+    {
+      const EntityId id = _batch.ids[i];
+      void *component = _batch.components[t] + i * info.size;
+      // Skip entities deleted in the same step
+      if (!this->EntityExists(id) || !pool.Insert(id, component))
+        info.destructor(component);
     }
   }
 
-  // Update queries with components removed more than 1 update ago
-  for (StorageKey key : this->dataPtr->removedComponents)
+  for (std::size_t i = 0; i < _batch.count; ++i)
   {
-    for (auto &query : this->dataPtr->queries)
+    if (this->EntityExists(_batch.ids[i]))
+      this->Slot(EntityIndex(_batch.ids[i]))->components |= _batch.mask;
+  }
+
+  // Every entity in the batch matches the same queries
+  for (EntityQuery *query : this->liveQueries)
+  {
+    if ((query->Mask() & ~_batch.mask).any() ||
+        (query->ExcludedMask() & _batch.mask).any())
+    {
+      continue;
+    }
+    for (std::size_t i = 0; i < _batch.count; ++i)
     {
-      auto const & types = query.ComponentTypes();
-      if (types.find(key.second) != types.end())
-        query.RemoveEntity(key.first);
+      if (this->EntityExists(_batch.ids[i]))
+        query->StageAddEntity(_batch.ids[i]);
     }
   }
-  this->dataPtr->removedComponents = std::move(
-      this->dataPtr->toRemoveComponents);
+}
+
+/////////////////////////////////////////////////
+EntityBatch::EntityBatch(EntityBatchPrivate *_batch)
+: batch(_batch)
+{
+}
+
+/////////////////////////////////////////////////
+std::size_t EntityBatch::Size() const
+{
+  return this->batch ? this->batch->count : 0;
+}
+
+/////////////////////////////////////////////////
+EntityId EntityBatch::Id(std::size_t _index) const
+{
+  return this->batch->ids[_index];
+}
 
-  // Update querys with added components
-  for (auto kv : this->dataPtr->toAddComponents)
+/////////////////////////////////////////////////
+void *EntityBatch::Components(ComponentType _type) const
+{
+  if (this->batch)
   {
-    char *storage = kv.second;
-    StorageKey key = kv.first;
-    EntityId id = key.first;
-    this->dataPtr->differences[key] = WAS_CREATED;
-    // Add to main storage
-    auto index = this->dataPtr->components.size();
-    this->dataPtr->components.push_back(storage);
-    this->dataPtr->componentIndices[key] = index;
-    this->dataPtr->UpdateQueries(id);
+    for (std::size_t t = 0; t < this->batch->numTypes; ++t)
+    {
+      if (this->batch->types[t] == _type)
+        return this->batch->components[t];
+    }
   }
-  this->dataPtr->toAddComponents.clear();
+  return nullptr;
+}
 
-  // Clearing this effectively creates entities
-  this->dataPtr->toCreateEntities.clear();
+/////////////////////////////////////////////////
+std::size_t EntityComponentDatabase::StagingBytes() const
+{
+  return this->dataPtr->stagingBytes;
+}
 
-  assert(this->dataPtr->componentIndices.size()
-      == this->dataPtr->components.size());
+/////////////////////////////////////////////////
+std::size_t EntityComponentDatabase::StagingCapacity() const
+{
+  return this->dataPtr->stagingCapacity;
+}
+
+/////////////////////////////////////////////////
+ComponentPool *EntityComponentDatabasePrivate::Pool(ComponentType _type) const
+{
+  if (_type >= 0 && static_cast<std::size_t>(_type) < this->pools.size())
+    return this->pools[_type].get();
+  return nullptr;
+}
+
+/////////////////////////////////////////////////
+ComponentPool &EntityComponentDatabasePrivate::PoolOrCreate(
+    ComponentType _type)
+{
+  if (static_cast<std::size_t>(_type) >= this->pools.size())
+    this->pools.resize(_type + 1);
+  if (!this->pools[_type])
+    this->pools[_type].reset(new ComponentPool(_type));
+  return *(this->pools[_type]);
 }
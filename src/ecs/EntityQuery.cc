@@ -15,22 +15,46 @@
  *
 */
 #include <algorithm>
+#include <functional>
+#include <iterator>
 #include <set>
+#include <utility>
 
 #include "gazebo/ecs/EntityQuery.hh"
+#include "EntityQueryPrivate.hh"
 
 using namespace gazebo;
 using namespace ecs;
 
-// Private data class
-class gazebo::ecs::EntityQueryPrivate
+/// \brief Bytes of results in one chunk, half of a typical L1 data cache
+static const std::size_t CHUNK_BYTES = 16 * 1024;
+
+/////////////////////////////////////////////////
+void EntityQueryPrivate::Left(const std::vector<EntityId> &_ids)
 {
-  /// \brief list of component types that must be present on entities
-  public: std::set<ComponentType> componentTypes;
+  // Entities that joined and left in the same update were never seen
+  std::vector<EntityId> seen;
+  std::set_difference(_ids.begin(), _ids.end(), this->addedIds.begin(),
+      this->addedIds.end(), std::back_inserter(seen));
+  std::vector<EntityId> merged;
+  std::set_difference(this->addedIds.begin(), this->addedIds.end(),
+      _ids.begin(), _ids.end(), std::back_inserter(merged));
+  this->addedIds.swap(merged);
 
-  /// \brief all entities that matched the query
-  public: std::set<EntityId> entityIds;
-};
+  merged.clear();
+  std::set_union(this->removedIds.begin(), this->removedIds.end(),
+      seen.begin(), seen.end(), std::back_inserter(merged));
+  this->removedIds.swap(merged);
+}
+
+/////////////////////////////////////////////////
+void EntityQueryPrivate::Joined(const std::vector<EntityId> &_ids)
+{
+  std::vector<EntityId> merged;
+  std::set_union(this->addedIds.begin(), this->addedIds.end(),
+      _ids.begin(), _ids.end(), std::back_inserter(merged));
+  this->addedIds.swap(merged);
+}
 
 /////////////////////////////////////////////////
 EntityQuery::EntityQuery()
@@ -52,9 +76,66 @@ bool EntityQuery::AddComponent(const std::string &_name)
 /////////////////////////////////////////////////
 bool EntityQuery::AddComponent(ComponentType _type)
 {
-  if (_type != NO_COMPONENT)
+  if (_type >= 0 && _type < MAX_COMPONENT_TYPES &&
+      !this->dataPtr->excludedMask.test(_type))
   {
     this->dataPtr->componentTypes.insert(_type);
+    this->dataPtr->mask.set(_type);
+    this->dataPtr->optionalTypes.erase(_type);
+    this->dataPtr->resultTypes.insert(_type);
+    this->dataPtr->components.resize(this->dataPtr->resultTypes.size());
+    this->dataPtr->entitiesChanged = true;
+    return true;
+  }
+
+  return false;
+}
+
+/////////////////////////////////////////////////
+bool EntityQuery::Without(const std::string &_name)
+{
+  return this->Without(ComponentFactory::Type(_name));
+}
+
+/////////////////////////////////////////////////
+bool EntityQuery::Without(ComponentType _type)
+{
+  if (_type >= 0 && _type < MAX_COMPONENT_TYPES &&
+      !this->dataPtr->mask.test(_type))
+  {
+    this->dataPtr->excludedMask.set(_type);
+    if (this->dataPtr->optionalTypes.erase(_type))
+    {
+      this->dataPtr->resultTypes.erase(_type);
+      this->dataPtr->components.resize(this->dataPtr->resultTypes.size());
+      this->dataPtr->entitiesChanged = true;
+    }
+    return true;
+  }
+
+  return false;
+}
+
+/////////////////////////////////////////////////
+bool EntityQuery::Optional(const std::string &_name)
+{
+  return this->Optional(ComponentFactory::Type(_name));
+}
+
+/////////////////////////////////////////////////
+bool EntityQuery::Optional(ComponentType _type)
+{
+  if (_type >= 0 && _type < MAX_COMPONENT_TYPES &&
+      !this->dataPtr->excludedMask.test(_type))
+  {
+    // Required components are already in the results
+    if (!this->dataPtr->mask.test(_type))
+    {
+      this->dataPtr->optionalTypes.insert(_type);
+      this->dataPtr->resultTypes.insert(_type);
+      this->dataPtr->components.resize(this->dataPtr->resultTypes.size());
+      this->dataPtr->entitiesChanged = true;
+    }
     return true;
   }
 
@@ -64,33 +145,281 @@ bool EntityQuery::AddComponent(ComponentType _type)
 /////////////////////////////////////////////////
 bool EntityQuery::operator==(const EntityQuery &_rhs) const
 {
-  return std::equal(this->dataPtr->componentTypes.begin(),
-                    this->dataPtr->componentTypes.end(),
-                    _rhs.dataPtr->componentTypes.begin()) &&
-         std::equal(this->dataPtr->entityIds.begin(),
-                    this->dataPtr->entityIds.end(),
-                    _rhs.dataPtr->entityIds.begin());
+  // Results don't matter, queries with the same terms end up with the
+  // same results
+  return this->dataPtr->mask == _rhs.dataPtr->mask &&
+         this->dataPtr->excludedMask == _rhs.dataPtr->excludedMask &&
+         this->dataPtr->optionalTypes == _rhs.dataPtr->optionalTypes &&
+         this->dataPtr->reactive == _rhs.dataPtr->reactive;
+}
+
+/////////////////////////////////////////////////
+std::size_t EntityQuery::Hash() const
+{
+  std::hash<ComponentMask> hashMask;
+  std::size_t hash = hashMask(this->dataPtr->mask);
+  hash = hash * 31 + hashMask(this->dataPtr->excludedMask);
+  for (ComponentType type : this->dataPtr->optionalTypes)
+    hash = hash * 31 + static_cast<std::size_t>(type);
+  return hash * 2 + this->dataPtr->reactive;
 }
 
 /////////////////////////////////////////////////
 bool EntityQuery::AddEntity(const EntityId _id)
 {
-  std::pair<std::set<EntityId>::iterator, bool> result =
-    this->dataPtr->entityIds.insert(_id);
+  auto &ids = this->dataPtr->entityIds;
+  auto iter = std::lower_bound(ids.begin(), ids.end(), _id);
+  if (iter != ids.end() && *iter == _id)
+    return false;
 
-  return result.second;
+  ids.insert(iter, _id);
+  this->dataPtr->entitiesChanged = true;
+  return true;
 }
 
 /////////////////////////////////////////////////
 void EntityQuery::RemoveEntity(const EntityId _id)
 {
-  this->dataPtr->entityIds.erase(_id);
+  auto &ids = this->dataPtr->entityIds;
+  auto iter = std::lower_bound(ids.begin(), ids.end(), _id);
+  if (iter != ids.end() && *iter == _id)
+  {
+    ids.erase(iter);
+    this->dataPtr->entitiesChanged = true;
+  }
 }
 
 /////////////////////////////////////////////////
 void EntityQuery::Clear()
 {
   this->dataPtr->entityIds.clear();
+  this->dataPtr->entitiesChanged = true;
+}
+
+/////////////////////////////////////////////////
+void EntityQuery::StageAddEntity(const EntityId _id)
+{
+  this->dataPtr->staged.push_back(std::make_pair(_id, true));
+}
+
+/////////////////////////////////////////////////
+void EntityQuery::StageRemoveEntity(const EntityId _id)
+{
+  this->dataPtr->staged.push_back(std::make_pair(_id, false));
+}
+
+/////////////////////////////////////////////////
+void EntityQuery::Commit(uint64_t _update)
+{
+  auto &ids = this->dataPtr->entityIds;
+  auto &staged = this->dataPtr->staged;
+  const bool reactive = this->dataPtr->reactive;
+  if (reactive && this->dataPtr->changesUpdate != _update)
+  {
+    this->dataPtr->addedIds.clear();
+    this->dataPtr->removedIds.clear();
+    this->dataPtr->changesUpdate = _update;
+  }
+  if (staged.empty())
+    return;
+
+  // Keep the last change staged for each entity
+  std::stable_sort(staged.begin(), staged.end(),
+      [](const std::pair<EntityId, bool> &_a,
+         const std::pair<EntityId, bool> &_b)
+      {
+        return _a.first < _b.first;
+      });
+  std::vector<EntityId> toAdd;
+  std::vector<EntityId> toRemove;
+  for (std::size_t i = 0; i < staged.size(); ++i)
+  {
+    if (i + 1 < staged.size() && staged[i + 1].first == staged[i].first)
+      continue;
+    if (staged[i].second)
+      toAdd.push_back(staged[i].first);
+    else
+      toRemove.push_back(staged[i].first);
+  }
+  staged.clear();
+
+  // Only entities that actually leave or join change the results, so a few
+  // changes cost a few binary searches instead of a pass over the results
+  std::vector<EntityId> left;
+  for (EntityId id : toRemove)
+  {
+    if (std::binary_search(ids.begin(), ids.end(), id))
+      left.push_back(id);
+  }
+  if (!left.empty())
+  {
+    if (reactive)
+      this->dataPtr->Left(left);
+    this->dataPtr->RemoveRows(left);
+  }
+
+  std::vector<EntityId> joined;
+  for (EntityId id : toAdd)
+  {
+    if (!std::binary_search(ids.begin(), ids.end(), id))
+      joined.push_back(id);
+  }
+  if (!joined.empty())
+  {
+    if (reactive)
+      this->dataPtr->Joined(joined);
+    this->dataPtr->InsertRows(joined);
+  }
+}
+
+/////////////////////////////////////////////////
+void EntityQueryPrivate::RemoveRows(const std::vector<EntityId> &_ids)
+{
+  auto &ids = this->entityIds;
+  std::size_t write = std::distance(ids.begin(),
+      std::lower_bound(ids.begin(), ids.end(), _ids.front()));
+  std::size_t next = 0;
+  for (std::size_t read = write; read < ids.size(); ++read)
+  {
+    if (next < _ids.size() && _ids[next] == ids[read])
+    {
+      ++next;
+      continue;
+    }
+    this->MoveRow(read, write++);
+  }
+  ids.resize(write);
+  if (!this->entitiesChanged)
+  {
+    for (auto &pointers : this->components)
+      pointers.resize(write);
+  }
+}
+
+/////////////////////////////////////////////////
+void EntityQueryPrivate::InsertRows(const std::vector<EntityId> &_ids)
+{
+  // Merge from the back, rows before the first new one stay put
+  auto &ids = this->entityIds;
+  std::size_t read = ids.size();
+  std::size_t write = ids.size() + _ids.size();
+  ids.resize(write);
+  if (!this->entitiesChanged)
+  {
+    for (auto &pointers : this->components)
+      pointers.resize(write, nullptr);
+  }
+  for (std::size_t add = _ids.size(); add-- > 0;)
+  {
+    while (read > 0 && ids[read - 1] > _ids[add])
+      this->MoveRow(--read, --write);
+    ids[--write] = _ids[add];
+    if (!this->entitiesChanged)
+    {
+      for (auto &pointers : this->components)
+        pointers[write] = nullptr;
+    }
+  }
+  if (!this->entitiesChanged)
+    this->newRows.insert(this->newRows.end(), _ids.begin(), _ids.end());
+}
+
+/////////////////////////////////////////////////
+void EntityQueryPrivate::MoveRow(std::size_t _from, std::size_t _to)
+{
+  this->entityIds[_to] = this->entityIds[_from];
+  if (this->entitiesChanged)
+    return;
+  for (auto &pointers : this->components)
+    pointers[_to] = pointers[_from];
+}
+
+/////////////////////////////////////////////////
+void EntityQueryPrivate::FindRow(std::size_t _column, EntityId _id)
+{
+  const auto &ids = this->entityIds;
+  auto iter = std::lower_bound(ids.begin(), ids.end(), _id);
+  if (iter != ids.end() && *iter == _id)
+  {
+    ComponentPool const *pool = this->pools[_column];
+    this->components[_column][std::distance(ids.begin(), iter)] =
+      pool ? pool->Find(_id) : nullptr;
+  }
+}
+
+/////////////////////////////////////////////////
+void EntityQueryPrivate::UpdateComponents(
+    const std::vector<ComponentPool *> &_pools)
+{
+  auto &pools = this->pools;
+  auto &versions = this->poolVersions;
+  const auto &ids = this->entityIds;
+  pools.resize(_pools.size(), nullptr);
+  versions.resize(_pools.size(), 0);
+  this->components.resize(_pools.size());
+
+  for (std::size_t c = 0; c < _pools.size(); ++c)
+  {
+    ComponentPool *pool = _pools[c];
+    const uint64_t version = pool ? pool->Version() : 0;
+    auto &pointers = this->components[c];
+
+    // Components only move when their pool inserts or erases one, and the
+    // pool lists which. They all move if its storage grew.
+    bool rebuild = this->entitiesChanged || pools[c] != pool ||
+      pointers.size() != ids.size();
+    if (!rebuild && versions[c] != version)
+    {
+      rebuild = versions[c] < pool->MovedSince() ||
+        pool->MovedIds().size() > ids.size();
+      if (!rebuild)
+      {
+        for (EntityId id : pool->MovedIds())
+          this->FindRow(c, id);
+      }
+    }
+
+    pools[c] = pool;
+    versions[c] = version;
+    if (rebuild)
+    {
+      pointers.resize(ids.size());
+      for (std::size_t i = 0; i < ids.size(); ++i)
+        pointers[i] = pool ? pool->Find(ids[i]) : nullptr;
+    }
+    else
+    {
+      for (EntityId id : this->newRows)
+        this->FindRow(c, id);
+    }
+  }
+  this->newRows.clear();
+  this->entitiesChanged = false;
+
+  if (!this->reactive)
+    return;
+
+  // Pools know which of their components changed, so this costs as much
+  // as there were changes
+  auto &modified = this->modifiedIds;
+  auto const &added = this->addedIds;
+  modified.clear();
+  for (ComponentPool const *pool : _pools)
+  {
+    if (!pool)
+      continue;
+    for (EntityId id : pool->ChangedIds())
+    {
+      if (std::binary_search(ids.begin(), ids.end(), id) &&
+          !std::binary_search(added.begin(), added.end(), id))
+      {
+        modified.push_back(id);
+      }
+    }
+  }
+  std::sort(modified.begin(), modified.end());
+  modified.erase(std::unique(modified.begin(), modified.end()),
+      modified.end());
 }
 
 /////////////////////////////////////////////////
@@ -100,11 +429,127 @@ const std::set<ComponentType> &EntityQuery::ComponentTypes() const
 }
 
 /////////////////////////////////////////////////
-const std::set<EntityId> &EntityQuery::EntityIds() const
+const ComponentMask &EntityQuery::Mask() const
+{
+  return this->dataPtr->mask;
+}
+
+/////////////////////////////////////////////////
+void EntityQuery::Reactive(bool _reactive)
+{
+  this->dataPtr->reactive = _reactive;
+  if (!_reactive)
+  {
+    this->dataPtr->addedIds.clear();
+    this->dataPtr->removedIds.clear();
+    this->dataPtr->modifiedIds.clear();
+  }
+}
+
+/////////////////////////////////////////////////
+bool EntityQuery::Reactive() const
+{
+  return this->dataPtr->reactive;
+}
+
+/////////////////////////////////////////////////
+const ComponentMask &EntityQuery::ExcludedMask() const
+{
+  return this->dataPtr->excludedMask;
+}
+
+/////////////////////////////////////////////////
+const std::set<ComponentType> &EntityQuery::OptionalTypes() const
+{
+  return this->dataPtr->optionalTypes;
+}
+
+/////////////////////////////////////////////////
+const std::set<ComponentType> &EntityQuery::ResultTypes() const
+{
+  return this->dataPtr->resultTypes;
+}
+
+/////////////////////////////////////////////////
+const std::vector<EntityId> &EntityQuery::EntityIds() const
 {
   return this->dataPtr->entityIds;
 }
 
+/////////////////////////////////////////////////
+std::size_t EntityQuery::ChunkSize() const
+{
+  // An id, and a pointer and a component of every type in the results
+  std::size_t bytes = sizeof(EntityId);
+  for (ComponentType type : this->dataPtr->resultTypes)
+    bytes += sizeof(void *) + ComponentFactory::TypeInfo(type).stride;
+  return std::max(CHUNK_BYTES / bytes, std::size_t(1));
+}
+
+/////////////////////////////////////////////////
+const std::vector<EntityId> &EntityQuery::AddedEntityIds() const
+{
+  return this->dataPtr->addedIds;
+}
+
+/////////////////////////////////////////////////
+const std::vector<EntityId> &EntityQuery::RemovedEntityIds() const
+{
+  return this->dataPtr->removedIds;
+}
+
+/////////////////////////////////////////////////
+const std::vector<EntityId> &EntityQuery::ModifiedEntityIds() const
+{
+  return this->dataPtr->modifiedIds;
+}
+
+/////////////////////////////////////////////////
+const std::vector<void const *> &EntityQuery::Components(
+    ComponentType _type) const
+{
+  static const std::vector<void const *> noComponents;
+  auto const &types = this->dataPtr->resultTypes;
+  auto iter = types.find(_type);
+  if (iter == types.end())
+    return noComponents;
+  return this->dataPtr->components[std::distance(types.begin(), iter)];
+}
+
+/////////////////////////////////////////////////
+MutableComponentSpan EntityQuery::ComponentsMutable(
+    ComponentType _type) const
+{
+  static const std::vector<void const *> noComponents;
+  auto const &types = this->dataPtr->resultTypes;
+  auto iter = types.find(_type);
+  if (iter == types.end() ||
+      this->dataPtr->pools.size() != types.size())
+  {
+    return MutableComponentSpan(nullptr, 0, noComponents);
+  }
+  const std::size_t c = std::distance(types.begin(), iter);
+  return MutableComponentSpan(this->dataPtr.get(), c,
+      this->dataPtr->components[c]);
+}
+
+/////////////////////////////////////////////////
+void *EntityQueryPrivate::Modify(std::size_t _column,
+    void const *_component) const
+{
+  ComponentPool *pool = this->pools[_column];
+  return pool->Modify(pool->SlotOf(_component));
+}
+
+/////////////////////////////////////////////////
+void *MutableComponentSpan::Modify(std::size_t _index) const
+{
+  void const *component = (*this->pointers)[_index];
+  if (!component)
+    return nullptr;
+  return this->query->Modify(this->column, component);
+}
+
 /////////////////////////////////////////////////
 bool EntityQuery::IsNull()
 {
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2017 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#ifndef GAZEBO_ECS_ENTITYQUERYPRIVATE_HH_
+#define GAZEBO_ECS_ENTITYQUERYPRIVATE_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "gazebo/ecs/Entity.hh"
+#include "gazebo/ecs/EntityQuery.hh"
+#include "ComponentPool.hh"
+
+namespace gazebo
+{
+  namespace ecs
+  {
+    /// \brief Private data of EntityQuery, shared with the database that
+    ///   keeps its results
+    class EntityQueryPrivate
+    {
+      /// \brief list of component types that must be present on entities
+      public: std::set<ComponentType> componentTypes;
+
+      /// \brief componentTypes as a bitmask
+      public: ComponentMask mask;
+
+      /// \brief component types that must not be present on entities
+      public: ComponentMask excludedMask;
+
+      /// \brief component types returned if present
+      public: std::set<ComponentType> optionalTypes;
+
+      /// \brief componentTypes and optionalTypes
+      public: std::set<ComponentType> resultTypes;
+
+      /// \brief all entities that matched the query, sorted
+      public: std::vector<EntityId> entityIds;
+
+      /// \brief entities to add (true) or remove (false) on the next commit,
+      ///   in the order they were staged
+      public: std::vector<std::pair<EntityId, bool> > staged;
+
+      /// \brief Pointers to components parallel to entityIds, one vector per
+      ///   type in resultTypes
+      public: std::vector<std::vector<void const *> > components;
+
+      /// \brief Pools the component pointers point into
+      public: std::vector<ComponentPool *> pools;
+
+      /// \brief Version of each pool when the pointers were last updated
+      public: std::vector<uint64_t> poolVersions;
+
+      /// \brief true if the pointers must all be found again, because
+      ///   entities or types changed without keeping them in step
+      public: bool entitiesChanged = false;
+
+      /// \brief entities given a row by the last commit whose pointers
+      ///   haven't been found yet
+      public: std::vector<EntityId> newRows;
+
+      /// \brief true if changes to the results are listed
+      public: bool reactive = false;
+
+      /// \brief database update the lists of changes belong to
+      public: uint64_t changesUpdate = 0;
+
+      /// \brief entities that started matching, sorted
+      public: std::vector<EntityId> addedIds;
+
+      /// \brief entities that stopped matching, sorted
+      public: std::vector<EntityId> removedIds;
+
+      /// \brief entities whose components changed, sorted
+      public: std::vector<EntityId> modifiedIds;
+
+      /// \brief Remember entities that stopped matching
+      /// \param[in] _ids sorted ids that were in the results
+      public: void Left(const std::vector<EntityId> &_ids);
+
+      /// \brief Remember entities that started matching
+      /// \param[in] _ids sorted ids that weren't in the results
+      public: void Joined(const std::vector<EntityId> &_ids);
+
+      /// \brief Remove rows from the results, shifting only the rows after
+      ///   the first one removed
+      /// \param[in] _ids sorted ids that are in the results
+      public: void RemoveRows(const std::vector<EntityId> &_ids);
+
+      /// \brief Insert rows into the results, shifting only the rows after
+      ///   the first one inserted. Their pointers are found by
+      ///   UpdateComponents().
+      /// \param[in] _ids sorted ids that aren't in the results
+      public: void InsertRows(const std::vector<EntityId> &_ids);
+
+      /// \brief Copy a row of the results over another
+      /// \param[in] _from index of the row to copy
+      /// \param[in] _to index of the row to overwrite
+      public: void MoveRow(std::size_t _from, std::size_t _to);
+
+      /// \brief Find the component of an entity's row again
+      /// \param[in] _column index of the component's type in resultTypes
+      /// \param[in] _id entity, nothing happens if it isn't in the results
+      public: void FindRow(std::size_t _column, EntityId _id);
+
+      /// \brief Point the components at the current storage, and list
+      ///   entities whose components changed if the query is reactive
+      /// \param[in] _pools pool for each of resultTypes in ascending
+      ///   order of type, nullptr if there is no pool for a type
+      public: void UpdateComponents(
+                  const std::vector<ComponentPool *> &_pools);
+
+      /// \brief Get a copy of a component in the results to modify
+      /// \param[in] _column index of the component's type in resultTypes
+      /// \param[in] _component pointer to the component in its pool
+      /// \returns pointer to the copy
+      public: void *Modify(std::size_t _column,
+                  void const *_component) const;
+    };
+  }
+}
+#endif
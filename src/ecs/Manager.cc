@@ -14,22 +14,31 @@
  * limitations under the License.
  *
 */
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
 #include <queue>
 #include <set>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include <ignition/common/Console.hh>
 #include <sdf/sdf.hh>
-#include <ignition/common/WorkerPool.hh>
 
+#include "gazebo/components/Geometry.hh"
+#include "gazebo/components/WorldPose.hh"
 #include "gazebo/ecs/Componentizer.hh"
 #include "gazebo/ecs/EntityComponentDatabase.hh"
 #include "gazebo/ecs/EntityQuery.hh"
 #include "gazebo/ecs/Manager.hh"
 #include "gazebo/ecs/QueryRegistrar.hh"
+#include "gazebo/ecs/SpatialIndex.hh"
+#include "gazebo/ecs/TaskScheduler.hh"
 #include "gazebo/util/DiagnosticsManager.hh"
 
 using namespace gazebo;
@@ -38,6 +47,59 @@ using namespace ecs;
 /// \brief Forward declaration
 class System;
 
+/// \brief Clock updates are paced with
+typedef std::chrono::steady_clock PaceClock;
+
+/// \brief Furthest the pacing schedule may fall behind. Updates run back
+///   to back until it's caught up, but time lost beyond this is dropped.
+static const std::chrono::milliseconds MAX_PACE_LAG(100);
+
+/// \brief Furthest the pacing schedule may run ahead of the wall clock,
+///   beyond the wall time of the step before. Further means sim time
+///   jumped forward, so the schedule starts over.
+static const std::chrono::milliseconds MAX_PACE_LEAD(100);
+
+/// \brief How long before a deadline to stop sleeping and spin, since
+///   sleeps overshoot by tens of microseconds
+static const std::chrono::microseconds PACE_SPIN(100);
+
+/////////////////////////////////////////////////
+/// \brief Get the greatest common divisor of two numbers
+static unsigned int Gcd(unsigned int _a, unsigned int _b)
+{
+  while (_b)
+  {
+    const unsigned int r = _a % _b;
+    _a = _b;
+    _b = r;
+  }
+  return _a;
+}
+
+/////////////////////////////////////////////////
+/// \brief Sleep, then spin, until a point in time
+/// \param[in] _deadline when to return
+static void SleepUntil(const PaceClock::time_point &_deadline)
+{
+  if (PaceClock::now() + PACE_SPIN < _deadline)
+    std::this_thread::sleep_until(_deadline - PACE_SPIN);
+  while (PaceClock::now() < _deadline)
+  {
+  }
+}
+
+/////////////////////////////////////////////////
+/// \brief A callback and the results it's called with
+struct SystemUpdate
+{
+  /// \brief results of a query, owned by the database
+  /// \remarks queries aren't removed, so this stays valid
+  public: const EntityQuery *query;
+
+  /// \brief called with the results every update
+  public: QueryCallback callback;
+};
+
 /////////////////////////////////////////////////
 /// \brief struct to hold information required for updating a system
 struct SystemInfo
@@ -45,13 +107,82 @@ struct SystemInfo
   /// \brief name of a system
   public: std::string name;
 
-  /// \brief List of callbacks to call
-  public: std::vector<std::pair<EntityQueryId, QueryCallback> > updates;
+  /// \brief Callbacks to call in order, resolved when the system is loaded
+  public: std::vector<SystemUpdate> updates;
+
+  /// \brief Components the system reads
+  public: ComponentMask reads;
+
+  /// \brief Components the system writes
+  public: ComponentMask writes;
+
+  /// \brief True if the system declared what it accesses
+  public: bool declared = false;
+
+  /// \brief Components the system or its queries may access, all if it
+  ///   didn't declare
+  public: ComponentMask needs;
+
+  /// \brief Systems loaded later that wait for this one every update
+  public: std::vector<std::size_t> successors;
+
+  /// \brief Number of systems loaded earlier this one waits for
+  public: std::size_t numPredecessors = 0;
+
+  /// \brief Steps between updates of the system
+  public: unsigned int every = 1;
+
+  /// \brief The system updates on steps where step % every == phase
+  public: unsigned int phase = 0;
+
+  /// \brief Updates per second of sim time, 0 if every was declared
+  public: double rate = 0;
+};
+
+/////////////////////////////////////////////////
+/// \brief Chunks of query results shared by the threads iterating them
+struct ChunkedWork
+{
+  /// \brief function called for each chunk
+  public: const std::function<void(std::size_t, std::size_t)> *fn;
+
+  /// \brief number of entities in the results
+  public: std::size_t count;
+
+  /// \brief entities per chunk
+  public: std::size_t chunkSize;
+
+  /// \brief number of chunks
+  public: std::size_t numChunks;
+
+  /// \brief next chunk to be taken
+  public: std::atomic<std::size_t> next{0};
+
+  /// \brief Take chunks and call the function on them until none are left
+  public: void Run()
+          {
+            std::size_t chunk;
+            while ((chunk = this->next.fetch_add(1)) < this->numChunks)
+            {
+              const std::size_t begin = chunk * this->chunkSize;
+              (*this->fn)(begin,
+                  std::min(begin + this->chunkSize, this->count));
+            }
+          }
 };
 
 /////////////////////////////////////////////////
 class gazebo::ecs::ManagerPrivate
 {
+  /// \brief Constructor
+  /// \param[in] _threads number of worker threads
+  /// \param[in] _cpus CPUs to pin the workers to
+  public: ManagerPrivate(unsigned int _threads,
+              const std::vector<int> &_cpus)
+          : scheduler(_threads, _cpus)
+          {
+          }
+
   /// \brief Componentizers that are added to the manager
   public: std::vector<std::unique_ptr<Componentizer> > componentizers;
 
@@ -61,8 +192,8 @@ class gazebo::ecs::ManagerPrivate
   /// \brief System info associated with a system by index
   public: std::vector<SystemInfo> systemInfo;
 
-  /// \brief Pool of workers to do stuff in parallel
-  public: ignition::common::WorkerPool workerThreads;
+  /// \brief Runs systems and their tasks in parallel
+  public: TaskScheduler scheduler;
 
   /// \brief Handles storage and quering of components
   public: EntityComponentDatabase database;
@@ -79,22 +210,106 @@ class gazebo::ecs::ManagerPrivate
   /// \brief true if the simulation is paused
   public: bool paused = false;
 
+  /// \brief Real time factor updates are paced at, 0 when there is no
+  ///   schedule to keep
+  public: double paceRtf = 0;
+
+  /// \brief Wall time the pacing schedule starts at
+  public: PaceClock::time_point paceWallStart;
+
+  /// \brief Sim time the pacing schedule starts at
+  public: ignition::common::Time paceSimStart;
+
+  /// \brief Wall time the last paced update ended
+  public: PaceClock::time_point paceWallLast;
+
+  /// \brief Sim time the last paced update ended
+  public: ignition::common::Time paceSimLast;
+
   /// \brief tool for publishing diagnostic info
   public: util::DiagnosticsManager diagnostics;
 
   /// \brief mutex for protecting diagnostics when doing multi-threaded stuff
   public: std::mutex diagMtx;
 
+  /// \brief Protects waiting
+  public: std::mutex scheduleMtx;
+
+  /// \brief Number of systems each system still waits for this update
+  public: std::vector<std::size_t> waiting;
+
+  /// \brief Systems running this update
+  public: TaskGroup systemTasks;
+
+  /// \brief Whether each system updates this step, index is the system
+  public: std::vector<bool> due;
+
+  /// \brief Number of updates so far
+  public: uint64_t step = 0;
+
+  /// \brief Sim time the last update that advanced it advanced it by
+  public: ignition::common::Time baseStep;
+
+  /// \brief True to commit modified components while systems run
+  public: bool pipelined = false;
+
+  /// \brief Nanoseconds spent committing deferred components this update,
+  ///   counted if diagnostics are on
+  public: std::atomic<int64_t> deferredNs{0};
+
+  /// \brief Index of entities by position, if enabled
+  public: std::unique_ptr<ecs::SpatialIndex> spatialIndex;
+
+  /// \brief Query the spatial index is updated from
+  public: EntityQueryId spatialQuery;
+
   /// \brief Updates the state and systems once
   public: void UpdateOnce();
 
+  /// \brief Spawn a task running a system
+  /// \param[in] _index index of the system
+  public: void StartSystem(std::size_t _index);
+
+  /// \brief Spawn a task committing a deferred type of component, then
+  ///   starting systems waiting for it
+  /// \param[in] _type the type
+  /// \param[in] _timed true to count the time it takes
+  public: void StartCommit(ComponentType _type, bool _timed);
+
+  /// \brief Run a system's callbacks, then start systems waiting for it
+  /// \param[in] _index index of the system
+  public: void RunSystem(std::size_t _index);
+
+  /// \brief Pick the phase of a system that skips steps, so as few
+  ///   systems as possible update on the same steps
+  /// \param[in] _index index of the system
+  public: void AssignPhase(std::size_t _index);
+
+  /// \brief Turn a system's rate into steps between updates, if the
+  ///   base step is known
+  /// \param[in] _index index of the system
+  public: void ApplyRate(std::size_t _index);
+
+  /// \brief Get whether two systems can't run at the same time
+  /// \param[in] _a a system
+  /// \param[in] _b another system
+  /// \return true if both write the same component, or either didn't
+  ///   declare what it accesses
+  public: static bool Conflict(const SystemInfo &_a, const SystemInfo &_b);
+
   /// \brief Invokes componentizers on SDF
   public: void Componentize(Manager *_mgr, sdf::SDF &_sdf);
 };
 
 /////////////////////////////////////////////////
 Manager::Manager()
-: dataPtr(new ManagerPrivate)
+: Manager(TaskScheduler::DefaultThreadCount())
+{
+}
+
+/////////////////////////////////////////////////
+Manager::Manager(unsigned int _threads, const std::vector<int> &_cpus)
+: dataPtr(new ManagerPrivate(_threads, _cpus))
 {
   this->dataPtr->pauseCount = 0;
   this->dataPtr->diagnostics.Init("ecs:Manager");
@@ -111,6 +326,13 @@ EntityId Manager::CreateEntity()
   return this->dataPtr->database.CreateEntity();
 }
 
+/////////////////////////////////////////////////
+EntityBatch Manager::CreateEntities(std::size_t _count,
+    const std::vector<ComponentType> &_types)
+{
+  return this->dataPtr->database.CreateEntities(_count, _types);
+}
+
 /////////////////////////////////////////////////
 bool Manager::DeleteEntity(EntityId _id)
 {
@@ -120,38 +342,101 @@ bool Manager::DeleteEntity(EntityId _id)
 /////////////////////////////////////////////////
 void Manager::UpdateOnce()
 {
+  // Sim time advances off the schedule, so the next paced update starts
+  // a new one
+  this->dataPtr->paceRtf = 0;
   this->dataPtr->diagnostics.UpdateBegin(this->dataPtr->simTime);
   this->dataPtr->UpdateOnce();
   this->dataPtr->diagnostics.UpdateEnd();
 }
 
 /////////////////////////////////////////////////
-void Manager::UpdateOnce(double _real_time_factor)
+void Manager::UpdateOnce(double _realTimeFactor)
 {
-  this->dataPtr->diagnostics.UpdateBegin(this->dataPtr->simTime);
+  if (_realTimeFactor <= 0)
+  {
+    this->UpdateOnce();
+    return;
+  }
 
-  ignition::common::Time startWallTime = ignition::common::Time::SystemTime();
-  ignition::common::Time startSimTime = this->dataPtr->simTime;
+  ManagerPrivate &data = *this->dataPtr;
+  data.diagnostics.UpdateBegin(data.simTime);
 
-  this->dataPtr->UpdateOnce();
+  // Start a new schedule if there isn't one for this real time factor
+  PaceClock::time_point now = PaceClock::now();
+  if (data.paceRtf != _realTimeFactor)
+  {
+    data.paceRtf = _realTimeFactor;
+    data.paceWallStart = now;
+    data.paceSimStart = data.simTime;
+    data.paceWallLast = now;
+    data.paceSimLast = data.simTime;
+  }
+
+  // A step is only known to be a jump compared to the ones before
+  const ignition::common::Time lastStep = data.baseStep;
+  data.UpdateOnce();
+
+  // Every update ends when the schedule says its sim time is due, so a
+  // late update is made up by the next ones instead of adding up
+  now = PaceClock::now();
+  const ignition::common::Time simElapsed = data.simTime - data.paceSimStart;
+  PaceClock::time_point deadline = data.paceWallStart +
+    std::chrono::duration_cast<PaceClock::duration>(
+        std::chrono::duration<double>(simElapsed.Double() / _realTimeFactor));
+  const PaceClock::duration lastStepWall =
+    std::chrono::duration_cast<PaceClock::duration>(
+        std::chrono::duration<double>(lastStep.Double() / _realTimeFactor));
+  if (data.paused || simElapsed < ignition::common::Time::Zero ||
+      deadline - now > lastStepWall + MAX_PACE_LEAD)
+  {
+    // Sim time stopped or jumped, start over from here
+    data.paceWallStart = now;
+    data.paceSimStart = data.simTime;
+    deadline = now;
+  }
+  else if (now - deadline > MAX_PACE_LAG)
+  {
+    // Too far behind to catch up, move the schedule forward
+    data.paceWallStart += (now - deadline) - MAX_PACE_LAG;
+    deadline = now - MAX_PACE_LAG;
+  }
 
-  ignition::common::Time endSimTime = this->dataPtr->simTime;
-  ignition::common::Time endWallTime = ignition::common::Time::SystemTime();
+  data.diagnostics.StartTimer("sleep");
+  SleepUntil(deadline);
+  data.diagnostics.StopTimer("sleep");
 
-  this->dataPtr->diagnostics.StartTimer("sleep");
-  const ignition::common::Time scalar(_real_time_factor);
-  const ignition::common::Time deltaWall = endWallTime - startWallTime;
-  const ignition::common::Time deltaSim = endSimTime - startSimTime;
-  const ignition::common::Time expectedDeltaWall = deltaSim / scalar;
-  if (deltaWall < expectedDeltaWall)
+  // Compare the real time factor since the last update to the target
+  now = PaceClock::now();
+  const double wallElapsed =
+    std::chrono::duration<double>(now - data.paceWallLast).count();
+  if (wallElapsed > 0)
   {
-    ignition::common::Time sleep = (expectedDeltaWall - deltaWall);
-    std::this_thread::sleep_for(std::chrono::seconds(sleep.sec) +
-        std::chrono::nanoseconds(sleep.nsec));
+    data.diagnostics.AddValue("real time factor",
+        (data.simTime - data.paceSimLast).Double() / wallElapsed);
   }
-  this->dataPtr->diagnostics.StopTimer("sleep");
+  data.diagnostics.AddValue("target real time factor", _realTimeFactor);
+  data.paceWallLast = now;
+  data.paceSimLast = data.simTime;
 
-  this->dataPtr->diagnostics.UpdateEnd();
+  data.diagnostics.UpdateEnd();
+}
+
+/////////////////////////////////////////////////
+void Manager::Step(uint64_t _steps)
+{
+  if (_steps == 0)
+    return;
+
+  // Diagnostics read the clock, so only the last update is timed
+  util::DiagnosticsManager &diagnostics = this->dataPtr->diagnostics;
+  const bool enabled = diagnostics.Enabled();
+  diagnostics.Enabled(false);
+  for (uint64_t i = 1; i < _steps; ++i)
+    this->dataPtr->UpdateOnce();
+  diagnostics.Enabled(enabled);
+
+  this->UpdateOnce();
 }
 
 /////////////////////////////////////////////////
@@ -162,36 +447,269 @@ void ManagerPrivate::UpdateOnce()
   // even when simulation time is paused, so it's up to each system to check
   this->paused = this->pauseCount;
 
-  // Let database do some stuff before starting the new update
+  // Let database do some stuff before starting the new update. When
+  // pipelined, modified components are moved into place while systems that
+  // don't need them already run.
+  ComponentMask defer;
+  if (this->pipelined)
+  {
+    defer.set();
+    // The spatial index is updated before any system runs
+    if (this->spatialIndex)
+    {
+      defer.reset(ComponentFactory::Type<components::WorldPose>());
+      defer.reset(ComponentFactory::Type<components::Geometry>());
+    }
+  }
+  const bool timed = this->pipelined && this->diagnostics.Enabled();
+  const PaceClock::time_point updateStart =
+    timed ? PaceClock::now() : PaceClock::time_point();
   this->diagnostics.StartTimer("database");
-  this->database.Update();
+  const ComponentMask deferred = this->database.Update(defer);
   this->diagnostics.StopTimer("database");
+  const std::chrono::duration<double> serial =
+    timed ? PaceClock::now() - updateStart : PaceClock::duration::zero();
+  this->diagnostics.AddValue("staging bytes",
+      static_cast<double>(this->database.StagingBytes()));
+
+  if (this->spatialIndex)
+  {
+    this->diagnostics.StartTimer("spatial index");
+    this->spatialIndex->Update(this->database.Query(this->spatialQuery));
+    this->diagnostics.StopTimer("spatial index");
+  }
 
-  // Update systems in parallel
-  for(auto &sysInfo : this->systemInfo)
+  // Update systems in parallel. Systems that don't wait for others or for
+  // deferred components are started now, the rest when the last thing
+  // they wait for finishes. This thread runs tasks too until all are done.
+  std::vector<std::size_t> ready;
   {
-    this->workerThreads.AddWork([&sysInfo, this] ()
+    std::lock_guard<std::mutex> lock(this->scheduleMtx);
+    for (std::size_t i = 0; i < this->systemInfo.size(); ++i)
+    {
+      const SystemInfo &sysInfo = this->systemInfo[i];
+      this->due[i] = this->step % sysInfo.every == sysInfo.phase;
+      this->waiting[i] = sysInfo.numPredecessors;
+      if (this->due[i])
+        this->waiting[i] += (sysInfo.needs & deferred).count();
+    }
+    // Systems that aren't due count as finished. Systems that conflict
+    // with each other are ordered directly, so none is run early.
+    for (std::size_t i = 0; i < this->systemInfo.size(); ++i)
+    {
+      if (this->due[i])
+        continue;
+      for (std::size_t next : this->systemInfo[i].successors)
+        --this->waiting[next];
+    }
+    for (std::size_t i = 0; i < this->systemInfo.size(); ++i)
+    {
+      if (this->due[i] && this->waiting[i] == 0)
+        ready.push_back(i);
+    }
+  }
+  this->deferredNs = 0;
+  for (ComponentType type = 0; type < MAX_COMPONENT_TYPES; ++type)
+  {
+    if (deferred.test(type))
+      this->StartCommit(type, timed);
+  }
+  for (std::size_t index : ready)
+    this->StartSystem(index);
+  this->scheduler.Wait(this->systemTasks);
+
+  if (this->pipelined)
+  {
+    // Share of the database update taken off the critical path
+    const double overlapped = this->deferredNs.load() * 1e-9;
+    this->diagnostics.AddValue("deferred types",
+        static_cast<double>(deferred.count()));
+    if (overlapped + serial.count() > 0)
+    {
+      this->diagnostics.AddValue("pipelined commit fraction",
+          overlapped / (overlapped + serial.count()));
+    }
+  }
+
+  // Systems declaring a rate need to know how long a step is
+  const ignition::common::Time advance = this->nextSimTime - this->simTime;
+  if (advance > ignition::common::Time::Zero && advance != this->baseStep)
+  {
+    this->baseStep = advance;
+    for (std::size_t i = 0; i < this->systemInfo.size(); ++i)
+      this->ApplyRate(i);
+  }
+  ++this->step;
+
+  // Advance sim time according to what was set last update
+  this->simTime = this->nextSimTime;
+}
+
+/////////////////////////////////////////////////
+void ManagerPrivate::AssignPhase(std::size_t _index)
+{
+  SystemInfo &sysInfo = this->systemInfo[_index];
+  sysInfo.phase = 0;
+  if (sysInfo.every <= 1)
+    return;
+
+  // Two systems update on the same step once every lcm of their periods
+  // if their phases agree modulo the gcd of their periods
+  double leastOverlap = std::numeric_limits<double>::max();
+  for (unsigned int phase = 0; phase < sysInfo.every; ++phase)
+  {
+    double overlap = 0;
+    for (std::size_t i = 0; i < this->systemInfo.size(); ++i)
+    {
+      const SystemInfo &other = this->systemInfo[i];
+      if (i == _index || other.every <= 1)
+        continue;
+      const unsigned int gcd = Gcd(sysInfo.every, other.every);
+      if (phase % gcd == other.phase % gcd)
+      {
+        overlap += static_cast<double>(gcd) /
+          (static_cast<double>(sysInfo.every) * other.every);
+      }
+    }
+    if (overlap < leastOverlap)
+    {
+      leastOverlap = overlap;
+      sysInfo.phase = phase;
+    }
+  }
+}
+
+/////////////////////////////////////////////////
+void ManagerPrivate::ApplyRate(std::size_t _index)
+{
+  SystemInfo &sysInfo = this->systemInfo[_index];
+  const double step = this->baseStep.Double();
+  if (!(sysInfo.rate > 0) || !(step > 0))
+    return;
+  const double steps = std::round(1.0 / (sysInfo.rate * step));
+  sysInfo.every = static_cast<unsigned int>(std::max(1.0,
+        std::min(steps, 1e9)));
+  this->AssignPhase(_index);
+}
+
+/////////////////////////////////////////////////
+void ManagerPrivate::StartSystem(std::size_t _index)
+{
+  this->scheduler.Spawn(this->systemTasks, [this, _index] ()
+      {
+        this->RunSystem(_index);
+      });
+}
+
+/////////////////////////////////////////////////
+void ManagerPrivate::StartCommit(ComponentType _type, bool _timed)
+{
+  this->scheduler.Spawn(this->systemTasks, [this, _type, _timed] ()
+      {
+        const PaceClock::time_point start =
+          _timed ? PaceClock::now() : PaceClock::time_point();
+        this->database.CommitModified(_type);
+        if (_timed)
         {
+          this->deferredNs += std::chrono::duration_cast<
+            std::chrono::nanoseconds>(PaceClock::now() - start).count();
+        }
+
+        std::lock_guard<std::mutex> lock(this->scheduleMtx);
+        for (std::size_t i = 0; i < this->systemInfo.size(); ++i)
+        {
+          if (this->due[i] && this->systemInfo[i].needs.test(_type) &&
+              --this->waiting[i] == 0)
           {
-            std::unique_lock<std::mutex> diagLock(this->diagMtx);
-            this->diagnostics.StartTimer(sysInfo.name);
-          }
-          for (auto &updateInfo : sysInfo.updates)
-          {
-            auto query = this->database.Query(updateInfo.first);
-            QueryCallback cb = updateInfo.second;
-            cb(query);
-          }
-          {
-             std::unique_lock<std::mutex> diagLock(this->diagMtx);
-             this->diagnostics.StopTimer(sysInfo.name);
+            this->StartSystem(i);
           }
-        });
+        }
+      });
+}
+
+/////////////////////////////////////////////////
+void ManagerPrivate::RunSystem(std::size_t _index)
+{
+  SystemInfo &sysInfo = this->systemInfo[_index];
+  {
+    std::unique_lock<std::mutex> diagLock(this->diagMtx);
+    this->diagnostics.StartTimer(sysInfo.name);
+  }
+  for (const SystemUpdate &update : sysInfo.updates)
+    update.callback(*update.query);
+  {
+    std::unique_lock<std::mutex> diagLock(this->diagMtx);
+    this->diagnostics.StopTimer(sysInfo.name);
   }
-  assert(this->workerThreads.WaitForResults());
 
-  // Advance sim time according to what was set last update
-  this->simTime = this->nextSimTime;
+  // Successors are spawned before this task counts as finished, so the
+  // update can't end early
+  std::lock_guard<std::mutex> lock(this->scheduleMtx);
+  for (std::size_t next : sysInfo.successors)
+  {
+    if (--this->waiting[next] == 0 && this->due[next])
+      this->StartSystem(next);
+  }
+}
+
+/////////////////////////////////////////////////
+bool ManagerPrivate::Conflict(const SystemInfo &_a, const SystemInfo &_b)
+{
+  if (!_a.declared || !_b.declared)
+    return true;
+  // Readers see components as of the last update whatever the order, so
+  // only writers of the same component need one
+  return (_a.writes & _b.writes).any();
+}
+
+/////////////////////////////////////////////////
+void Manager::ParallelForEachChunk(const EntityQuery &_query,
+    const std::function<void(std::size_t, std::size_t)> &_fn)
+{
+  const std::size_t count = _query.EntityIds().size();
+  const std::size_t chunkSize = _query.ChunkSize();
+  const std::size_t numChunks = (count + chunkSize - 1) / chunkSize;
+  if (numChunks <= 1)
+  {
+    if (count)
+      _fn(0, count);
+    return;
+  }
+
+  ChunkedWork work;
+  work.fn = &_fn;
+  work.count = count;
+  work.chunkSize = chunkSize;
+  work.numChunks = numChunks;
+
+  // Idle workers steal the helpers, and take chunks until none are left.
+  // Helpers that start late find nothing to do.
+  TaskScheduler &scheduler = this->dataPtr->scheduler;
+  TaskGroup helpers;
+  const std::size_t numHelpers = std::min<std::size_t>(numChunks - 1,
+      scheduler.ThreadCount());
+  for (std::size_t i = 0; i < numHelpers; ++i)
+    scheduler.Spawn(helpers, [&work]() {work.Run();});
+  work.Run();
+  scheduler.Wait(helpers);
+}
+
+/////////////////////////////////////////////////
+void Manager::Pipelined(bool _pipelined)
+{
+  this->dataPtr->pipelined = _pipelined;
+}
+
+/////////////////////////////////////////////////
+bool Manager::Pipelined() const
+{
+  return this->dataPtr->pipelined;
+}
+
+/////////////////////////////////////////////////
+TaskScheduler &Manager::Scheduler()
+{
+  return this->dataPtr->scheduler;
 }
 
 /////////////////////////////////////////////////
@@ -206,20 +724,76 @@ bool Manager::LoadSystem(const std::string &_name,
     QueryRegistrar registrar;
     _sys->Manager(this);
     _sys->Init(registrar);
-    for (auto registration : registrar.Registrations())
+    for (auto const &registration : registrar.Registrations())
+    {
+      auto result = this->dataPtr->database.AddQuery(registration.first);
+      SystemUpdate update;
+      update.query = &this->dataPtr->database.Query(result.first);
+      update.callback = registration.second;
+      sysInfo.updates.push_back(std::move(update));
+    }
+    sysInfo.reads = registrar.ReadMask();
+    sysInfo.writes = registrar.WriteMask();
+    sysInfo.declared = registrar.Declared();
+    sysInfo.needs = sysInfo.reads | sysInfo.writes;
+    for (const SystemUpdate &update : sysInfo.updates)
+    {
+      sysInfo.needs |= update.query->Mask();
+      for (ComponentType type : update.query->OptionalTypes())
+        sysInfo.needs.set(type);
+    }
+    if (!sysInfo.declared)
+      sysInfo.needs.set();
+    sysInfo.every = registrar.UpdateEvery();
+    sysInfo.rate = registrar.UpdateRate();
+
+    // When systems conflict the one loaded first runs first
+    const std::size_t index = this->dataPtr->systemInfo.size();
+    for (SystemInfo &other : this->dataPtr->systemInfo)
     {
-      EntityQuery &query = registration.first;
-      QueryCallback &cb = registration.second;
-      auto result = this->dataPtr->database.AddQuery(query);
-      sysInfo.updates.push_back(std::make_pair(result.first, cb));
+      if (ManagerPrivate::Conflict(other, sysInfo))
+      {
+        other.successors.push_back(index);
+        ++sysInfo.numPredecessors;
+      }
     }
     this->dataPtr->systems.push_back(std::move(_sys));
-    this->dataPtr->systemInfo.push_back(sysInfo);
+    this->dataPtr->systemInfo.push_back(std::move(sysInfo));
+    this->dataPtr->waiting.push_back(0);
+    this->dataPtr->due.push_back(false);
+    this->dataPtr->AssignPhase(index);
+    this->dataPtr->ApplyRate(index);
     success = true;
   }
   return success;
 }
 
+//////////////////////////////////////////////////
+bool Manager::EnableSpatialIndex(double _cellSize)
+{
+  if (this->dataPtr->spatialIndex || !(_cellSize > 0))
+    return false;
+
+  EntityQuery query;
+  if (!query.AddComponent<components::WorldPose>() ||
+      !query.AddComponent<components::Geometry>())
+  {
+    std::cerr << "WorldPose and Geometry must be registered to index them"
+      << std::endl;
+    return false;
+  }
+  query.Reactive(true);
+  this->dataPtr->spatialQuery = this->dataPtr->database.AddQuery(query).first;
+  this->dataPtr->spatialIndex.reset(new ecs::SpatialIndex(_cellSize));
+  return true;
+}
+
+//////////////////////////////////////////////////
+const ecs::SpatialIndex *Manager::SpatialIndex() const
+{
+  return this->dataPtr->spatialIndex.get();
+}
+
 //////////////////////////////////////////////////
 bool Manager::LoadComponentizer(std::unique_ptr<Componentizer> _cz)
 {
@@ -304,6 +878,13 @@ gazebo::ecs::Entity &Manager::Entity(const EntityId _id) const
   return this->dataPtr->database.Entity(_id);
 }
 
+/////////////////////////////////////////////////
+const std::vector<EntityId> &Manager::ChangedEntities(
+    ComponentType _type) const
+{
+  return this->dataPtr->database.ChangedEntities(_type);
+}
+
 /////////////////////////////////////////////////
 const ignition::common::Time &Manager::SimulationTime() const
 {
@@ -358,5 +939,6 @@ std::set<gazebo::ecs::EntityId> Manager::QueryEntities(
   }
 
   this->dataPtr->database.InstantQuery(q);
-  return q.EntityIds();
+  auto const &ids = q.EntityIds();
+  return std::set<EntityId>(ids.begin(), ids.end());
 }
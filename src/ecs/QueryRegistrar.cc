@@ -15,6 +15,7 @@
  *
 */
 
+#include <iostream>
 #include <utility>
 #include <vector>
 
@@ -26,6 +27,21 @@ class gazebo::ecs::QueryRegistrarPrivate
 {
   /// \brief queries and callbacks that have been registered
   public: std::vector<QueryRegistration> queryCallbacks;
+
+  /// \brief components the system reads
+  public: ComponentMask readMask;
+
+  /// \brief components the system writes
+  public: ComponentMask writeMask;
+
+  /// \brief true if the system declared what it accesses, maybe nothing
+  public: bool declared = false;
+
+  /// \brief steps between updates
+  public: unsigned int every = 1;
+
+  /// \brief updates per second of sim time, 0 if not declared
+  public: double rate = 0;
 };
 
 /////////////////////////////////////////////////
@@ -52,3 +68,105 @@ std::vector<QueryRegistration> QueryRegistrar::Registrations() const
   return this->dataPtr->queryCallbacks;
 }
 
+/////////////////////////////////////////////////
+bool QueryRegistrar::Reads(ComponentType _type)
+{
+  if (_type < 0 || _type >= MAX_COMPONENT_TYPES)
+    return false;
+  this->dataPtr->readMask.set(_type);
+  this->dataPtr->declared = true;
+  return true;
+}
+
+/////////////////////////////////////////////////
+bool QueryRegistrar::Writes(ComponentType _type)
+{
+  if (_type < 0 || _type >= MAX_COMPONENT_TYPES)
+    return false;
+  this->dataPtr->writeMask.set(_type);
+  this->dataPtr->declared = true;
+  return true;
+}
+
+/////////////////////////////////////////////////
+void QueryRegistrar::Accesses(ComponentType _type, bool _write)
+{
+  if (_type < 0 || _type >= MAX_COMPONENT_TYPES)
+    return;
+  if (_write)
+    this->dataPtr->writeMask.set(_type);
+  else
+    this->dataPtr->readMask.set(_type);
+}
+
+/////////////////////////////////////////////////
+const ComponentMask &QueryRegistrar::ReadMask() const
+{
+  return this->dataPtr->readMask;
+}
+
+/////////////////////////////////////////////////
+const ComponentMask &QueryRegistrar::WriteMask() const
+{
+  return this->dataPtr->writeMask;
+}
+
+/////////////////////////////////////////////////
+void QueryRegistrar::DeclareNone()
+{
+  this->dataPtr->declared = true;
+}
+
+/////////////////////////////////////////////////
+bool QueryRegistrar::Declared() const
+{
+  return this->dataPtr->declared;
+}
+
+/////////////////////////////////////////////////
+bool QueryRegistrar::UpdateEvery(unsigned int _steps)
+{
+  if (_steps == 0)
+    return false;
+  this->dataPtr->every = _steps;
+  this->dataPtr->rate = 0;
+  return true;
+}
+
+/////////////////////////////////////////////////
+unsigned int QueryRegistrar::UpdateEvery() const
+{
+  return this->dataPtr->every;
+}
+
+/////////////////////////////////////////////////
+bool QueryRegistrar::UpdateRate(double _hz)
+{
+  if (!(_hz > 0))
+    return false;
+  this->dataPtr->rate = _hz;
+  this->dataPtr->every = 1;
+  return true;
+}
+
+/////////////////////////////////////////////////
+double QueryRegistrar::UpdateRate() const
+{
+  return this->dataPtr->rate;
+}
+
+/////////////////////////////////////////////////
+bool QueryRegistrar::MakeQuery(const ComponentType *_types,
+    std::size_t _count, EntityQuery &_query)
+{
+  for (std::size_t i = 0; i < _count; ++i)
+  {
+    if (!_query.AddComponent(_types[i]))
+    {
+      std::cerr << "Undefined component in typed query" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
@@ -0,0 +1,650 @@
+/*
+ * Copyright (C) 2017 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "gazebo/components/Geometry.hh"
+#include "gazebo/components/WorldPose.hh"
+#include "gazebo/ecs/ComponentFactory.hh"
+#include "gazebo/ecs/EntityQuery.hh"
+#include "gazebo/ecs/SpatialIndex.hh"
+
+using namespace gazebo;
+using namespace ecs;
+
+/// \brief Cell coordinates are clamped to this so they can't overflow
+static const double MAX_CELL = 1e15;
+
+/////////////////////////////////////////////////
+/// \brief Coordinates of a grid cell
+struct Cell
+{
+  /// \brief x, y and z index of the cell
+  public: int64_t coords[3];
+
+  /// \brief Equality operator
+  public: bool operator==(const Cell &_other) const
+          {
+            return this->coords[0] == _other.coords[0] &&
+              this->coords[1] == _other.coords[1] &&
+              this->coords[2] == _other.coords[2];
+          }
+};
+
+/////////////////////////////////////////////////
+/// \brief Hash of a grid cell
+struct CellHash
+{
+  /// \brief Hash a cell
+  public: std::size_t operator()(const Cell &_cell) const
+          {
+            // Large primes spread neighbouring cells over the buckets
+            return static_cast<std::size_t>(
+                (static_cast<uint64_t>(_cell.coords[0]) * 73856093u) ^
+                (static_cast<uint64_t>(_cell.coords[1]) * 19349663u) ^
+                (static_cast<uint64_t>(_cell.coords[2]) * 83492791u));
+          }
+};
+
+/////////////////////////////////////////////////
+/// \brief Bounds of an entity in the index
+struct Bounds
+{
+  /// \brief Center of the bounding sphere
+  public: ignition::math::Vector3d center;
+
+  /// \brief Radius of the bounding sphere
+  public: double radius;
+
+  /// \brief True if the sphere is larger than a cell, and kept in the
+  ///   list of large entities instead of a cell
+  public: bool large;
+
+  /// \brief Cell holding the center
+  public: Cell cell;
+};
+
+/////////////////////////////////////////////////
+class gazebo::ecs::SpatialIndexPrivate
+{
+  /// \brief Width of a cell
+  public: double cellSize;
+
+  /// \brief Bounds of every entity in the index
+  public: std::unordered_map<EntityId, Bounds> bounds;
+
+  /// \brief Entities in each cell that isn't empty
+  public: std::unordered_map<Cell, std::vector<EntityId>, CellHash> cells;
+
+  /// \brief Entities larger than a cell
+  public: std::vector<EntityId> large;
+
+  /// \brief Smallest coordinates of cells that held entities
+  /// \remarks only grows until the grid is empty
+  public: Cell lower;
+
+  /// \brief Largest coordinates of cells that held entities
+  public: Cell upper;
+
+  /// \brief True once every result of the query has been indexed
+  public: bool loaded = false;
+
+  /// \brief Get the cell holding a point
+  public: Cell CellOf(const ignition::math::Vector3d &_point) const
+          {
+            const double point[3] = {_point.X(), _point.Y(), _point.Z()};
+            Cell cell;
+            for (int i = 0; i < 3; ++i)
+            {
+              const double c = std::floor(point[i] / this->cellSize);
+              cell.coords[i] = static_cast<int64_t>(
+                  std::max(-MAX_CELL, std::min(MAX_CELL, c)));
+            }
+            return cell;
+          }
+
+  /// \brief Put an entity in its cell or in the list of large entities
+  public: void Link(EntityId _id, const Bounds &_bounds)
+          {
+            if (_bounds.large)
+            {
+              this->large.push_back(_id);
+              return;
+            }
+            if (this->cells.empty())
+            {
+              this->lower = _bounds.cell;
+              this->upper = _bounds.cell;
+            }
+            for (int i = 0; i < 3; ++i)
+            {
+              this->lower.coords[i] = std::min(this->lower.coords[i],
+                  _bounds.cell.coords[i]);
+              this->upper.coords[i] = std::max(this->upper.coords[i],
+                  _bounds.cell.coords[i]);
+            }
+            this->cells[_bounds.cell].push_back(_id);
+          }
+
+  /// \brief Take an entity out of its cell or the list of large entities
+  public: void Unlink(EntityId _id, const Bounds &_bounds)
+          {
+            if (_bounds.large)
+            {
+              auto iter = std::find(this->large.begin(), this->large.end(),
+                  _id);
+              *iter = this->large.back();
+              this->large.pop_back();
+              return;
+            }
+            auto cellIter = this->cells.find(_bounds.cell);
+            std::vector<EntityId> &ids = cellIter->second;
+            *std::find(ids.begin(), ids.end(), _id) = ids.back();
+            ids.pop_back();
+            if (ids.empty())
+              this->cells.erase(cellIter);
+          }
+
+  /// \brief Call a function with every entity in a cell
+  public: template <typename F>
+          void ForEachIn(const Cell &_cell, F _fn) const
+          {
+            auto iter = this->cells.find(_cell);
+            if (iter != this->cells.end())
+            {
+              for (EntityId id : iter->second)
+                _fn(id);
+            }
+          }
+};
+
+/////////////////////////////////////////////////
+/// \brief Get the radius of a sphere around a geometry
+/// \param[in] _geom the geometry
+/// \return radius of a sphere centered on the geometry containing it
+static double BoundingRadius(const components::Geometry &_geom)
+{
+  switch (_geom.type)
+  {
+    case components::Geometry::SPHERE:
+      return _geom.sphere.radius;
+    case components::Geometry::BOX:
+      return _geom.box.size.Length() / 2.0;
+    case components::Geometry::CYLINDER:
+      return std::sqrt(_geom.cylinder.radius * _geom.cylinder.radius +
+          _geom.cylinder.length * _geom.cylinder.length / 4.0);
+    default:
+      return 0.0;
+  }
+}
+
+/////////////////////////////////////////////////
+/// \brief Intersect a ray with a sphere
+/// \param[in] _origin start of the ray
+/// \param[in] _direction unit direction of the ray
+/// \param[in] _bounds the sphere
+/// \param[out] _distance distance along the ray to the sphere
+/// \return true if the ray hits the sphere
+static bool RaySphere(const ignition::math::Vector3d &_origin,
+    const ignition::math::Vector3d &_direction, const Bounds &_bounds,
+    double &_distance)
+{
+  const ignition::math::Vector3d offset = _origin - _bounds.center;
+  const double b = offset.Dot(_direction);
+  const double c = offset.Dot(offset) - _bounds.radius * _bounds.radius;
+  if (c <= 0)
+  {
+    // The origin is inside
+    _distance = 0;
+    return true;
+  }
+  const double discriminant = b * b - c;
+  if (b > 0 || discriminant < 0)
+    return false;
+  _distance = -b - std::sqrt(discriminant);
+  return true;
+}
+
+/////////////////////////////////////////////////
+SpatialIndex::SpatialIndex(double _cellSize)
+: dataPtr(new SpatialIndexPrivate)
+{
+  this->dataPtr->cellSize = _cellSize;
+}
+
+/////////////////////////////////////////////////
+SpatialIndex::~SpatialIndex()
+{
+}
+
+/////////////////////////////////////////////////
+double SpatialIndex::CellSize() const
+{
+  return this->dataPtr->cellSize;
+}
+
+/////////////////////////////////////////////////
+std::size_t SpatialIndex::Size() const
+{
+  return this->dataPtr->bounds.size();
+}
+
+/////////////////////////////////////////////////
+void SpatialIndex::Set(EntityId _id, const ignition::math::Vector3d &_center,
+    double _radius)
+{
+  SpatialIndexPrivate &data = *this->dataPtr;
+  const bool large = _radius > data.cellSize;
+  const Cell cell = data.CellOf(_center);
+
+  auto iter = data.bounds.find(_id);
+  if (iter == data.bounds.end())
+  {
+    iter = data.bounds.insert(std::make_pair(_id, Bounds())).first;
+  }
+  else if (iter->second.large == large &&
+      (large || iter->second.cell == cell))
+  {
+    // Moved within its cell
+    iter->second.center = _center;
+    iter->second.radius = _radius;
+    return;
+  }
+  else
+  {
+    data.Unlink(_id, iter->second);
+  }
+
+  Bounds &bounds = iter->second;
+  bounds.center = _center;
+  bounds.radius = _radius;
+  bounds.large = large;
+  bounds.cell = cell;
+  data.Link(_id, bounds);
+}
+
+/////////////////////////////////////////////////
+bool SpatialIndex::Remove(EntityId _id)
+{
+  auto iter = this->dataPtr->bounds.find(_id);
+  if (iter == this->dataPtr->bounds.end())
+    return false;
+  this->dataPtr->Unlink(_id, iter->second);
+  this->dataPtr->bounds.erase(iter);
+  return true;
+}
+
+/////////////////////////////////////////////////
+void SpatialIndex::Update(const EntityQuery &_result)
+{
+  auto const &ids = _result.EntityIds();
+  auto const &poses = _result.Components(
+      ComponentFactory::Type<components::WorldPose>());
+  auto const &geoms = _result.Components(
+      ComponentFactory::Type<components::Geometry>());
+  if (poses.size() != ids.size() || geoms.size() != ids.size())
+    return;
+
+  auto index = [&](std::size_t _i)
+  {
+    auto pose = static_cast<components::WorldPose const *>(poses[_i]);
+    auto geom = static_cast<components::Geometry const *>(geoms[_i]);
+    // Components removed last update
+    if (!pose || !geom)
+      this->Remove(ids[_i]);
+    else
+      this->Set(ids[_i], pose->position, BoundingRadius(*geom));
+  };
+
+  if (!this->dataPtr->loaded)
+  {
+    for (std::size_t i = 0; i < ids.size(); ++i)
+      index(i);
+    this->dataPtr->loaded = true;
+    return;
+  }
+
+  for (EntityId id : _result.RemovedEntityIds())
+    this->Remove(id);
+  for (auto changed : {&_result.AddedEntityIds(),
+      &_result.ModifiedEntityIds()})
+  {
+    for (EntityId id : *changed)
+    {
+      auto iter = std::lower_bound(ids.begin(), ids.end(), id);
+      if (iter != ids.end() && *iter == id)
+        index(iter - ids.begin());
+    }
+  }
+}
+
+/////////////////////////////////////////////////
+std::vector<EntityId> SpatialIndex::Within(
+    const ignition::math::Vector3d &_point, double _radius) const
+{
+  const SpatialIndexPrivate &data = *this->dataPtr;
+  std::vector<EntityId> result;
+  auto test = [&](EntityId _id)
+  {
+    const Bounds &bounds = data.bounds.find(_id)->second;
+    if ((bounds.center - _point).Length() <= _radius + bounds.radius)
+      result.push_back(_id);
+  };
+
+  for (EntityId id : data.large)
+    test(id);
+
+  if (!data.cells.empty())
+  {
+    // Entities in the grid are no bigger than a cell, so their centers
+    // are at most a cell further than the radius
+    const double reach = _radius + data.cellSize;
+    const ignition::math::Vector3d offset(reach, reach, reach);
+    Cell lo = data.CellOf(_point - offset);
+    Cell hi = data.CellOf(_point + offset);
+    double cellsInRange = 1;
+    for (int i = 0; i < 3; ++i)
+    {
+      lo.coords[i] = std::max(lo.coords[i], data.lower.coords[i]);
+      hi.coords[i] = std::min(hi.coords[i], data.upper.coords[i]);
+      cellsInRange *= std::max<int64_t>(0, hi.coords[i] - lo.coords[i] + 1);
+    }
+
+    if (cellsInRange > data.cells.size())
+    {
+      // Cheaper to look at every cell that isn't empty
+      for (auto const &cell : data.cells)
+      {
+        bool inRange = true;
+        for (int i = 0; i < 3; ++i)
+        {
+          inRange = inRange && cell.first.coords[i] >= lo.coords[i] &&
+            cell.first.coords[i] <= hi.coords[i];
+        }
+        if (inRange)
+        {
+          for (EntityId id : cell.second)
+            test(id);
+        }
+      }
+    }
+    else
+    {
+      Cell cell;
+      for (cell.coords[0] = lo.coords[0]; cell.coords[0] <= hi.coords[0];
+          ++cell.coords[0])
+      {
+        for (cell.coords[1] = lo.coords[1]; cell.coords[1] <= hi.coords[1];
+            ++cell.coords[1])
+        {
+          for (cell.coords[2] = lo.coords[2];
+              cell.coords[2] <= hi.coords[2]; ++cell.coords[2])
+          {
+            data.ForEachIn(cell, test);
+          }
+        }
+      }
+    }
+  }
+
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+/////////////////////////////////////////////////
+std::vector<EntityId> SpatialIndex::Nearest(
+    const ignition::math::Vector3d &_point, std::size_t _count) const
+{
+  const SpatialIndexPrivate &data = *this->dataPtr;
+  std::vector<EntityId> result;
+  if (_count == 0)
+    return result;
+
+  // Distance to the bounds and id, the furthest of the best on top
+  typedef std::pair<double, EntityId> Candidate;
+  std::priority_queue<Candidate> best;
+  auto consider = [&](EntityId _id)
+  {
+    const Bounds &bounds = data.bounds.find(_id)->second;
+    const Candidate candidate(std::max(0.0,
+          (bounds.center - _point).Length() - bounds.radius), _id);
+    if (best.size() < _count)
+    {
+      best.push(candidate);
+    }
+    else if (candidate < best.top())
+    {
+      best.pop();
+      best.push(candidate);
+    }
+  };
+
+  for (EntityId id : data.large)
+    consider(id);
+
+  if (!data.cells.empty())
+  {
+    // Search rings of cells around the point, outwards until the rest of
+    // the cells can't hold anything closer
+    const Cell center = data.CellOf(_point);
+    int64_t lastRing = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+      lastRing = std::max(lastRing, std::max(
+            center.coords[i] - data.lower.coords[i],
+            data.upper.coords[i] - center.coords[i]));
+    }
+
+    double visited = 0;
+    for (int64_t ring = 0; ring <= lastRing; ++ring)
+    {
+      // The point is somewhere in the center cell and entities are no
+      // bigger than a cell
+      const double closest = (ring - 2) * data.cellSize;
+      if (best.size() == _count && best.top().first < closest)
+        break;
+
+      const double side = 2.0 * ring + 1.0;
+      const double ringCells = ring == 0 ? 1.0 :
+        side * side * side - (side - 2.0) * (side - 2.0) * (side - 2.0);
+      if (visited + ringCells > data.cells.size())
+      {
+        // Cheaper to look at every cell that hasn't been searched
+        for (auto const &cell : data.cells)
+        {
+          int64_t distance = 0;
+          for (int i = 0; i < 3; ++i)
+          {
+            distance = std::max(distance,
+                std::abs(cell.first.coords[i] - center.coords[i]));
+          }
+          if (distance >= ring)
+          {
+            for (EntityId id : cell.second)
+              consider(id);
+          }
+        }
+        break;
+      }
+      visited += ringCells;
+
+      Cell cell;
+      for (int64_t dx = -ring; dx <= ring; ++dx)
+      {
+        for (int64_t dy = -ring; dy <= ring; ++dy)
+        {
+          // Only the faces of the ring unless x or y is on the edge
+          const bool edge = std::abs(dx) == ring || std::abs(dy) == ring;
+          const int64_t dzStep = edge || ring == 0 ? 1 : 2 * ring;
+          for (int64_t dz = -ring; dz <= ring; dz += dzStep)
+          {
+            cell.coords[0] = center.coords[0] + dx;
+            cell.coords[1] = center.coords[1] + dy;
+            cell.coords[2] = center.coords[2] + dz;
+            data.ForEachIn(cell, consider);
+          }
+        }
+      }
+    }
+  }
+
+  result.resize(best.size());
+  for (std::size_t i = result.size(); i > 0; --i)
+  {
+    result[i - 1] = best.top().second;
+    best.pop();
+  }
+  return result;
+}
+
+/////////////////////////////////////////////////
+std::vector<RayHit> SpatialIndex::Raycast(
+    const ignition::math::Vector3d &_origin,
+    const ignition::math::Vector3d &_direction, double _maxDistance) const
+{
+  const SpatialIndexPrivate &data = *this->dataPtr;
+  std::vector<RayHit> hits;
+  const double length = _direction.Length();
+  if (length <= 0 || _maxDistance < 0)
+    return hits;
+  const ignition::math::Vector3d direction = _direction * (1.0 / length);
+
+  auto test = [&](EntityId _id)
+  {
+    RayHit hit;
+    hit.id = _id;
+    if (RaySphere(_origin, direction, data.bounds.find(_id)->second,
+          hit.distance) && hit.distance <= _maxDistance)
+    {
+      hits.push_back(hit);
+    }
+  };
+
+  for (EntityId id : data.large)
+    test(id);
+
+  if (!data.cells.empty())
+  {
+    const double origin[3] = {_origin.X(), _origin.Y(), _origin.Z()};
+    const double dir[3] = {direction.X(), direction.Y(), direction.Z()};
+
+    // Clip the ray to the box of cells that could hold entities it hits,
+    // one cell around those that held entities
+    double tStart = 0;
+    double tEnd = _maxDistance;
+    for (int i = 0; i < 3; ++i)
+    {
+      const double lo = (data.lower.coords[i] - 1) * data.cellSize;
+      const double hi = (data.upper.coords[i] + 2) * data.cellSize;
+      if (dir[i] == 0)
+      {
+        if (origin[i] < lo || origin[i] > hi)
+          tEnd = -1;
+        continue;
+      }
+      double t0 = (lo - origin[i]) / dir[i];
+      double t1 = (hi - origin[i]) / dir[i];
+      if (t0 > t1)
+        std::swap(t0, t1);
+      tStart = std::max(tStart, t0);
+      tEnd = std::min(tEnd, t1);
+    }
+
+    if (tStart <= tEnd)
+    {
+      // Walk the cells along the ray. Entities stick out of their cell by
+      // at most a cell, so the neighbours of each cell are searched too.
+      const Cell first = data.CellOf(_origin + direction * tStart);
+      int64_t current[3];
+      int64_t step[3];
+      double tNext[3];
+      double tDelta[3];
+      for (int i = 0; i < 3; ++i)
+      {
+        current[i] = std::max(data.lower.coords[i] - 1,
+            std::min(data.upper.coords[i] + 1, first.coords[i]));
+        const double start = origin[i] + dir[i] * tStart;
+        if (dir[i] > 0)
+        {
+          step[i] = 1;
+          tNext[i] = tStart +
+            ((current[i] + 1) * data.cellSize - start) / dir[i];
+          tDelta[i] = data.cellSize / dir[i];
+        }
+        else if (dir[i] < 0)
+        {
+          step[i] = -1;
+          tNext[i] = tStart + (current[i] * data.cellSize - start) / dir[i];
+          tDelta[i] = -data.cellSize / dir[i];
+        }
+        else
+        {
+          step[i] = 0;
+          tNext[i] = std::numeric_limits<double>::infinity();
+          tDelta[i] = 0;
+        }
+      }
+
+      std::unordered_set<Cell, CellHash> searched;
+      while (true)
+      {
+        Cell cell;
+        for (int64_t dx = -1; dx <= 1; ++dx)
+        {
+          for (int64_t dy = -1; dy <= 1; ++dy)
+          {
+            for (int64_t dz = -1; dz <= 1; ++dz)
+            {
+              cell.coords[0] = current[0] + dx;
+              cell.coords[1] = current[1] + dy;
+              cell.coords[2] = current[2] + dz;
+              if (searched.insert(cell).second)
+                data.ForEachIn(cell, test);
+            }
+          }
+        }
+
+        int axis = 0;
+        if (tNext[1] < tNext[axis])
+          axis = 1;
+        if (tNext[2] < tNext[axis])
+          axis = 2;
+        if (tNext[axis] > tEnd)
+          break;
+        current[axis] += step[axis];
+        tNext[axis] += tDelta[axis];
+      }
+    }
+  }
+
+  std::sort(hits.begin(), hits.end(),
+      [](const RayHit &_a, const RayHit &_b)
+      {
+        return _a.distance < _b.distance ||
+          (_a.distance == _b.distance && _a.id < _b.id);
+      });
+  return hits;
+}
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2017 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "gazebo/ecs/TaskScheduler.hh"
+
+using namespace gazebo;
+using namespace ecs;
+
+/////////////////////////////////////////////////
+/// \brief A function and the group it belongs to
+struct Task
+{
+  /// \brief function to call
+  public: std::function<void()> fn;
+
+  /// \brief group to tell when the function returns
+  public: TaskGroup *group;
+};
+
+/////////////////////////////////////////////////
+/// \brief Tasks waiting to run
+struct TaskQueue
+{
+  /// \brief Protects tasks
+  /// \remarks held only to push or take one task
+  public: std::mutex mtx;
+
+  /// \brief The owner uses the back, thieves the front
+  public: std::deque<Task> tasks;
+};
+
+/// \brief The queue a thread pushes to
+struct CurrentQueue
+{
+  /// \brief Scheduler the thread is a worker of
+  TaskSchedulerPrivate *owner = nullptr;
+
+  /// \brief Index of the worker's queue
+  std::size_t index = 0;
+};
+
+/// \brief Set on worker threads
+static thread_local CurrentQueue tlCurrentQueue;
+
+/////////////////////////////////////////////////
+class gazebo::ecs::TaskSchedulerPrivate
+{
+  /// \brief Queue 0 is shared by threads that aren't workers, worker i
+  ///   owns queue i + 1
+  public: std::vector<std::unique_ptr<TaskQueue> > queues;
+
+  /// \brief Worker threads
+  public: std::vector<std::thread> workers;
+
+  /// \brief True if workers were pinned to CPUs
+  public: bool pinned = false;
+
+  /// \brief Number of tasks in all queues
+  public: std::atomic<std::size_t> queued{0};
+
+  /// \brief Number of workers sleeping or about to
+  public: std::atomic<std::size_t> sleeping{0};
+
+  /// \brief Set to stop the workers
+  public: bool stop = false;
+
+  /// \brief Protects stop, and sleeping workers wait on it
+  public: std::mutex sleepMtx;
+
+  /// \brief Wakes sleeping workers
+  public: std::condition_variable sleepCv;
+
+  /// \brief Get the queue the calling thread pushes to and takes from
+  public: std::size_t OwnQueue() const
+          {
+            return tlCurrentQueue.owner == this ? tlCurrentQueue.index : 0;
+          }
+
+  /// \brief Take a task from the back of the thread's own queue, or steal
+  ///   one from the front of another
+  /// \param[out] _task the task
+  /// \return false if every queue was empty
+  public: bool Take(Task &_task)
+          {
+            if (this->queued.load() == 0)
+              return false;
+
+            const std::size_t own = this->OwnQueue();
+            for (std::size_t i = 0; i < this->queues.size(); ++i)
+            {
+              const std::size_t victim = (own + i) % this->queues.size();
+              TaskQueue &queue = *this->queues[victim];
+              std::lock_guard<std::mutex> lock(queue.mtx);
+              if (queue.tasks.empty())
+                continue;
+              if (i == 0)
+              {
+                _task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+              }
+              else
+              {
+                _task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+              }
+              --this->queued;
+              return true;
+            }
+            return false;
+          }
+
+  /// \brief Run a task and tell its group
+  public: static void Run(Task &_task)
+          {
+            _task.fn();
+            // Captures are released before waiters carry on
+            _task.fn = nullptr;
+            _task.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+          }
+
+  /// \brief Run tasks until stopped
+  /// \param[in] _index index of the worker
+  public: void Work(std::size_t _index)
+          {
+            tlCurrentQueue.owner = this;
+            tlCurrentQueue.index = _index + 1;
+            Task task;
+            while (true)
+            {
+              if (this->Take(task))
+              {
+                Run(task);
+                continue;
+              }
+
+              std::unique_lock<std::mutex> lock(this->sleepMtx);
+              ++this->sleeping;
+              // Spawn() counts a task before checking for sleepers, so
+              // either it's seen here or this worker is notified
+              this->sleepCv.wait(lock, [this]
+                  {
+                    return this->stop || this->queued.load() > 0;
+                  });
+              --this->sleeping;
+              if (this->stop)
+                return;
+            }
+          }
+
+  /// \brief Pin a worker to a CPU
+  /// \param[in] _thread the worker
+  /// \param[in] _cpu the CPU
+  /// \return true if it worked
+  public: static bool Pin(std::thread &_thread, int _cpu)
+          {
+#ifdef __linux__
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(_cpu, &set);
+            return pthread_setaffinity_np(_thread.native_handle(),
+                sizeof(cpu_set_t), &set) == 0;
+#else
+            return false;
+#endif
+          }
+};
+
+/////////////////////////////////////////////////
+TaskScheduler::TaskScheduler(unsigned int _threads,
+    const std::vector<int> &_cpus)
+: dataPtr(new TaskSchedulerPrivate)
+{
+  for (unsigned int i = 0; i <= _threads; ++i)
+    this->dataPtr->queues.emplace_back(new TaskQueue);
+
+  this->dataPtr->pinned = !_cpus.empty() && _threads > 0;
+  for (unsigned int i = 0; i < _threads; ++i)
+  {
+    this->dataPtr->workers.emplace_back(&TaskSchedulerPrivate::Work,
+        this->dataPtr.get(), i);
+    if (!_cpus.empty())
+    {
+      this->dataPtr->pinned = TaskSchedulerPrivate::Pin(
+          this->dataPtr->workers.back(), _cpus[i % _cpus.size()]) &&
+        this->dataPtr->pinned;
+    }
+  }
+}
+
+/////////////////////////////////////////////////
+TaskScheduler::~TaskScheduler()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->dataPtr->sleepMtx);
+    this->dataPtr->stop = true;
+  }
+  this->dataPtr->sleepCv.notify_all();
+  for (auto &worker : this->dataPtr->workers)
+    worker.join();
+}
+
+/////////////////////////////////////////////////
+unsigned int TaskScheduler::DefaultThreadCount()
+{
+  return std::max(std::thread::hardware_concurrency(), 2u) - 1;
+}
+
+/////////////////////////////////////////////////
+unsigned int TaskScheduler::ThreadCount() const
+{
+  return this->dataPtr->workers.size();
+}
+
+/////////////////////////////////////////////////
+bool TaskScheduler::Pinned() const
+{
+  return this->dataPtr->pinned;
+}
+
+/////////////////////////////////////////////////
+void TaskScheduler::Spawn(TaskGroup &_group, std::function<void()> _task)
+{
+  _group.pending.fetch_add(1, std::memory_order_relaxed);
+
+  Task task;
+  task.fn = std::move(_task);
+  task.group = &_group;
+  TaskQueue &queue = *this->dataPtr->queues[this->dataPtr->OwnQueue()];
+  {
+    // Counted under the lock so Take() never counts it first
+    std::lock_guard<std::mutex> lock(queue.mtx);
+    queue.tasks.push_back(std::move(task));
+    ++this->dataPtr->queued;
+  }
+
+  if (this->dataPtr->sleeping.load() > 0)
+  {
+    // Locking makes sure the worker is waiting, not about to
+    {
+      std::lock_guard<std::mutex> lock(this->dataPtr->sleepMtx);
+    }
+    this->dataPtr->sleepCv.notify_one();
+  }
+}
+
+/////////////////////////////////////////////////
+void TaskScheduler::Wait(TaskGroup &_group)
+{
+  Task task;
+  while (!_group.Done())
+  {
+    if (this->dataPtr->Take(task))
+      TaskSchedulerPrivate::Run(task);
+    else
+      std::this_thread::yield();
+  }
+}
@@ -15,12 +15,17 @@
  *
 */
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <csignal>
 #include <functional>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include <gflags/gflags.h>
 
@@ -47,6 +52,18 @@ DEFINE_int32(verbose, 1, "");
 DEFINE_int32(v, 1, "");
 DEFINE_string(file, "", "");
 DEFINE_string(f, "empty.world", "");
+DEFINE_int32(threads, -1, "");
+DEFINE_bool(headless, false, "");
+DEFINE_double(rtf, 1.0, "");
+DEFINE_uint64(iterations, 0, "");
+DEFINE_bool(pipelined, false, "");
+
+/// \brief Updates run back to back between checks for a stop request
+///   when running as fast as possible
+static const uint64_t STEP_BATCH = 100;
+
+/// \brief Set by the signal handler when running headless
+static std::atomic<bool> headlessStop(false);
 
 //////////////////////////////////////////////////
 void Help()
@@ -63,6 +80,24 @@ void Help()
   << "  -v [--verbose] arg            Adjust the level of console output (0~4)."
   << std::endl
   << "  -f [ --file ] FILE            SDF file to load on start." << std::endl
+  << "  --headless                    Run without a GUI until interrupted or"
+  << std::endl
+  << "                                --iterations are done." << std::endl
+  << "  --rtf arg                     Real time factor to run at, 0 to run as"
+  << std::endl
+  << "                                fast as possible without a GUI"
+  << std::endl
+  << "                                (default: 1)." << std::endl
+  << "  --iterations arg              Number of updates to run, 0 for no limit"
+  << std::endl
+  << "                                (default: 0)." << std::endl
+  << "  --pipelined                   Commit modified components while"
+  << std::endl
+  << "                                systems run." << std::endl
+  << "  --threads arg                 Number of worker threads (default: one"
+  << std::endl
+  << "                                less than the number of cores)."
+  << std::endl
   << std::endl;
 }
 
@@ -85,6 +120,18 @@ static bool VerbosityValidator(const char */*_flagname*/, int _value)
   return _value >= 0 && _value <= 4;
 }
 
+//////////////////////////////////////////////////
+static bool RtfValidator(const char */*_flagname*/, double _value)
+{
+  return _value >= 0;
+}
+
+//////////////////////////////////////////////////
+void OnSignal(int /*_signal*/)
+{
+  headlessStop = true;
+}
+
 //////////////////////////////////////////////////
 bool LoadSystems(gzecs::Manager &_mgr, const std::vector<std::string> &_libs)
 {
@@ -194,11 +241,33 @@ bool LoadWorld(gzecs::Manager &_mgr, const std::string &_file)
 //////////////////////////////////////////////////
 void RunECS(gzecs::Manager &_mgr, std::atomic<bool> &stop)
 {
-  const double realTimeFactor = 1.0;
-  while (!stop)
+  const double realTimeFactor = FLAGS_rtf;
+  const uint64_t iterations = FLAGS_iterations;
+  uint64_t steps = 0;
+  auto start = std::chrono::steady_clock::now();
+  while (!stop && (iterations == 0 || steps < iterations))
   {
-    _mgr.UpdateOnce(realTimeFactor);
+    if (realTimeFactor > 0)
+    {
+      _mgr.UpdateOnce(realTimeFactor);
+      ++steps;
+    }
+    else
+    {
+      // Only check for a stop request every batch of updates
+      uint64_t batch = STEP_BATCH;
+      if (iterations > 0)
+        batch = std::min(batch, iterations - steps);
+      _mgr.Step(batch);
+      steps += batch;
+    }
   }
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  ignmsg << "Ran " << steps << " updates in " << elapsed.count()
+    << " seconds (" << steps / std::max(elapsed.count(), 1e-9)
+    << " updates/sec)" << std::endl;
 }
 
 //////////////////////////////////////////////////
@@ -227,6 +296,7 @@ int main(int _argc, char **_argv)
   // Register validators
   gflags::RegisterFlagValidator(&FLAGS_verbose, &VerbosityValidator);
   gflags::RegisterFlagValidator(&FLAGS_v, &VerbosityValidator);
+  gflags::RegisterFlagValidator(&FLAGS_rtf, &RtfValidator);
 
   // Parse command line
   gflags::ParseCommandLineNonHelpFlags(&_argc, &_argv, true);
@@ -294,7 +364,12 @@ int main(int _argc, char **_argv)
 
     SDFormatModelPathSetup();
 
-    gzecs::Manager manager;
+    gzecs::Manager manager(FLAGS_threads < 0 ?
+        gzecs::TaskScheduler::DefaultThreadCount() : FLAGS_threads);
+    manager.Pipelined(FLAGS_pipelined);
+
+    // Running as fast as possible leaves nothing for a GUI to keep up with
+    const bool headless = FLAGS_headless || FLAGS_rtf <= 0;
 
     if (!LoadComponentizers(manager, {
           "gazeboCZName",
@@ -310,11 +385,11 @@ int main(int _argc, char **_argv)
       return 2;
     }
 
-    // Load ECS systems
-    if (!LoadSystems(manager, {
-        "gazeboPhysicsSystem",
-        "gazeboRenderSystem",
-        }))
+    // Load ECS systems, rendering only feeds the GUI
+    std::vector<std::string> systems = {"gazeboPhysicsSystem"};
+    if (!headless)
+      systems.push_back("gazeboRenderSystem");
+    if (!LoadSystems(manager, systems))
     {
       return 1;
     }
@@ -325,6 +400,16 @@ int main(int _argc, char **_argv)
       return 4;
     }
 
+    if (headless)
+    {
+      // Run the ECS on this thread until interrupted
+      std::signal(SIGINT, OnSignal);
+      std::signal(SIGTERM, OnSignal);
+      RunECS(manager, headlessStop);
+      igndbg << "Shutting down" << std::endl;
+      return 0;
+    }
+
     // Initialize app
     ignition::gui::initApp();
 
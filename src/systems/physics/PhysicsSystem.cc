@@ -59,6 +59,12 @@ void PhysicsSystem::Init(ecs::QueryRegistrar &_registrar)
   // use of the Mass and WorldVelocity components if present, but these are
   // optional
 
+  _registrar.Reads<components::PhysicsConfig>();
+  _registrar.Reads<components::Geometry>();
+  _registrar.Reads<components::Inertial>();
+  _registrar.Writes<components::Pose>();
+  _registrar.Writes<components::WorldVelocity>();
+
   _registrar.Register(query,
       std::bind(&PhysicsSystem::UpdateBodies, this, std::placeholders::_1));
 }
@@ -89,21 +95,28 @@ void PhysicsSystem::UpdateBodies(const ecs::EntityQuery &_result)
   // STEP 1 Loop through entities and update internal representation
   // This is where the effects of other systems get propagated to this one,
   // for example, if a pose is changed or a body is deleted through the GUI.
-  for (auto const &entityId : _result.EntityIds())
+  auto const &entityIds = _result.EntityIds();
+  auto const geometries = _result.Components<components::Geometry>();
+  auto const poses = _result.Components<components::Pose>();
+  for (std::size_t i = 0; i < entityIds.size(); ++i)
   {
-    // Get entity (should check if exists?)
-    auto &entity = mgr.Entity(entityId);
+    // A required component is null if it was removed last time step
+    auto doDelete = !geometries[i] || !poses[i];
+    if (doDelete)
+    {
+      // TODO Remove a body from the physics engine world
+      continue;
+    }
 
     // Check for changes since last time step
+    auto &entity = mgr.Entity(entityIds[i]);
     auto diffGeometry = entity.IsDifferent<components::Geometry>();
-    auto diffPose = entity.IsDifferent<components::Geometry>();
+    auto diffPose = entity.IsDifferent<components::Pose>();
 
-    auto doDelete = (diffGeometry == ecs::WAS_DELETED)
-      || (diffPose == ecs::WAS_DELETED);
-    auto doCreate = (!doDelete) && (diffGeometry == ecs::WAS_CREATED
-        || diffPose == ecs::WAS_CREATED);
-    auto doModify = (!doDelete) && (!doCreate) && (
-        diffGeometry == ecs::WAS_CREATED || diffPose == ecs::WAS_CREATED);
+    auto doCreate = diffGeometry == ecs::WAS_CREATED
+      || diffPose == ecs::WAS_CREATED;
+    auto doModify = (!doCreate) && (diffGeometry == ecs::WAS_MODIFIED
+        || diffPose == ecs::WAS_MODIFIED);
 
     // Another system created a new geometry we don't know about yet, so
     // create it internally
@@ -111,10 +124,6 @@ void PhysicsSystem::UpdateBodies(const ecs::EntityQuery &_result)
     {
       // TODO Add a new body to the physics engine world
     }
-    else if (doDelete)
-    {
-      // TODO Remove a body from the physics engine world
-    }
     else if (doModify)
     {
       // TODO Update body in physics engine world
@@ -53,6 +53,10 @@ void RenderSystem::Init(ecs::QueryRegistrar &_registrar)
 
   _registrar.Register(query, std::bind(&RenderSystem::Update, this,
         std::placeholders::_1));
+  // Only the camera and the render engine are touched, so other systems
+  // don't have to wait for this one
+  _registrar.DeclareNone();
+  _registrar.UpdateRate(1000.0);
 
   std::string topic = "/rendering/image";
   this->pub =
@@ -75,11 +79,11 @@ void RenderSystem::Update(const ecs::EntityQuery &_result)
   // the render engine should only be responsible for updating the scene tree.
   // we shouldn't be throttling the update rate based on sim time
   // because objects can move when simulation is paused!
-  // This is just for demo only
+  // This is just for demo only. The manager only calls this at the rate
+  // declared in Init(), so it only has to skip updates while paused.
   auto &mgr = this->Manager();
   auto const &currentSimTime = mgr.SimulationTime();
-  double updateRate = 1000.0;
-  if ((currentSimTime - this->prevUpdateTime).Double() < 1.0/updateRate)
+  if (currentSimTime == this->prevUpdateTime)
     return;
   this->prevUpdateTime = currentSimTime;
   // for demo only
@@ -58,7 +58,7 @@ namespace gazebo
       /// \brief Publisher to the image toipc
       public: ignition::transport::Node::Publisher pub;
 
-      /// \brief previous update sim time
+      /// \brief sim time of the previous update that moved the camera
       public: ignition::common::Time prevUpdateTime;
 
       /// \brief previous render time
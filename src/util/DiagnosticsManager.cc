@@ -16,6 +16,7 @@
 */
 
 #include <map>
+#include <string>
 
 #include <ignition/msgs.hh>
 #include <ignition/transport.hh>
@@ -42,6 +43,9 @@ class gzutil::DiagnosticsManagerPrivate
   /// \brief true if initialized
   public: bool initialized = false;
 
+  /// \brief false while turned off
+  public: bool enabled = true;
+
   /// \brief name belonging to these diagnostics
   public: std::string name;
 };
@@ -74,7 +78,7 @@ bool DiagnosticsManager::Init(const std::string &_name)
 //////////////////////////////////////////////////
 void DiagnosticsManager::UpdateBegin(ignition::common::Time _simTime)
 {
-  if (this->dataPtr->initialized)
+  if (this->Enabled())
   {
     this->dataPtr->msg.mutable_sim_time()->set_sec(_simTime.sec);
     this->dataPtr->msg.mutable_sim_time()->set_nsec(_simTime.nsec);
@@ -84,10 +88,11 @@ void DiagnosticsManager::UpdateBegin(ignition::common::Time _simTime)
 //////////////////////////////////////////////////
 void DiagnosticsManager::UpdateEnd()
 {
-  if (this->dataPtr->initialized)
+  if (this->Enabled())
   {
     this->dataPtr->pub.Publish(this->dataPtr->msg);
     this->dataPtr->msg.clear_time();
+    this->dataPtr->msg.clear_header();
     this->dataPtr->timers.clear();
   }
 }
@@ -95,7 +100,7 @@ void DiagnosticsManager::UpdateEnd()
 //////////////////////////////////////////////////
 void DiagnosticsManager::StartTimer(const std::string &_name)
 {
-  if (this->dataPtr->initialized)
+  if (this->Enabled())
   {
     ignition::common::Timer timer;
     timer.Start();
@@ -106,7 +111,7 @@ void DiagnosticsManager::StartTimer(const std::string &_name)
 //////////////////////////////////////////////////
 void DiagnosticsManager::StopTimer(const std::string &_name)
 {
-  if (this->dataPtr->initialized)
+  if (this->Enabled())
   {
     auto kvIter = this->dataPtr->timers.find(_name);
     if (kvIter != this->dataPtr->timers.end())
@@ -127,3 +132,26 @@ void DiagnosticsManager::StopTimer(const std::string &_name)
     }
   }
 }
+
+//////////////////////////////////////////////////
+void DiagnosticsManager::AddValue(const std::string &_name, double _value)
+{
+  if (this->Enabled())
+  {
+    auto data = this->dataPtr->msg.mutable_header()->add_data();
+    data->set_key(this->dataPtr->name + ":" + _name);
+    data->add_value(std::to_string(_value));
+  }
+}
+
+//////////////////////////////////////////////////
+void DiagnosticsManager::Enabled(bool _enabled)
+{
+  this->dataPtr->enabled = _enabled;
+}
+
+//////////////////////////////////////////////////
+bool DiagnosticsManager::Enabled() const
+{
+  return this->dataPtr->initialized && this->dataPtr->enabled;
+}
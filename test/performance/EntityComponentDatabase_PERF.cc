@@ -0,0 +1,541 @@
+/*
+ * Copyright (C) 2017 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "gazebo/ecs/ComponentFactory.hh"
+#include "gazebo/ecs/EntityComponentDatabase.hh"
+#include "gazebo/ecs/EntityQuery.hh"
+
+namespace gzecs = gazebo::ecs;
+
+// Component Types for testing
+struct TC1
+{
+  float itemOne;
+};
+
+struct TC2
+{
+  float itemOne;
+  int itemTwo;
+};
+
+struct TC3
+{
+  double itemOne[3];
+};
+
+/// \brief Many distinct component types for building many queries
+template <int N>
+struct Tag
+{
+  int value;
+};
+
+/// \brief Number of Tag types registered
+const int numTags = 32;
+
+/// \brief Register Tag<0> through Tag<N - 1>
+template <int N>
+struct RegisterTags
+{
+  static void Do()
+  {
+    RegisterTags<N - 1>::Do();
+    gzecs::ComponentFactory::Register<Tag<N - 1> >(
+        "Tag" + std::to_string(N - 1));
+  }
+};
+
+/// \brief End of the recursion
+template <>
+struct RegisterTags<0>
+{
+  static void Do()
+  {
+  }
+};
+
+/////////////////////////////////////////////////
+/// \brief Measures wall time of a block of code
+class Stopwatch
+{
+  /// \brief Constructor, starts timing
+  public: Stopwatch()
+          : start(std::chrono::steady_clock::now())
+          {
+          }
+
+  /// \brief Seconds elapsed since construction
+  public: double Elapsed() const
+          {
+            return std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - this->start).count();
+          }
+
+  /// \brief When timing started
+  private: std::chrono::steady_clock::time_point start;
+};
+
+/////////////////////////////////////////////////
+/// \brief Create a world of entities with components on them
+/// \param[in] _db database to populate
+/// \param[in] _count number of entities
+/// \returns ids of created entities
+std::vector<gzecs::EntityId> MakeWorld(gzecs::EntityComponentDatabase &_db,
+    int _count)
+{
+  std::vector<gzecs::EntityId> entities;
+  entities.reserve(_count);
+  for (int i = 0; i < _count; ++i)
+  {
+    gzecs::EntityId id = _db.CreateEntity();
+    entities.push_back(id);
+    _db.AddComponent<TC1>(id)->itemOne = i;
+    if (i % 2)
+      _db.AddComponent<TC2>(id)->itemTwo = i;
+    if (i % 3)
+      _db.AddComponent<TC3>(id)->itemOne[0] = i;
+  }
+  _db.Update();
+  return entities;
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, DeleteTenPercentOfLargeWorld)
+{
+  const int worldSize = 100000;
+  gzecs::EntityComponentDatabase db;
+
+  gzecs::EntityQuery query;
+  query.AddComponent("TC1");
+  query.AddComponent("TC3");
+  auto queryId = db.AddQuery(query).first;
+
+  std::vector<gzecs::EntityId> entities = MakeWorld(db, worldSize);
+  const std::size_t matchesBefore = db.Query(queryId).EntityIds().size();
+
+  // Despawn every tenth entity in one step
+  Stopwatch timer;
+  int deleted = 0;
+  int deletedMatches = 0;
+  for (int i = 0; i < worldSize; i += 10)
+  {
+    EXPECT_TRUE(db.DeleteEntity(entities[i]));
+    ++deleted;
+    if (i % 3)
+      ++deletedMatches;
+  }
+  const double stageTime = timer.Elapsed();
+
+  // Components are destroyed on this update
+  Stopwatch updateTimer;
+  db.Update();
+  const double removeTime = updateTimer.Elapsed();
+
+  // Queries drop the entities on this update
+  Stopwatch queryTimer;
+  db.Update();
+  const double queryTime = queryTimer.Elapsed();
+
+  std::cout << "Deleted " << deleted << " of " << worldSize << " entities:"
+            << " stage " << stageTime << "s,"
+            << " remove " << removeTime << "s,"
+            << " update queries " << queryTime << "s" << std::endl;
+
+  EXPECT_EQ(matchesBefore - deletedMatches,
+      db.Query(queryId).EntityIds().size());
+  for (int i = 0; i < worldSize; ++i)
+  {
+    if (i % 10 == 0)
+      EXPECT_EQ(nullptr, db.EntityComponent<TC1>(entities[i]));
+    else
+      ASSERT_NE(nullptr, db.EntityComponent<TC1>(entities[i]));
+  }
+
+  // Retiring the batch must scale with the batch, not the world. Erasing
+  // from the middle of storage and renumbering the rest takes minutes here.
+  EXPECT_LT(stageTime + removeTime + queryTime, 1.0);
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, SpawnInBatch)
+{
+  const int worldSize = 50000;
+  gzecs::EntityQuery query;
+  query.AddComponent("TC1");
+  query.AddComponent("TC2");
+
+  // One entity and component at a time
+  gzecs::EntityComponentDatabase single;
+  auto singleQuery = single.AddQuery(query).first;
+  Stopwatch singleTimer;
+  for (int i = 0; i < worldSize; ++i)
+  {
+    gzecs::EntityId id = single.CreateEntity();
+    single.AddComponent<TC1>(id)->itemOne = i;
+    single.AddComponent<TC2>(id)->itemTwo = i;
+    single.AddComponent<TC3>(id)->itemOne[0] = i;
+  }
+  single.Update();
+  const double singleTime = singleTimer.Elapsed();
+
+  // All at once
+  gzecs::EntityComponentDatabase batched;
+  auto batchQuery = batched.AddQuery(query).first;
+  Stopwatch batchTimer;
+  auto batch = batched.CreateEntities<TC1, TC2, TC3>(worldSize);
+  TC1 *tc1 = batch.Components<TC1>();
+  TC2 *tc2 = batch.Components<TC2>();
+  TC3 *tc3 = batch.Components<TC3>();
+  for (int i = 0; i < worldSize; ++i)
+  {
+    tc1[i].itemOne = i;
+    tc2[i].itemTwo = i;
+    tc3[i].itemOne[0] = i;
+  }
+  batched.Update();
+  const double batchTime = batchTimer.Elapsed();
+
+  std::cout << "Spawned " << worldSize << " entities: one at a time "
+            << singleTime << "s, in a batch " << batchTime << "s"
+            << std::endl;
+
+  ASSERT_EQ(static_cast<std::size_t>(worldSize), batch.Size());
+  EXPECT_EQ(single.Query(singleQuery).EntityIds().size(),
+      batched.Query(batchQuery).EntityIds().size());
+  EXPECT_LT(batchTime, singleTime);
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, ModifyEveryComponentEveryStep)
+{
+  const int worldSize = 100000;
+  const int steps = 10;
+  gzecs::EntityComponentDatabase db;
+  std::vector<gzecs::EntityId> entities = MakeWorld(db, worldSize);
+
+  // Like a physics system writing every pose every step
+  Stopwatch timer;
+  for (int step = 0; step < steps; ++step)
+  {
+    for (gzecs::EntityId id : entities)
+      db.EntityComponentMutable<TC1>(id)->itemOne += 1;
+    db.Update();
+  }
+  const double elapsed = timer.Elapsed();
+
+  std::cout << "Modified " << worldSize << " components " << steps
+            << " times: " << elapsed / steps << "s per step" << std::endl;
+
+  for (int i = 0; i < worldSize; ++i)
+    ASSERT_FLOAT_EQ(i + steps, db.EntityComponent<TC1>(entities[i])->itemOne);
+  EXPECT_LT(elapsed, 5.0);
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, FindChangesAmongManyComponents)
+{
+  const int worldSize = 100000;
+  const int steps = 10;
+  gzecs::EntityComponentDatabase db;
+  std::vector<gzecs::EntityId> entities = MakeWorld(db, worldSize);
+
+  // A few components change every step, like a rendering system checking
+  // three component types on every entity for something to redraw
+  Stopwatch timer;
+  int found = 0;
+  for (int step = 0; step < steps; ++step)
+  {
+    for (int i = step; i < worldSize; i += 100)
+      db.EntityComponentMutable<TC1>(entities[i])->itemOne += 1;
+    db.Update();
+    for (gzecs::EntityId id : entities)
+    {
+      if (db.IsDifferent<TC1>(id) != gzecs::NO_DIFFERENCE ||
+          db.IsDifferent<TC2>(id) != gzecs::NO_DIFFERENCE ||
+          db.IsDifferent<TC3>(id) != gzecs::NO_DIFFERENCE)
+      {
+        ++found;
+      }
+    }
+  }
+  const double checkTime = timer.Elapsed();
+
+  // Same thing visiting only what changed
+  Stopwatch listTimer;
+  std::size_t listed = 0;
+  for (int step = 0; step < steps; ++step)
+  {
+    for (int i = step; i < worldSize; i += 100)
+      db.EntityComponentMutable<TC1>(entities[i])->itemOne += 1;
+    db.Update();
+    listed += db.ChangedEntities<TC1>().size() +
+      db.ChangedEntities<TC2>().size() + db.ChangedEntities<TC3>().size();
+  }
+  const double listTime = listTimer.Elapsed();
+
+  std::cout << "Found changes among " << worldSize << " entities " << steps
+            << " times: checking all " << checkTime / steps
+            << "s per step, listing changed " << listTime / steps
+            << "s per step" << std::endl;
+
+  EXPECT_EQ(worldSize / 100 * steps, found);
+  EXPECT_EQ(static_cast<std::size_t>(found), listed);
+  EXPECT_LT(listTime, checkTime);
+}
+
+/////////////////////////////////////////////////
+/// \brief Find entities whose components changed through a query, like a
+///   rendering system syncing its scene
+/// \param[in] _reactive true to use the lists of a reactive query
+/// \param[out] _synced number of entities found
+/// \returns seconds per step, updates included
+double SyncWithQuery(bool _reactive, int &_synced)
+{
+  const int worldSize = 100000;
+  const int steps = 10;
+  gzecs::EntityComponentDatabase db;
+  gzecs::EntityQuery query;
+  query.AddComponent<TC1>();
+  query.Optional<TC2>();
+  query.Reactive(_reactive);
+  auto queryId = db.AddQuery(query).first;
+  std::vector<gzecs::EntityId> entities = MakeWorld(db, worldSize);
+  db.Update();
+
+  _synced = 0;
+  Stopwatch timer;
+  for (int step = 0; step < steps; ++step)
+  {
+    for (int i = step; i < worldSize; i += 100)
+      db.EntityComponentMutable<TC1>(entities[i])->itemOne += 1;
+    db.Update();
+    auto const &result = db.Query(queryId);
+    if (_reactive)
+    {
+      _synced += result.ModifiedEntityIds().size();
+      continue;
+    }
+    for (gzecs::EntityId id : result.EntityIds())
+    {
+      if (db.IsDifferent<TC1>(id) != gzecs::NO_DIFFERENCE ||
+          db.IsDifferent<TC2>(id) != gzecs::NO_DIFFERENCE)
+      {
+        ++_synced;
+      }
+    }
+  }
+  return timer.Elapsed() / steps;
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, SyncMostlyStaticWorld)
+{
+  int checked = 0;
+  const double checkTime = SyncWithQuery(false, checked);
+  int listed = 0;
+  const double listTime = SyncWithQuery(true, listed);
+
+  std::cout << "Synced a world where 1% changes every step: checking all "
+            << checkTime << "s per step, reactive query " << listTime
+            << "s per step" << std::endl;
+
+  EXPECT_EQ(10000, checked);
+  EXPECT_EQ(checked, listed);
+  EXPECT_LT(listTime, checkTime);
+}
+
+/////////////////////////////////////////////////
+/// \brief Read every TC1 in the world from several threads at once
+/// \param[in] _db database to read
+/// \param[in] _entities entities in the world
+/// \param[in] _numThreads number of reader threads
+/// \param[in] _passes times each thread reads the whole world
+/// \returns seconds taken
+double ReadConcurrently(const gzecs::EntityComponentDatabase &_db,
+    const std::vector<gzecs::EntityId> &_entities, int _numThreads,
+    int _passes)
+{
+  std::vector<double> sums(_numThreads, 0.0);
+  std::vector<std::thread> threads;
+  Stopwatch timer;
+  for (int t = 0; t < _numThreads; ++t)
+  {
+    threads.push_back(std::thread([&_db, &_entities, &sums, t, _passes]()
+      {
+        double sum = 0.0;
+        for (int pass = 0; pass < _passes; ++pass)
+        {
+          for (gzecs::EntityId id : _entities)
+            sum += _db.EntityComponent<TC1>(id)->itemOne;
+        }
+        sums[t] = sum;
+      }));
+  }
+  for (auto &thread : threads)
+    thread.join();
+  const double elapsed = timer.Elapsed();
+
+  for (double sum : sums)
+    EXPECT_DOUBLE_EQ(sums[0], sum);
+  return elapsed;
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, ConcurrentReadsScale)
+{
+  const int worldSize = 100000;
+  const int passes = 10;
+  const int numThreads = 8;
+  gzecs::EntityComponentDatabase db;
+  std::vector<gzecs::EntityId> entities = MakeWorld(db, worldSize);
+
+  const double oneThread = ReadConcurrently(db, entities, 1, passes);
+  const double manyThreads = ReadConcurrently(db, entities, numThreads,
+      passes);
+  const unsigned int cores = std::thread::hardware_concurrency();
+
+  // Each thread does the same work, so perfect scaling keeps the time flat
+  // until there are more threads than cores
+  std::cout << "Read " << worldSize * passes << " components:"
+            << " 1 thread " << oneThread << "s,"
+            << " " << numThreads << " threads " << manyThreads << "s"
+            << " on " << cores << " cores" << std::endl;
+
+  // Reads don't lock, so threads can only slow each other down by sharing
+  // cores. A global lock makes this several times slower. On one core the
+  // bound is 16x, too loose to catch a lock; it needs several cores.
+  const int sharing = cores ? (numThreads + cores - 1) / cores : numThreads;
+  EXPECT_LT(manyThreads, oneThread * sharing * 2 + 0.05);
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, ManyQueriesStayCheap)
+{
+  const int worldSize = 20000;
+  const int numQueries = 500;
+  gzecs::EntityComponentDatabase db;
+
+  // Every entity gets a few of the tags
+  std::vector<gzecs::EntityId> entities;
+  for (int i = 0; i < worldSize; ++i)
+  {
+    gzecs::EntityId id = db.CreateEntity();
+    entities.push_back(id);
+    for (int t = 0; t < numTags; ++t)
+    {
+      if ((i * 7 + t * 13) % 5 == 0)
+        db.AddComponent(id, gzecs::ComponentFactory::Type(
+              "Tag" + std::to_string(t)));
+    }
+  }
+  db.Update();
+
+  // Each query wants a different pair or triple of tags
+  Stopwatch addTimer;
+  int added = 0;
+  for (int q = 0; added < numQueries; ++q)
+  {
+    gzecs::EntityQuery query;
+    query.AddComponent("Tag" + std::to_string(q % numTags));
+    query.AddComponent("Tag" + std::to_string((q / numTags) % numTags));
+    if (q >= numTags * numTags)
+      query.AddComponent("Tag" + std::to_string((q * 7) % numTags));
+    if (db.AddQuery(query).second)
+      ++added;
+  }
+  const double addTime = addTimer.Elapsed();
+
+  // Adding a component has to be checked against every query
+  Stopwatch updateTimer;
+  for (int i = 0; i < worldSize; ++i)
+    db.AddComponent<TC1>(entities[i]);
+  db.Update();
+  const double updateTime = updateTimer.Elapsed();
+
+  std::cout << numQueries << " queries on " << worldSize << " entities:"
+            << " add queries " << addTime << "s,"
+            << " add components " << updateTime << "s" << std::endl;
+
+  EXPECT_LT(addTime + updateTime, 5.0);
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, SpawnIntoLargeQuery)
+{
+  const int worldSize = 200000;
+  const int steps = 200;
+  gzecs::EntityQuery query;
+  query.AddComponent("TC1");
+  query.AddComponent("TC2");
+
+  gzecs::EntityComponentDatabase db;
+  auto queryId = db.AddQuery(query).first;
+  auto batch = db.CreateEntities<TC1, TC2>(worldSize);
+  ASSERT_EQ(static_cast<std::size_t>(worldSize), batch.Size());
+  db.Update();
+  db.Update();
+
+  // Updates with nothing to merge are the baseline
+  Stopwatch idleTimer;
+  for (int s = 0; s < steps; ++s)
+    db.Update();
+  const double idleTime = idleTimer.Elapsed();
+
+  // One spawn and one removal per update shouldn't cost a pass over the
+  // results
+  std::vector<gzecs::EntityId> spawned;
+  Stopwatch spawnTimer;
+  for (int s = 0; s < steps; ++s)
+  {
+    gzecs::EntityId id = db.CreateEntity();
+    db.AddComponent<TC1>(id);
+    db.AddComponent<TC2>(id);
+    spawned.push_back(id);
+    if (s > 0)
+      db.RemoveComponent<TC2>(spawned[s - 1]);
+    db.Update();
+  }
+  const double spawnTime = spawnTimer.Elapsed();
+
+  std::cout << "Updated a query of " << worldSize << " entities " << steps
+            << " times: idle " << idleTime << "s, one spawn each "
+            << spawnTime << "s" << std::endl;
+
+  // The last entity to lose a component stays for one more update
+  EXPECT_EQ(static_cast<std::size_t>(worldSize + 2),
+      db.Query(queryId).EntityIds().size());
+  EXPECT_LT(spawnTime, idleTime * 10 + 0.05);
+}
+
+int main(int argc, char **argv)
+{
+  gzecs::ComponentFactory::Register<TC1>("TC1");
+  gzecs::ComponentFactory::Register<TC2>("TC2");
+  gzecs::ComponentFactory::Register<TC3>("TC3");
+  RegisterTags<numTags>::Do();
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2017 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include "gazebo/ecs/ComponentFactory.hh"
+
+namespace gzecs = gazebo::ecs;
+
+/////////////////////////////////////////////////
+// Component Types for testing
+struct TC1
+{
+  float itemOne;
+};
+
+/////////////////////////////////////////////////
+struct TC2
+{
+  float itemOne;
+  int itemTwo;
+};
+
+/////////////////////////////////////////////////
+struct alignas(32) Aligned32
+{
+  float values[8];
+};
+
+/////////////////////////////////////////////////
+struct WithString
+{
+  std::string name = "default";
+};
+
+/////////////////////////////////////////////////
+struct NotRegistered
+{
+  std::string name;
+};
+
+/////////////////////////////////////////////////
+TEST(ComponentFactory, TypeByActualTypeMatchesTypeByName)
+{
+  EXPECT_NE(gzecs::NO_COMPONENT, gzecs::ComponentFactory::Type<TC1>());
+  EXPECT_NE(gzecs::NO_COMPONENT, gzecs::ComponentFactory::Type<TC2>());
+  EXPECT_NE(gzecs::ComponentFactory::Type<TC1>(),
+      gzecs::ComponentFactory::Type<TC2>());
+  EXPECT_EQ(gzecs::ComponentFactory::Type("TC1"),
+      gzecs::ComponentFactory::Type<TC1>());
+  EXPECT_EQ(gzecs::ComponentFactory::Type("TC2"),
+      gzecs::ComponentFactory::Type<TC2>());
+}
+
+/////////////////////////////////////////////////
+TEST(ComponentFactory, UnregisteredTypeIsNoComponent)
+{
+  EXPECT_EQ(gzecs::NO_COMPONENT,
+      gzecs::ComponentFactory::Type<NotRegistered>());
+  EXPECT_EQ(gzecs::NO_COMPONENT,
+      gzecs::ComponentFactory::Type("NotRegistered"));
+  EXPECT_EQ(0u, gzecs::ComponentFactory::TypeInfo(gzecs::NO_COMPONENT).size);
+}
+
+/////////////////////////////////////////////////
+TEST(ComponentFactory, RegisterTwiceFails)
+{
+  EXPECT_FALSE(gzecs::ComponentFactory::Register<TC1>("TC1"));
+  EXPECT_FALSE(gzecs::ComponentFactory::Register<TC1>("AnotherName"));
+  EXPECT_FALSE(gzecs::ComponentFactory::Register<NotRegistered>("TC2"));
+  EXPECT_EQ(gzecs::NO_COMPONENT,
+      gzecs::ComponentFactory::Type<NotRegistered>());
+}
+
+/////////////////////////////////////////////////
+TEST(ComponentFactory, TypeFromManyThreads)
+{
+  const gzecs::ComponentType expected = gzecs::ComponentFactory::Type<TC2>();
+  std::vector<int> mismatches(4, 0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t)
+  {
+    threads.push_back(std::thread([&mismatches, expected, t]()
+      {
+        for (int i = 0; i < 10000; ++i)
+        {
+          if (gzecs::ComponentFactory::Type<TC2>() != expected)
+            ++mismatches[t];
+        }
+      }));
+  }
+  for (auto &thread : threads)
+    thread.join();
+  for (int count : mismatches)
+    EXPECT_EQ(0, count);
+}
+
+/////////////////////////////////////////////////
+TEST(ComponentFactory, TrivialTypesAreFlagged)
+{
+  EXPECT_TRUE(gzecs::ComponentFactory::TypeInfo(
+        gzecs::ComponentFactory::Type<TC1>()).trivial);
+  EXPECT_FALSE(gzecs::ComponentFactory::TypeInfo(
+        gzecs::ComponentFactory::Type<WithString>()).trivial);
+}
+
+/////////////////////////////////////////////////
+TEST(ComponentFactory, BatchOperations)
+{
+  const std::size_t count = 10;
+  for (auto type : {gzecs::ComponentFactory::Type<TC2>(),
+      gzecs::ComponentFactory::Type<WithString>()})
+  {
+    const gzecs::ComponentTypeInfo &info =
+      gzecs::ComponentFactory::TypeInfo(type);
+    std::vector<char> first(count * info.size);
+    std::vector<char> second(count * info.size);
+    std::vector<char> third(count * info.size);
+    info.constructMany(first.data(), count, info.size);
+    info.copyMany(first.data(), second.data(), count, info.size);
+    info.moveMany(second.data(), third.data(), count, info.size);
+    info.destructMany(first.data(), count, info.size);
+    info.destructMany(third.data(), count, info.size);
+  }
+
+  // Check the values that went through a non-trivial type
+  const gzecs::ComponentTypeInfo &info = gzecs::ComponentFactory::TypeInfo(
+      gzecs::ComponentFactory::Type<WithString>());
+  WithString from[count];
+  from[3].name = "three";
+  alignas(WithString) char to[count * sizeof(WithString)];
+  info.copyMany(from, to, count, info.size);
+  WithString *copies = reinterpret_cast<WithString *>(to);
+  EXPECT_EQ("default", copies[0].name);
+  EXPECT_EQ("three", copies[3].name);
+  info.destructMany(to, count, info.size);
+}
+
+/////////////////////////////////////////////////
+TEST(ComponentFactory, AlignmentIsRecorded)
+{
+  const gzecs::ComponentTypeInfo &aligned = gzecs::ComponentFactory::TypeInfo(
+      gzecs::ComponentFactory::Type<Aligned32>());
+  EXPECT_EQ(32u, aligned.alignment);
+  EXPECT_EQ(sizeof(Aligned32), aligned.stride);
+
+  const gzecs::ComponentTypeInfo &packed = gzecs::ComponentFactory::TypeInfo(
+      gzecs::ComponentFactory::Type<TC2>());
+  EXPECT_EQ(alignof(TC2), packed.alignment);
+  EXPECT_EQ(sizeof(TC2), packed.stride);
+
+  const gzecs::ComponentTypeInfo &padded = gzecs::ComponentFactory::TypeInfo(
+      gzecs::ComponentFactory::Type<TC1>());
+  EXPECT_EQ(gzecs::CACHE_LINE_SIZE, padded.alignment);
+  EXPECT_EQ(gzecs::CACHE_LINE_SIZE, padded.stride);
+  EXPECT_EQ(sizeof(TC1), padded.size);
+}
+
+int main(int argc, char **argv)
+{
+  // Register types with the factory
+  gazebo::ecs::ComponentFactory::Register<TC1>("TC1", true);
+  gazebo::ecs::ComponentFactory::Register<TC2>("TC2");
+  gazebo::ecs::ComponentFactory::Register<WithString>("WithString");
+  gazebo::ecs::ComponentFactory::Register<Aligned32>("Aligned32");
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
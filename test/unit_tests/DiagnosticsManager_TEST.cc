@@ -118,6 +118,53 @@ TEST_F(DiagnosticsManagerTest, DiagnosticsClearedEveryUpdate)
   EXPECT_EQ(0, this->msg.time_size());
 }
 
+//////////////////////////////////////////////////
+TEST_F(DiagnosticsManagerTest, PublishValues)
+{
+  gzutil::DiagnosticsManager mgr;
+  ASSERT_TRUE(mgr.Init("PublishValues"));
+
+  ignition::common::Time simTime;
+  mgr.UpdateBegin(simTime);
+  mgr.AddValue("bytes", 42);
+  mgr.UpdateEnd();
+
+  ASSERT_EQ(1, this->num);
+  ASSERT_EQ(1, this->msg.header().data_size());
+  EXPECT_EQ("PublishValues:bytes", this->msg.header().data(0).key());
+  ASSERT_EQ(1, this->msg.header().data(0).value_size());
+  EXPECT_DOUBLE_EQ(42.0, std::stod(this->msg.header().data(0).value(0)));
+
+  mgr.UpdateBegin(simTime);
+  mgr.UpdateEnd();
+  ASSERT_EQ(2, this->num);
+  EXPECT_EQ(0, this->msg.header().data_size());
+}
+
+//////////////////////////////////////////////////
+TEST_F(DiagnosticsManagerTest, Disabled)
+{
+  gzutil::DiagnosticsManager mgr;
+  EXPECT_FALSE(mgr.Enabled());
+  ASSERT_TRUE(mgr.Init("Disabled"));
+  EXPECT_TRUE(mgr.Enabled());
+
+  ignition::common::Time simTime;
+  mgr.Enabled(false);
+  EXPECT_FALSE(mgr.Enabled());
+  mgr.UpdateBegin(simTime);
+  mgr.StartTimer("asdf");
+  mgr.StopTimer("asdf");
+  mgr.UpdateEnd();
+  ASSERT_EQ(0, this->num);
+
+  mgr.Enabled(true);
+  mgr.UpdateBegin(simTime);
+  mgr.UpdateEnd();
+  ASSERT_EQ(1, this->num);
+  EXPECT_EQ(0, this->msg.time_size());
+}
+
 int main(int argc, char **argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
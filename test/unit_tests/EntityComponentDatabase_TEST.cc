@@ -16,6 +16,10 @@
 */
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
 #include <gtest/gtest.h>
 
 #include "gazebo/ecs/ComponentFactory.hh"
@@ -42,6 +46,22 @@ struct TC3
   double itemThree;
 };
 
+struct TC4
+{
+  std::string name;
+};
+
+struct alignas(32) TC5
+{
+  float values[8];
+};
+
+/// \brief registered with padding to cache lines
+struct TC6
+{
+  std::string name;
+};
+
 /////////////////////////////////////////////////
 TEST(EntityComponentDatabase, FirstEntityIdIsNotNoEntityId)
 {
@@ -354,6 +374,72 @@ TEST(EntityComponentDatabase, RemoveQueryNoResults)
   ASSERT_EQ(0, uut.Query(result.first).EntityIds().size());
 }
 
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, IdenticalQueriesShareResults)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  gazebo::ecs::EntityQuery query;
+  query.AddComponent("TC1");
+  auto first = uut.AddQuery(query);
+  EXPECT_TRUE(first.second);
+
+  gazebo::ecs::EntityId entity = uut.CreateEntity();
+  uut.AddComponent<TC1>(entity);
+  uut.Update();
+
+  // Added later, when the results of the first one aren't empty
+  gazebo::ecs::EntityQuery same;
+  same.AddComponent("TC1");
+  auto second = uut.AddQuery(same);
+  EXPECT_FALSE(second.second);
+  EXPECT_EQ(first.first, second.first);
+  ASSERT_EQ(1u, uut.Query(second.first).EntityIds().size());
+
+  // Removed once for every time it was added
+  EXPECT_TRUE(uut.RemoveQuery(first.first));
+  EXPECT_EQ(1u, uut.Query(second.first).EntityIds().size());
+  EXPECT_TRUE(uut.RemoveQuery(second.first));
+  EXPECT_TRUE(uut.Query(second.first).EntityIds().empty());
+  EXPECT_FALSE(uut.RemoveQuery(second.first));
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, RemovingQueryKeepsOtherIds)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  gazebo::ecs::EntityQuery q1;
+  q1.AddComponent("TC1");
+  gazebo::ecs::EntityQuery q2;
+  q2.AddComponent("TC2");
+  gazebo::ecs::EntityQuery q3;
+  q3.AddComponent("TC3");
+  auto id1 = uut.AddQuery(q1).first;
+  auto id2 = uut.AddQuery(q2).first;
+  auto id3 = uut.AddQuery(q3).first;
+
+  gazebo::ecs::EntityId entity = uut.CreateEntity();
+  uut.AddComponent<TC2>(entity);
+  uut.AddComponent<TC3>(entity);
+  uut.Update();
+
+  EXPECT_TRUE(uut.RemoveQuery(id1));
+  EXPECT_EQ(q2.Mask(), uut.Query(id2).Mask());
+  EXPECT_EQ(q3.Mask(), uut.Query(id3).Mask());
+
+  // Removed queries are no longer updated, the others are
+  gazebo::ecs::EntityId other = uut.CreateEntity();
+  uut.AddComponent<TC1>(other);
+  uut.AddComponent<TC3>(other);
+  uut.Update();
+  EXPECT_EQ(1u, uut.Query(id2).EntityIds().size());
+  EXPECT_EQ(2u, uut.Query(id3).EntityIds().size());
+
+  // A new query gets a new id
+  auto id4 = uut.AddQuery(q1).first;
+  EXPECT_NE(id1, id4);
+  EXPECT_EQ(1u, uut.Query(id4).EntityIds().size());
+}
+
 /////////////////////////////////////////////////
 TEST(EntityComponentDatabase, TrackComponentChanges)
 {
@@ -389,6 +475,42 @@ TEST(EntityComponentDatabase, TrackComponentChanges)
   EXPECT_EQ(gazebo::ecs::WAS_DELETED, uut.IsDifferent<TC2>(entity));
 }
 
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, ListChangedEntities)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  EXPECT_TRUE(uut.ChangedEntities<TC1>().empty());
+
+  std::vector<gazebo::ecs::EntityId> entities;
+  for (int i = 0; i < 10; ++i)
+  {
+    entities.push_back(uut.CreateEntity());
+    uut.AddComponent<TC1>(entities.back());
+  }
+  uut.Update();
+  auto changed = uut.ChangedEntities<TC1>();
+  std::sort(changed.begin(), changed.end());
+  EXPECT_EQ(entities, changed);
+  EXPECT_TRUE(uut.ChangedEntities<TC2>().empty());
+
+  // Only entities that changed are listed
+  uut.EntityComponentMutable<TC1>(entities[2])->itemOne = 2;
+  uut.RemoveComponent<TC1>(entities[5]);
+  uut.Update();
+  changed = uut.ChangedEntities<TC1>();
+  std::sort(changed.begin(), changed.end());
+  ASSERT_EQ(2u, changed.size());
+  EXPECT_EQ(entities[2], changed[0]);
+  EXPECT_EQ(entities[5], changed[1]);
+  EXPECT_EQ(gazebo::ecs::WAS_MODIFIED, uut.IsDifferent<TC1>(entities[2]));
+  EXPECT_EQ(gazebo::ecs::WAS_DELETED, uut.IsDifferent<TC1>(entities[5]));
+  EXPECT_EQ(gazebo::ecs::NO_DIFFERENCE, uut.IsDifferent<TC1>(entities[3]));
+
+  uut.Update();
+  EXPECT_TRUE(uut.ChangedEntities<TC1>().empty());
+  EXPECT_EQ(gazebo::ecs::NO_DIFFERENCE, uut.IsDifferent<TC1>(entities[2]));
+}
+
 /////////////////////////////////////////////////
 TEST(EntityComponentDatabase, QueriesIncludeDeletedEntitiesForOneUpdate)
 {
@@ -452,7 +574,7 @@ TEST(EntityComponentDatabase, CreateComponentSetInitialValues)
   uut.Update();
   auto constComp = uut.EntityComponent<TC1>(entity);
   ASSERT_NE(nullptr, constComp);
-  EXPECT_FLOAT_EQ(12345.0, comp->itemOne);
+  EXPECT_FLOAT_EQ(12345.0, constComp->itemOne);
 }
 
 /////////////////////////////////////////////////
@@ -584,9 +706,824 @@ TEST(EntityComponentDatabase, ReuseSmallestAvailableEntityId)
   EXPECT_EQ(6, entities.back());
 
   uut.Update();
-  // Now the deleted ids can be reused
-  EXPECT_EQ(2, uut.CreateEntity());
-  EXPECT_EQ(3, uut.CreateEntity());
+  // Now the deleted indices can be reused with a new generation
+  gazebo::ecs::EntityId reused = uut.CreateEntity();
+  EXPECT_EQ(2, gazebo::ecs::EntityIndex(reused));
+  EXPECT_NE(entities[2], reused);
+  reused = uut.CreateEntity();
+  EXPECT_EQ(3, gazebo::ecs::EntityIndex(reused));
+  EXPECT_NE(entities[3], reused);
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, StaleIdDoesNotAliasReusedEntity)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  gazebo::ecs::EntityId stale = uut.CreateEntity();
+  uut.AddComponent<TC1>(stale)->itemOne = 1.0;
+  uut.Update();
+
+  uut.DeleteEntity(stale);
+  uut.Update();
+  uut.Update();
+
+  gazebo::ecs::EntityId fresh = uut.CreateEntity();
+  ASSERT_EQ(gazebo::ecs::EntityIndex(stale),
+      gazebo::ecs::EntityIndex(fresh));
+  ASSERT_NE(stale, fresh);
+  uut.AddComponent<TC1>(fresh)->itemOne = 2.0;
+  uut.Update();
+
+  // The old handle refers to nothing
+  EXPECT_EQ(gazebo::ecs::NO_ENTITY, uut.Entity(stale).Id());
+  EXPECT_EQ(nullptr, uut.EntityComponent<TC1>(stale));
+  EXPECT_EQ(nullptr, uut.EntityComponentMutable<TC1>(stale));
+  EXPECT_EQ(nullptr, uut.AddComponent<TC2>(stale));
+  EXPECT_FALSE(uut.RemoveComponent<TC1>(stale));
+  EXPECT_FALSE(uut.DeleteEntity(stale));
+  EXPECT_EQ(gazebo::ecs::NO_DIFFERENCE, uut.IsDifferent<TC1>(stale));
+
+  // The new one sees its own component
+  EXPECT_EQ(fresh, uut.Entity(fresh).Id());
+  ASSERT_NE(nullptr, uut.EntityComponent<TC1>(fresh));
+  EXPECT_FLOAT_EQ(2.0, uut.EntityComponent<TC1>(fresh)->itemOne);
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, ComponentAddedToDeletedEntityIsDropped)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  gazebo::ecs::EntityId id = uut.CreateEntity();
+  uut.Update();
+
+  ASSERT_NE(nullptr, uut.AddComponent<TC4>(id));
+  EXPECT_TRUE(uut.DeleteEntity(id));
+  uut.Update();
+  EXPECT_EQ(nullptr, uut.EntityComponent<TC4>(id));
+
+  // The index comes back without the component
+  uut.Update();
+  gazebo::ecs::EntityId fresh = uut.CreateEntity();
+  ASSERT_EQ(gazebo::ecs::EntityIndex(id), gazebo::ecs::EntityIndex(fresh));
+  EXPECT_NE(nullptr, uut.AddComponent<TC4>(fresh));
+  uut.Update();
+  EXPECT_NE(nullptr, uut.EntityComponent<TC4>(fresh));
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, QueryResultsHaveComponentPointers)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  gazebo::ecs::EntityQuery query;
+  query.AddComponent("TC1");
+  query.AddComponent("TC2");
+  auto queryId = uut.AddQuery(query).first;
+
+  // Enough entities to make the pools reallocate
+  std::vector<gazebo::ecs::EntityId> entities;
+  for (int i = 0; i < 100; ++i)
+  {
+    entities.push_back(uut.CreateEntity());
+    uut.AddComponent<TC1>(entities.back())->itemOne = i;
+    if (i % 2)
+      uut.AddComponent<TC2>(entities.back())->itemTwo = i;
+  }
+  uut.Update();
+
+  auto checkResults = [&uut, queryId]()
+    {
+      auto const &result = uut.Query(queryId);
+      auto const &ids = result.EntityIds();
+      auto const tc1 = result.Components<TC1>();
+      auto const tc2 = result.Components<TC2>();
+      EXPECT_TRUE(std::is_sorted(ids.begin(), ids.end()));
+      ASSERT_EQ(ids.size(), tc1.Size());
+      ASSERT_EQ(ids.size(), tc2.Size());
+      EXPECT_EQ(0u, result.Components<TC3>().Size());
+      for (std::size_t i = 0; i < ids.size(); ++i)
+      {
+        EXPECT_EQ(uut.EntityComponent<TC1>(ids[i]), tc1[i]);
+        EXPECT_EQ(uut.EntityComponent<TC2>(ids[i]), tc2[i]);
+      }
+    };
+
+  ASSERT_EQ(50u, uut.Query(queryId).EntityIds().size());
+  checkResults();
+
+  // Removing from the middle of a pool moves other components
+  uut.RemoveComponent<TC1>(entities[1]);
+  uut.DeleteEntity(entities[51]);
+  uut.Update();
+  checkResults();
+
+  // Removed components stay in the results for one update as nullptr
+  auto const &ids = uut.Query(queryId).EntityIds();
+  auto const tc1 = uut.Query(queryId).Components<TC1>();
+  auto const tc2 = uut.Query(queryId).Components<TC2>();
+  ASSERT_EQ(50u, ids.size());
+  auto iter = std::find(ids.begin(), ids.end(), entities[1]);
+  ASSERT_NE(ids.end(), iter);
+  EXPECT_EQ(nullptr, tc1[iter - ids.begin()]);
+  EXPECT_NE(nullptr, tc2[iter - ids.begin()]);
+
+  uut.Update();
+  EXPECT_EQ(48u, uut.Query(queryId).EntityIds().size());
+  checkResults();
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, ModifyQueryResults)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  gazebo::ecs::EntityQuery query;
+  query.AddComponent("TC1");
+  auto queryId = uut.AddQuery(query).first;
+
+  std::vector<gazebo::ecs::EntityId> entities;
+  for (int i = 0; i < 10; ++i)
+  {
+    entities.push_back(uut.CreateEntity());
+    uut.AddComponent<TC1>(entities.back())->itemOne = i;
+  }
+  uut.Update();
+
+  auto const &result = uut.Query(queryId);
+  auto const &ids = result.EntityIds();
+  auto tc1 = result.ComponentsMutable(
+      gazebo::ecs::ComponentFactory::Type<TC1>());
+  ASSERT_EQ(10u, tc1.Size());
+  EXPECT_EQ(0u, result.ComponentsMutable(
+        gazebo::ecs::ComponentFactory::Type<TC2>()).Size());
+
+  // Same copy as looking up the entity, applied next update
+  for (std::size_t i = 0; i < ids.size(); ++i)
+  {
+    TC1 *copy = static_cast<TC1 *>(tc1.Modify(i));
+    ASSERT_NE(nullptr, copy);
+    EXPECT_EQ(uut.EntityComponentMutable<TC1>(ids[i]), copy);
+    copy->itemOne += 100;
+  }
+  EXPECT_FLOAT_EQ(0, uut.EntityComponent<TC1>(entities[0])->itemOne);
+  uut.Update();
+  for (std::size_t i = 0; i < entities.size(); ++i)
+    EXPECT_FLOAT_EQ(i + 100, uut.EntityComponent<TC1>(entities[i])->itemOne);
+
+  // Removed components can't be modified
+  uut.RemoveComponent<TC1>(entities[3]);
+  uut.Update();
+  tc1 = uut.Query(queryId).ComponentsMutable(
+      gazebo::ecs::ComponentFactory::Type<TC1>());
+  auto iter = std::find(ids.begin(), ids.end(), entities[3]);
+  ASSERT_NE(ids.end(), iter);
+  EXPECT_EQ(nullptr, tc1.Modify(iter - ids.begin()));
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, QueryWithoutComponent)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  gazebo::ecs::EntityQuery query;
+  query.AddComponent<TC1>();
+  query.Without<TC2>();
+  auto queryId = uut.AddQuery(query).first;
+
+  gazebo::ecs::EntityId plain = uut.CreateEntity();
+  uut.AddComponent<TC1>(plain);
+  gazebo::ecs::EntityId both = uut.CreateEntity();
+  uut.AddComponent<TC1>(both);
+  uut.AddComponent<TC2>(both);
+  uut.Update();
+
+  auto const *ids = &uut.Query(queryId).EntityIds();
+  ASSERT_EQ(1u, ids->size());
+  EXPECT_EQ(plain, (*ids)[0]);
+
+  // Adding the excluded component takes the entity out of the results
+  uut.AddComponent<TC2>(plain);
+  uut.Update();
+  ids = &uut.Query(queryId).EntityIds();
+  EXPECT_TRUE(ids->empty());
+
+  // Removing it puts the entity back
+  uut.RemoveComponent<TC2>(both);
+  uut.Update();
+  ids = &uut.Query(queryId).EntityIds();
+  ASSERT_EQ(1u, ids->size());
+  EXPECT_EQ(both, (*ids)[0]);
+
+  // Deleting an entity doesn't put it back
+  uut.DeleteEntity(plain);
+  uut.Update();
+  uut.Update();
+  ids = &uut.Query(queryId).EntityIds();
+  ASSERT_EQ(1u, ids->size());
+  EXPECT_EQ(both, (*ids)[0]);
+
+  // Entities in batches are checked too
+  auto batch = uut.CreateEntities<TC1, TC2>(10);
+  EXPECT_EQ(10u, batch.Size());
+  uut.Update();
+  EXPECT_EQ(1u, uut.Query(queryId).EntityIds().size());
+
+  // Queries added later see the same entities
+  gazebo::ecs::EntityQuery instant;
+  instant.AddComponent<TC1>();
+  instant.Without<TC2>();
+  uut.InstantQuery(instant);
+  EXPECT_EQ(uut.Query(queryId).EntityIds(), instant.EntityIds());
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, QueryOptionalComponent)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  gazebo::ecs::EntityQuery query;
+  query.AddComponent<TC1>();
+  query.Optional<TC2>();
+  auto queryId = uut.AddQuery(query).first;
+
+  std::vector<gazebo::ecs::EntityId> entities;
+  for (int i = 0; i < 10; ++i)
+  {
+    entities.push_back(uut.CreateEntity());
+    uut.AddComponent<TC1>(entities.back())->itemOne = i;
+    if (i % 2)
+      uut.AddComponent<TC2>(entities.back())->itemTwo = i;
+  }
+  // Optional components don't make entities match
+  uut.AddComponent<TC2>(uut.CreateEntity());
+  uut.Update();
+
+  auto checkResults = [&uut, queryId, &entities]()
+    {
+      auto const &result = uut.Query(queryId);
+      auto const &ids = result.EntityIds();
+      auto const tc1 = result.Components<TC1>();
+      auto const tc2 = result.Components<TC2>();
+      ASSERT_EQ(entities, ids);
+      ASSERT_EQ(ids.size(), tc1.Size());
+      ASSERT_EQ(ids.size(), tc2.Size());
+      for (std::size_t i = 0; i < ids.size(); ++i)
+      {
+        EXPECT_EQ(uut.EntityComponent<TC1>(ids[i]), tc1[i]);
+        // nullptr if the entity doesn't have one
+        EXPECT_EQ(uut.EntityComponent<TC2>(ids[i]), tc2[i]);
+      }
+    };
+  checkResults();
+  EXPECT_EQ(nullptr, uut.Query(queryId).Components<TC2>()[0]);
+  ASSERT_NE(nullptr, uut.Query(queryId).Components<TC2>()[1]);
+  EXPECT_EQ(1, uut.Query(queryId).Components<TC2>()[1]->itemTwo);
+
+  // Optional components added later show up without changing the results
+  uut.AddComponent<TC2>(entities[0]);
+  uut.RemoveComponent<TC2>(entities[1]);
+  uut.Update();
+  checkResults();
+  EXPECT_NE(nullptr, uut.Query(queryId).Components<TC2>()[0]);
+  EXPECT_EQ(nullptr, uut.Query(queryId).Components<TC2>()[1]);
+  uut.Update();
+  checkResults();
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, ReactiveQueryListsChanges)
+{
+  typedef std::vector<gazebo::ecs::EntityId> Ids;
+  gazebo::ecs::EntityComponentDatabase uut;
+
+  Ids entities;
+  for (int i = 0; i < 5; ++i)
+  {
+    entities.push_back(uut.CreateEntity());
+    uut.AddComponent<TC1>(entities.back());
+  }
+  uut.Update();
+
+  gazebo::ecs::EntityQuery query;
+  query.AddComponent<TC1>();
+  query.Optional<TC2>();
+  query.Reactive(true);
+  auto queryId = uut.AddQuery(query).first;
+  auto const &result = uut.Query(queryId);
+
+  // Entities that already match are added
+  EXPECT_EQ(entities, result.AddedEntityIds());
+  uut.Update();
+  EXPECT_EQ(entities, result.AddedEntityIds());
+  EXPECT_TRUE(result.RemovedEntityIds().empty());
+  EXPECT_TRUE(result.ModifiedEntityIds().empty());
+
+  // Nothing changed
+  uut.Update();
+  EXPECT_TRUE(result.AddedEntityIds().empty());
+  EXPECT_TRUE(result.RemovedEntityIds().empty());
+  EXPECT_TRUE(result.ModifiedEntityIds().empty());
+
+  // Modifying required or optional components
+  gazebo::ecs::EntityId newEntity = uut.CreateEntity();
+  uut.AddComponent<TC1>(newEntity);
+  uut.AddComponent<TC2>(entities[1]);
+  uut.EntityComponentMutable<TC1>(entities[3])->itemOne = 3;
+  uut.EntityComponentMutable<TC1>(newEntity);
+  uut.DeleteEntity(entities[4]);
+  uut.Update();
+  EXPECT_EQ(Ids({newEntity}), result.AddedEntityIds());
+  EXPECT_TRUE(result.RemovedEntityIds().empty());
+  EXPECT_EQ(Ids({entities[1], entities[3], entities[4]}),
+      result.ModifiedEntityIds());
+
+  // Entities whose required components were removed leave the next update
+  uut.Update();
+  EXPECT_TRUE(result.AddedEntityIds().empty());
+  EXPECT_EQ(Ids({entities[4]}), result.RemovedEntityIds());
+  EXPECT_TRUE(result.ModifiedEntityIds().empty());
+  EXPECT_EQ(5u, result.EntityIds().size());
+
+  // Queries that aren't reactive don't list changes
+  gazebo::ecs::EntityQuery plain;
+  plain.AddComponent<TC1>();
+  plain.Optional<TC2>();
+  EXPECT_FALSE(plain == query);
+  auto plainId = uut.AddQuery(plain).first;
+  uut.RemoveComponent<TC2>(entities[1]);
+  uut.Update();
+  EXPECT_EQ(Ids({entities[1]}), uut.Query(queryId).ModifiedEntityIds());
+  EXPECT_TRUE(uut.Query(plainId).AddedEntityIds().empty());
+  EXPECT_TRUE(uut.Query(plainId).ModifiedEntityIds().empty());
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, DeferModifiedComponents)
+{
+  typedef std::vector<gazebo::ecs::EntityId> Ids;
+  gazebo::ecs::EntityComponentDatabase uut;
+  const gazebo::ecs::ComponentType tc1 =
+    gazebo::ecs::ComponentFactory::Type<TC1>();
+  const gazebo::ecs::ComponentType tc2 =
+    gazebo::ecs::ComponentFactory::Type<TC2>();
+  gazebo::ecs::ComponentMask both;
+  both.set(tc1);
+  both.set(tc2);
+
+  Ids entities;
+  for (int i = 0; i < 3; ++i)
+  {
+    entities.push_back(uut.CreateEntity());
+    uut.AddComponent<TC1>(entities.back())->itemOne = i;
+    uut.AddComponent<TC2>(entities.back());
+  }
+  // Added components are never deferred
+  EXPECT_TRUE(uut.Update(both).none());
+
+  gazebo::ecs::EntityQuery query;
+  query.AddComponent<TC1>();
+  query.AddComponent<TC2>();
+  query.Reactive(true);
+  auto const &result = uut.Query(uut.AddQuery(query).first);
+  uut.Update();
+
+  // Nothing modified, nothing to defer
+  EXPECT_TRUE(uut.Update(both).none());
+
+  uut.EntityComponentMutable<TC1>(entities[0])->itemOne = 10;
+  uut.EntityComponentMutable<TC2>(entities[2])->itemTwo = 20;
+  gazebo::ecs::ComponentMask deferred = uut.Update(both);
+  EXPECT_EQ(both, deferred);
+
+  // The query waits for both types
+  uut.CommitModified(tc1);
+  EXPECT_FLOAT_EQ(10, uut.EntityComponent<TC1>(entities[0])->itemOne);
+  EXPECT_TRUE(result.ModifiedEntityIds().empty());
+  uut.CommitModified(tc2);
+  EXPECT_EQ(20, uut.EntityComponent<TC2>(entities[2])->itemTwo);
+  EXPECT_EQ(Ids({entities[0], entities[2]}), result.ModifiedEntityIds());
+  EXPECT_EQ(Ids({entities[0]}), uut.ChangedEntities<TC1>());
+
+  // Changes are cleared by the next update as usual
+  uut.Update();
+  EXPECT_TRUE(result.ModifiedEntityIds().empty());
+  EXPECT_TRUE(uut.ChangedEntities<TC1>().empty());
+
+  // A type with a component removed is committed right away
+  uut.EntityComponentMutable<TC1>(entities[1])->itemOne = 11;
+  uut.EntityComponentMutable<TC2>(entities[1])->itemTwo = 21;
+  uut.RemoveComponent<TC2>(entities[0]);
+  deferred = uut.Update(both);
+  EXPECT_TRUE(deferred.test(tc1));
+  EXPECT_FALSE(deferred.test(tc2));
+  EXPECT_EQ(21, uut.EntityComponent<TC2>(entities[1])->itemTwo);
+  uut.CommitModified(tc1);
+  EXPECT_FLOAT_EQ(11, uut.EntityComponent<TC1>(entities[1])->itemOne);
+  EXPECT_EQ(Ids({entities[0], entities[1]}), result.ModifiedEntityIds());
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, CreateEntitiesInBatch)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  gazebo::ecs::EntityQuery query;
+  query.AddComponent("TC1");
+  query.AddComponent("TC2");
+  auto queryId = uut.AddQuery(query).first;
+
+  auto batch = uut.CreateEntities<TC1, TC2>(100);
+  ASSERT_EQ(100u, batch.Size());
+  EXPECT_EQ(nullptr, batch.Components<TC3>());
+  TC1 *tc1 = batch.Components<TC1>();
+  TC2 *tc2 = batch.Components<TC2>();
+  ASSERT_NE(nullptr, tc1);
+  ASSERT_NE(nullptr, tc2);
+  for (std::size_t i = 0; i < batch.Size(); ++i)
+  {
+    tc1[i].itemOne = i;
+    tc2[i].itemTwo = i;
+  }
+
+  // One of them also gets a component the batch doesn't have, and one is
+  // deleted before its components are stored
+  gazebo::ecs::EntityId extra = batch.Id(10);
+  gazebo::ecs::EntityId deleted = batch.Id(20);
+  uut.AddComponent<TC3>(extra)->itemThree = 3.0;
+  EXPECT_TRUE(uut.DeleteEntity(deleted));
+
+  std::vector<gazebo::ecs::EntityId> ids;
+  for (std::size_t i = 0; i < batch.Size(); ++i)
+    ids.push_back(batch.Id(i));
+  uut.Update();
+
+  EXPECT_EQ(99u, uut.Query(queryId).EntityIds().size());
+  for (std::size_t i = 0; i < ids.size(); ++i)
+  {
+    if (ids[i] == deleted)
+    {
+      EXPECT_EQ(nullptr, uut.EntityComponent<TC1>(ids[i]));
+      continue;
+    }
+    auto const *c1 = uut.EntityComponent<TC1>(ids[i]);
+    auto const *c2 = uut.EntityComponent<TC2>(ids[i]);
+    ASSERT_NE(nullptr, c1);
+    ASSERT_NE(nullptr, c2);
+    EXPECT_FLOAT_EQ(static_cast<float>(i), c1->itemOne);
+    EXPECT_EQ(static_cast<int>(i), c2->itemTwo);
+    EXPECT_EQ(gazebo::ecs::WAS_CREATED, uut.IsDifferent<TC1>(ids[i]));
+  }
+  ASSERT_NE(nullptr, uut.EntityComponent<TC3>(extra));
+  EXPECT_DOUBLE_EQ(3.0, uut.EntityComponent<TC3>(extra)->itemThree);
+
+  // Batches with types that aren't registered create nothing
+  std::vector<gazebo::ecs::ComponentType> badTypes{
+    gazebo::ecs::NO_COMPONENT};
+  EXPECT_EQ(0u, uut.CreateEntities(10, badTypes).Size());
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, ModifiedComponentStaysInPlace)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  gazebo::ecs::EntityId id = uut.CreateEntity();
+  uut.AddComponent<TC4>(id)->name = "before";
+  uut.Update();
+
+  auto const *readOnly = uut.EntityComponent<TC4>(id);
+  ASSERT_NE(nullptr, readOnly);
+
+  // Every thread gets the same copy
+  TC4 *copies[4] = {nullptr, nullptr, nullptr, nullptr};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t)
+  {
+    threads.push_back(std::thread([&uut, &copies, id, t]()
+      {
+        copies[t] = uut.EntityComponentMutable<TC4>(id);
+      }));
+  }
+  for (auto &thread : threads)
+    thread.join();
+  for (int t = 1; t < 4; ++t)
+    EXPECT_EQ(copies[0], copies[t]);
+  ASSERT_NE(nullptr, copies[0]);
+  EXPECT_NE(readOnly, copies[0]);
+  EXPECT_EQ("before", copies[0]->name);
+
+  copies[0]->name = "after";
+  EXPECT_EQ("before", readOnly->name);
+
+  // The modification is moved into the component readers already have
+  uut.Update();
+  EXPECT_EQ(readOnly, uut.EntityComponent<TC4>(id));
+  EXPECT_EQ("after", readOnly->name);
+  EXPECT_EQ(gazebo::ecs::WAS_MODIFIED, uut.IsDifferent<TC4>(id));
+
+  uut.Update();
+  EXPECT_EQ(gazebo::ecs::NO_DIFFERENCE, uut.IsDifferent<TC4>(id));
+  EXPECT_EQ("after", readOnly->name);
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, StagingMemoryReusedEveryUpdate)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  EXPECT_EQ(0u, uut.StagingBytes());
+
+  std::vector<gazebo::ecs::EntityId> ids;
+  for (int i = 0; i < 100; ++i)
+  {
+    ids.push_back(uut.CreateEntity());
+    uut.AddComponent<TC1>(ids.back())->itemOne = i;
+  }
+  uut.Update();
+  const std::size_t firstBytes = uut.StagingBytes();
+  EXPECT_GE(firstBytes, 100 * sizeof(TC1));
+
+  // Nothing staged
+  uut.Update();
+  EXPECT_EQ(0u, uut.StagingBytes());
+
+  // Same amount of changes uses the same amount of memory
+  for (int i = 0; i < 100; ++i)
+    uut.AddComponent<TC1>(uut.CreateEntity())->itemOne = i;
+  uut.Update();
+  EXPECT_EQ(firstBytes, uut.StagingBytes());
+  for (std::size_t i = 0; i < ids.size(); ++i)
+  {
+    auto const *component = uut.EntityComponent<TC1>(ids[i]);
+    ASSERT_NE(nullptr, component);
+    EXPECT_FLOAT_EQ(static_cast<float>(i), component->itemOne);
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, StagingMemoryFreedAfterBurst)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  for (int i = 0; i < 10; ++i)
+    uut.AddComponent<TC1>(uut.CreateEntity())->itemOne = i;
+  uut.Update();
+  const std::size_t steadyCapacity = uut.StagingCapacity();
+  EXPECT_GT(steadyCapacity, 0u);
+
+  // A burst of changes grows the memory kept for staging
+  for (int i = 0; i < 10000; ++i)
+    uut.AddComponent<TC1>(uut.CreateEntity())->itemOne = i;
+  uut.Update();
+  const std::size_t burstCapacity = uut.StagingCapacity();
+  EXPECT_GT(burstCapacity, steadyCapacity);
+
+  // It's freed once enough updates go by without needing it
+  std::size_t capacity = burstCapacity;
+  for (int u = 0; u < 100 && capacity == burstCapacity; ++u)
+  {
+    for (int i = 0; i < 10; ++i)
+      uut.AddComponent<TC1>(uut.CreateEntity())->itemOne = i;
+    uut.Update();
+    capacity = uut.StagingCapacity();
+  }
+  EXPECT_LE(capacity, steadyCapacity);
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, ComponentsAreAligned)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  auto isAligned = [](void const *_ptr, std::size_t _alignment)
+    {
+      return reinterpret_cast<std::uintptr_t>(_ptr) % _alignment == 0;
+    };
+
+  // Added one at a time and in a batch, enough to make the pools grow
+  std::vector<gazebo::ecs::EntityId> ids;
+  for (int i = 0; i < 50; ++i)
+  {
+    ids.push_back(uut.CreateEntity());
+    TC5 *tc5 = uut.AddComponent<TC5>(ids.back());
+    ASSERT_NE(nullptr, tc5);
+    EXPECT_TRUE(isAligned(tc5, 32));
+    tc5->values[0] = i;
+    uut.AddComponent<TC6>(ids.back())->name = std::to_string(i);
+  }
+  auto batch = uut.CreateEntities<TC5, TC6>(50);
+  EXPECT_TRUE(isAligned(batch.Components<TC5>(), 32));
+  for (std::size_t i = 0; i < batch.Size(); ++i)
+  {
+    ids.push_back(batch.Id(i));
+    batch.Components<TC5>()[i].values[0] = 50 + i;
+    batch.Components<TC6>()[i].name = std::to_string(50 + i);
+  }
+  uut.Update();
+
+  for (std::size_t i = 0; i < ids.size(); ++i)
+  {
+    auto const *tc5 = uut.EntityComponent<TC5>(ids[i]);
+    auto const *tc6 = uut.EntityComponent<TC6>(ids[i]);
+    ASSERT_NE(nullptr, tc5);
+    ASSERT_NE(nullptr, tc6);
+    EXPECT_TRUE(isAligned(tc5, 32));
+    EXPECT_TRUE(isAligned(tc6, gazebo::ecs::CACHE_LINE_SIZE));
+    EXPECT_FLOAT_EQ(static_cast<float>(i), tc5->values[0]);
+    EXPECT_EQ(std::to_string(i), tc6->name);
+  }
+
+  // Modified copies are aligned too
+  TC5 *modified = uut.EntityComponentMutable<TC5>(ids[3]);
+  EXPECT_TRUE(isAligned(modified, 32));
+  EXPECT_TRUE(isAligned(uut.EntityComponentMutable<TC6>(ids[4]),
+        gazebo::ecs::CACHE_LINE_SIZE));
+  modified->values[1] = 42;
+  uut.Update();
+  EXPECT_FLOAT_EQ(42, uut.EntityComponent<TC5>(ids[3])->values[1]);
+  EXPECT_EQ("4", uut.EntityComponent<TC6>(ids[4])->name);
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, ThreadsStageChangesIndependently)
+{
+  const int numThreads = 4;
+  const int perThread = 100;
+  gazebo::ecs::EntityComponentDatabase uut;
+  std::vector<gazebo::ecs::EntityId> entities;
+  for (int i = 0; i < numThreads * perThread; ++i)
+  {
+    entities.push_back(uut.CreateEntity());
+    uut.AddComponent<TC1>(entities.back())->itemOne = i;
+  }
+  uut.Update();
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < numThreads; ++t)
+  {
+    threads.push_back(std::thread([&uut, &entities, t, perThread]()
+      {
+        for (int i = t * perThread; i < (t + 1) * perThread; ++i)
+        {
+          // Reads see the state as of the last update
+          auto const *readOnly = uut.EntityComponent<TC1>(entities[i]);
+          auto *writable = uut.EntityComponentMutable<TC1>(entities[i]);
+          writable->itemOne = readOnly->itemOne * 2;
+          EXPECT_EQ(writable, uut.EntityComponentMutable<TC1>(entities[i]));
+          EXPECT_NE(nullptr, uut.AddComponent<TC2>(entities[i]));
+          EXPECT_EQ(nullptr, uut.AddComponent<TC2>(entities[i]));
+        }
+      }));
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  uut.Update();
+  for (int i = 0; i < numThreads * perThread; ++i)
+  {
+    ASSERT_NE(nullptr, uut.EntityComponent<TC1>(entities[i]));
+    EXPECT_FLOAT_EQ(i * 2, uut.EntityComponent<TC1>(entities[i])->itemOne);
+    EXPECT_NE(nullptr, uut.EntityComponent<TC2>(entities[i]));
+    EXPECT_EQ(gazebo::ecs::WAS_MODIFIED, uut.IsDifferent<TC1>(entities[i]));
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, QueryWhileRunningOutOfEntities)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  std::vector<gazebo::ecs::ComponentType> noTypes;
+  auto batch = uut.CreateEntities(gazebo::ecs::MAX_ENTITIES - 10, noTypes);
+  EXPECT_EQ(static_cast<std::size_t>(gazebo::ecs::MAX_ENTITIES - 10),
+      batch.Size());
+
+  // Running out of slots never lets a concurrent query look past the end
+  std::atomic<bool> done{false};
+  std::thread reader([&uut, &done]()
+    {
+      while (!done)
+      {
+        gazebo::ecs::EntityQuery query;
+        query.AddComponent("TC1");
+        uut.InstantQuery(query);
+      }
+    });
+  int created = 0;
+  for (int i = 0; i < 100; ++i)
+  {
+    if (uut.CreateEntity() != gazebo::ecs::NO_ENTITY)
+      ++created;
+    created += static_cast<int>(uut.CreateEntities(5, noTypes).Size());
+  }
+  done = true;
+  reader.join();
+  EXPECT_EQ(10, created);
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, QueryPointersFollowMovedComponents)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  gazebo::ecs::EntityQuery query;
+  query.AddComponent("TC1");
+  query.Optional("TC2");
+  auto queryId = uut.AddQuery(query).first;
+
+  // Spawns, removals and deletions every update move components around
+  // their pools, sometimes growing the storage
+  std::vector<gazebo::ecs::EntityId> live;
+  uint32_t seed = 1;
+  auto random = [&seed]()
+  {
+    seed = seed * 1664525u + 1013904223u;
+    return seed >> 8;
+  };
+  for (int update = 0; update < 50; ++update)
+  {
+    for (int i = 0; i < 20; ++i)
+    {
+      gazebo::ecs::EntityId id = uut.CreateEntity();
+      uut.AddComponent<TC1>(id)->itemOne = i;
+      if (random() % 2)
+        uut.AddComponent<TC2>(id)->itemTwo = i;
+      live.push_back(id);
+    }
+    if (update % 10 == 0)
+    {
+      auto batch = uut.CreateEntities<TC1>(100);
+      for (std::size_t i = 0; i < batch.Size(); ++i)
+        live.push_back(batch.Id(i));
+    }
+    for (int i = 0; i < 10; ++i)
+    {
+      const std::size_t index = random() % live.size();
+      switch (random() % 3)
+      {
+        case 0:
+          uut.DeleteEntity(live[index]);
+          live.erase(live.begin() + index);
+          break;
+        case 1:
+          uut.RemoveComponent<TC1>(live[index]);
+          break;
+        default:
+          uut.RemoveComponent<TC2>(live[index]);
+          break;
+      }
+    }
+    uut.Update();
+
+    auto const &result = uut.Query(queryId);
+    auto const &ids = result.EntityIds();
+    auto tc1 = result.Components<TC1>();
+    auto tc2 = result.Components<TC2>();
+    ASSERT_EQ(ids.size(), tc1.Size());
+    ASSERT_EQ(ids.size(), tc2.Size());
+    for (std::size_t i = 0; i < ids.size(); ++i)
+    {
+      EXPECT_EQ(uut.EntityComponent<TC1>(ids[i]), tc1[i]);
+      EXPECT_EQ(uut.EntityComponent<TC2>(ids[i]), tc2[i]);
+    }
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(EntityComponentDatabase, ManyComponentsSurviveStorageChanges)
+{
+  gazebo::ecs::EntityComponentDatabase uut;
+  std::vector<gazebo::ecs::EntityId> entities;
+
+  // Enough components to make the storage grow several times
+  for (int i = 0; i < 1000; ++i)
+  {
+    gazebo::ecs::EntityId id = uut.CreateEntity();
+    entities.push_back(id);
+    uut.AddComponent<TC1>(id)->itemOne = i;
+    // Long enough to not fit in a small string buffer
+    uut.AddComponent<TC4>(id)->name = "entity with a long name " +
+      std::to_string(i);
+  }
+  uut.Update();
+
+  // Remove every third component so others get moved around
+  for (int i = 0; i < 1000; i += 3)
+    EXPECT_TRUE(uut.RemoveComponent<TC4>(entities[i]));
+  uut.EntityComponentMutable<TC4>(entities[1])->name = "modified";
+  uut.Update();
+
+  for (int i = 0; i < 1000; ++i)
+  {
+    auto c1 = uut.EntityComponent<TC1>(entities[i]);
+    ASSERT_NE(nullptr, c1);
+    EXPECT_FLOAT_EQ(i, c1->itemOne);
+
+    auto c4 = uut.EntityComponent<TC4>(entities[i]);
+    if (i % 3 == 0)
+    {
+      EXPECT_EQ(nullptr, c4);
+    }
+    else if (i == 1)
+    {
+      ASSERT_NE(nullptr, c4);
+      EXPECT_EQ("modified", c4->name);
+    }
+    else
+    {
+      ASSERT_NE(nullptr, c4);
+      EXPECT_EQ("entity with a long name " + std::to_string(i), c4->name);
+    }
+  }
 }
 
 /////////////////////////////////////////////////
@@ -648,6 +1585,9 @@ int main(int argc, char **argv)
   gazebo::ecs::ComponentFactory::Register<TC1>("TC1");
   gazebo::ecs::ComponentFactory::Register<TC2>("TC2");
   gazebo::ecs::ComponentFactory::Register<TC3>("TC3");
+  gazebo::ecs::ComponentFactory::Register<TC4>("TC4");
+  gazebo::ecs::ComponentFactory::Register<TC5>("TC5");
+  gazebo::ecs::ComponentFactory::Register<TC6>("TC6", true);
 
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -82,6 +82,65 @@ TEST(EntityQuery, DuplicateComponent)
   ASSERT_EQ(1, types.size());
 }
 
+/////////////////////////////////////////////////
+TEST(EntityQuery, MaskMatchesComponentTypes)
+{
+  gazebo::ecs::EntityQuery uut;
+  EXPECT_TRUE(uut.Mask().none());
+
+  uut.AddComponent("TC1");
+  uut.AddComponent("TC3");
+  EXPECT_EQ(2u, uut.Mask().count());
+  EXPECT_TRUE(uut.Mask().test(gazebo::ecs::ComponentFactory::Type<TC1>()));
+  EXPECT_FALSE(uut.Mask().test(gazebo::ecs::ComponentFactory::Type<TC2>()));
+  EXPECT_TRUE(uut.Mask().test(gazebo::ecs::ComponentFactory::Type<TC3>()));
+
+  EXPECT_FALSE(uut.AddComponent(gazebo::ecs::MAX_COMPONENT_TYPES));
+  EXPECT_FALSE(uut.AddComponent("NotAComponent"));
+  EXPECT_EQ(2u, uut.Mask().count());
+}
+
+/////////////////////////////////////////////////
+TEST(EntityQuery, ExcludedAndOptionalComponents)
+{
+  const auto tc1 = gazebo::ecs::ComponentFactory::Type<TC1>();
+  const auto tc2 = gazebo::ecs::ComponentFactory::Type<TC2>();
+  const auto tc3 = gazebo::ecs::ComponentFactory::Type<TC3>();
+
+  gazebo::ecs::EntityQuery uut;
+  EXPECT_TRUE(uut.AddComponent<TC1>());
+  EXPECT_TRUE(uut.Without<TC2>());
+  EXPECT_TRUE(uut.Optional("TC3"));
+
+  // Only required components are in the mask
+  EXPECT_EQ(1u, uut.Mask().count());
+  EXPECT_TRUE(uut.Mask().test(tc1));
+  EXPECT_EQ(1u, uut.ExcludedMask().count());
+  EXPECT_TRUE(uut.ExcludedMask().test(tc2));
+  ASSERT_EQ(1u, uut.OptionalTypes().size());
+  EXPECT_EQ(tc3, *uut.OptionalTypes().begin());
+
+  // A component can't be both required and excluded
+  EXPECT_FALSE(uut.Without<TC1>());
+  EXPECT_FALSE(uut.AddComponent<TC2>());
+  EXPECT_FALSE(uut.Optional<TC2>());
+  EXPECT_FALSE(uut.Without("NotAComponent"));
+  EXPECT_FALSE(uut.Optional("NotAComponent"));
+
+  // Optional components that become required are no longer optional
+  EXPECT_TRUE(uut.AddComponent<TC3>());
+  EXPECT_TRUE(uut.OptionalTypes().empty());
+  EXPECT_EQ(2u, uut.ComponentTypes().size());
+
+  // Queries with different terms are different
+  gazebo::ecs::EntityQuery other;
+  other.AddComponent<TC1>();
+  other.AddComponent<TC3>();
+  EXPECT_FALSE(other == uut);
+  other.Without<TC2>();
+  EXPECT_TRUE(other == uut);
+}
+
 /////////////////////////////////////////////////
 TEST(EntityQuery, UnequalQueries)
 {
@@ -92,6 +151,24 @@ TEST(EntityQuery, UnequalQueries)
   EXPECT_TRUE(uut2 == gazebo::ecs::EntityQueryNull);
 }
 
+/////////////////////////////////////////////////
+TEST(EntityQuery, EqualityIgnoresResults)
+{
+  gazebo::ecs::EntityQuery uut;
+  uut.AddComponent("TC1");
+  uut.Optional("TC2");
+  gazebo::ecs::EntityQuery uut2;
+  uut2.Optional("TC2");
+  uut2.AddComponent("TC1");
+  uut2.AddEntity(1);
+
+  EXPECT_TRUE(uut == uut2);
+  EXPECT_EQ(uut.Hash(), uut2.Hash());
+
+  uut2.Reactive(true);
+  EXPECT_FALSE(uut == uut2);
+}
+
 /////////////////////////////////////////////////
 TEST(EntityQuery, InitiallyNoResults)
 {
@@ -16,10 +16,21 @@
 */
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 #include <gtest/gtest.h>
+#include "gazebo/components/Geometry.hh"
+#include "gazebo/components/WorldPose.hh"
 #include "gazebo/ecs/ComponentFactory.hh"
 #include "gazebo/ecs/EntityQuery.hh"
 #include "gazebo/ecs/Manager.hh"
+#include "gazebo/ecs/SpatialIndex.hh"
 
 namespace gzecs = gazebo::ecs;
 
@@ -51,6 +62,9 @@ class TestHookSystem : public gzecs::System
   /// \brief String that's set on update
   public: std::string sentinel;
 
+  /// \brief Results passed to the last update
+  public: const gzecs::EntityQuery *result = nullptr;
+
   public: virtual void Init(gzecs::QueryRegistrar &_registrar)
     {
       gzecs::EntityQuery q;
@@ -63,7 +77,163 @@ class TestHookSystem : public gzecs::System
   public: void Update(const gzecs::EntityQuery &_result)
     {
       this->sentinel = "Update Ran";
+      this->result = &_result;
+    }
+};
+
+/////////////////////////////////////////////////
+class TickSystem : public gzecs::System
+{
+  /// \brief Number of updates
+  public: int updates = 0;
+
+  /// \brief Update that takes 50 ms, none if negative
+  public: int slowUpdate = -1;
+
+  public: virtual void Init(gzecs::QueryRegistrar &_registrar)
+    {
+      gzecs::EntityQuery q;
+      _registrar.Register(q, std::bind(&TickSystem::Update, this,
+            std::placeholders::_1));
+    }
+
+  public: void Update(const gzecs::EntityQuery &/*_result*/)
+    {
+      if (this->updates++ == this->slowUpdate)
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      gzecs::Manager &mgr = this->Manager();
+      mgr.SimulationTime(mgr.SimulationTime() +
+          ignition::common::Time(0, 1000000));
+    }
+};
+
+/////////////////////////////////////////////////
+class ParallelSystem : public gzecs::System
+{
+  /// \brief Number of entities visited last update
+  public: std::atomic<int> visited{0};
+
+  /// \brief Threads that visited entities
+  public: std::set<std::thread::id> threads;
+
+  /// \brief Protects threads
+  public: std::mutex mtx;
+
+  public: virtual void Init(gzecs::QueryRegistrar &_registrar)
+    {
+      gzecs::EntityQuery q;
+      q.AddComponent("TC1");
+      _registrar.Register(q, std::bind(&ParallelSystem::Update, this,
+            std::placeholders::_1));
+    }
+
+  public: void Update(const gzecs::EntityQuery &_result)
+    {
+      gzecs::Manager &mgr = this->Manager();
+      this->visited = 0;
+      auto const &ids = _result.EntityIds();
+      mgr.ParallelForEach(_result, [&](std::size_t _index)
+        {
+          auto *tc1 = mgr.Entity(ids[_index]).ComponentMutable<TC1>();
+          tc1->itemOne += 1;
+          ++this->visited;
+          std::lock_guard<std::mutex> lock(this->mtx);
+          this->threads.insert(std::this_thread::get_id());
+        });
+    }
+};
+
+/////////////////////////////////////////////////
+class TypedSystem : public gzecs::System
+{
+  /// \brief Sum of TC1 and TC2 items last update
+  public: float sum = 0;
+
+  /// \brief Entities with TC1 last update
+  public: int visited = 0;
+
+  public: virtual void Init(gzecs::QueryRegistrar &_registrar)
+    {
+      _registrar.Register<TC1, TC2>([this](gzecs::EntityId _id,
+            const TC1 &_tc1, const TC2 &_tc2)
+        {
+          this->sum += _tc1.itemOne + _tc2.itemTwo;
+        });
+      _registrar.RegisterMutable<TC1>([this](gzecs::EntityId _id, TC1 &_tc1)
+        {
+          _tc1.itemOne += 1;
+          ++this->visited;
+        });
+    }
+};
+
+/////////////////////////////////////////////////
+/// \brief What scheduled systems did in an update
+struct Schedule
+{
+  /// \brief protects order
+  std::mutex mtx;
+
+  /// \brief names of systems in the order they finished
+  std::vector<std::string> order;
+
+  /// \brief number of systems running
+  std::atomic<int> running{0};
+
+  /// \brief most systems running at once
+  std::atomic<int> mostRunning{0};
+};
+
+/////////////////////////////////////////////////
+class ScheduledSystem : public gzecs::System
+{
+  /// \brief Constructor
+  /// \param[in] _name name recorded in the schedule
+  /// \param[in] _schedule schedule to record in
+  /// \param[in] _declare declares what the system accesses
+  /// \param[in] _ms milliseconds an update takes
+  public: ScheduledSystem(const std::string &_name, Schedule *_schedule,
+              std::function<void(gzecs::QueryRegistrar &)> _declare, int _ms)
+          : name(_name), schedule(_schedule), declare(_declare), ms(_ms)
+    {
     }
+
+  public: virtual void Init(gzecs::QueryRegistrar &_registrar)
+    {
+      this->declare(_registrar);
+      gzecs::EntityQuery q;
+      q.AddComponent("TC1");
+      _registrar.Register(q, std::bind(&ScheduledSystem::Update, this,
+            std::placeholders::_1));
+    }
+
+  public: void Update(const gzecs::EntityQuery &_result)
+    {
+      int running = ++this->schedule->running;
+      int most = this->schedule->mostRunning;
+      while (running > most &&
+          !this->schedule->mostRunning.compare_exchange_weak(most, running))
+      {
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(this->ms));
+      {
+        std::lock_guard<std::mutex> lock(this->schedule->mtx);
+        this->schedule->order.push_back(this->name);
+      }
+      --this->schedule->running;
+    }
+
+  /// \brief name recorded in the schedule
+  private: std::string name;
+
+  /// \brief schedule to record in
+  private: Schedule *schedule;
+
+  /// \brief declares what the system accesses
+  private: std::function<void(gzecs::QueryRegistrar &)> declare;
+
+  /// \brief milliseconds an update takes
+  private: int ms;
 };
 
 /////////////////////////////////////////////////
@@ -124,6 +294,221 @@ TEST(Manager, LoadSystem)
   EXPECT_EQ(std::string("Update Ran"), raw->sentinel);
 }
 
+/////////////////////////////////////////////////
+TEST(Manager, SystemsShareQueryResults)
+{
+  gzecs::Manager mgr;
+  TestHookSystem *first = new TestHookSystem;
+  TestHookSystem *second = new TestHookSystem;
+  mgr.LoadSystem("First", std::unique_ptr<gzecs::System>(first));
+  mgr.LoadSystem("Second", std::unique_ptr<gzecs::System>(second));
+
+  mgr.UpdateOnce();
+  ASSERT_NE(nullptr, first->result);
+  EXPECT_EQ(first->result, second->result);
+
+  // Callbacks are handed the database's results, not a copy
+  const gzecs::EntityQuery *results = first->result;
+  mgr.UpdateOnce();
+  EXPECT_EQ(results, first->result);
+  EXPECT_EQ(results, second->result);
+}
+
+/////////////////////////////////////////////////
+TEST(Manager, ConflictingSystemsRunInLoadOrder)
+{
+  gzecs::Manager mgr;
+  Schedule schedule;
+  // The first writer takes longer, so without ordering the second
+  // finishes first
+  mgr.LoadSystem("Writer", std::unique_ptr<gzecs::System>(
+        new ScheduledSystem("writer", &schedule,
+          [](gzecs::QueryRegistrar &_r) {_r.Writes<TC1>();}, 20)));
+  mgr.LoadSystem("Other writer", std::unique_ptr<gzecs::System>(
+        new ScheduledSystem("other writer", &schedule,
+          [](gzecs::QueryRegistrar &_r)
+          {
+            _r.Reads<TC2>();
+            _r.Writes<TC1>();
+          }, 0)));
+
+  mgr.UpdateOnce();
+  mgr.UpdateOnce();
+  EXPECT_EQ(std::vector<std::string>({"writer", "other writer", "writer",
+        "other writer"}), schedule.order);
+  EXPECT_EQ(1, schedule.mostRunning);
+}
+
+/////////////////////////////////////////////////
+TEST(Manager, ReadersDontWaitForWriters)
+{
+  gzecs::Manager mgr(1);
+  Schedule schedule;
+  mgr.LoadSystem("Writer", std::unique_ptr<gzecs::System>(
+        new ScheduledSystem("writer", &schedule,
+          [](gzecs::QueryRegistrar &_r) {_r.Writes<TC1>();}, 50)));
+  mgr.LoadSystem("Reader", std::unique_ptr<gzecs::System>(
+        new ScheduledSystem("reader", &schedule,
+          [](gzecs::QueryRegistrar &_r) {_r.Reads<TC1>();}, 0)));
+  mgr.LoadSystem("Nothing", std::unique_ptr<gzecs::System>(
+        new ScheduledSystem("nothing", &schedule,
+          [](gzecs::QueryRegistrar &_r) {_r.DeclareNone();}, 0)));
+
+  // The writer's modifications only show next update either way, so the
+  // others finish while it's still running
+  mgr.UpdateOnce();
+  ASSERT_EQ(3u, schedule.order.size());
+  EXPECT_EQ("writer", schedule.order.back());
+}
+
+/////////////////////////////////////////////////
+TEST(Manager, UndeclaredSystemsRunAlone)
+{
+  gzecs::Manager mgr;
+  Schedule schedule;
+  mgr.LoadSystem("Undeclared", std::unique_ptr<gzecs::System>(
+        new ScheduledSystem("undeclared", &schedule,
+          [](gzecs::QueryRegistrar &) {}, 20)));
+  mgr.LoadSystem("Reader", std::unique_ptr<gzecs::System>(
+        new ScheduledSystem("reader", &schedule,
+          [](gzecs::QueryRegistrar &_r) {_r.Reads<TC1>();}, 0)));
+  mgr.LoadSystem("Other reader", std::unique_ptr<gzecs::System>(
+        new ScheduledSystem("other reader", &schedule,
+          [](gzecs::QueryRegistrar &_r) {_r.Reads<TC2>();}, 0)));
+
+  mgr.UpdateOnce();
+  ASSERT_EQ(3u, schedule.order.size());
+  EXPECT_EQ("undeclared", schedule.order[0]);
+}
+
+/////////////////////////////////////////////////
+TEST(Manager, TypedRegistrationDoesNotDeclare)
+{
+  gzecs::Manager mgr;
+  Schedule schedule;
+  // Registers for TC1 only, but could modify TC2 through Entity
+  mgr.LoadSystem("Typed", std::unique_ptr<gzecs::System>(
+        new ScheduledSystem("typed", &schedule,
+          [](gzecs::QueryRegistrar &_r)
+          {
+            _r.Register<TC1>([](gzecs::EntityId, const TC1 &) {});
+          }, 20)));
+  mgr.LoadSystem("Writer", std::unique_ptr<gzecs::System>(
+        new ScheduledSystem("writer", &schedule,
+          [](gzecs::QueryRegistrar &_r) {_r.Writes<TC2>();}, 0)));
+
+  mgr.UpdateOnce();
+  EXPECT_EQ(std::vector<std::string>({"typed", "writer"}), schedule.order);
+  EXPECT_EQ(1, schedule.mostRunning);
+}
+
+/////////////////////////////////////////////////
+TEST(Manager, SpatialIndex)
+{
+  gzecs::Manager mgr;
+  EXPECT_EQ(nullptr, mgr.SpatialIndex());
+  EXPECT_FALSE(mgr.EnableSpatialIndex(0));
+  EXPECT_TRUE(mgr.EnableSpatialIndex(1));
+  EXPECT_FALSE(mgr.EnableSpatialIndex(2));
+  const gzecs::SpatialIndex *index = mgr.SpatialIndex();
+  ASSERT_NE(nullptr, index);
+
+  gzecs::EntityId id = mgr.CreateEntity();
+  gzecs::Entity &entity = mgr.Entity(id);
+  entity.AddComponent<gazebo::components::WorldPose>()->position.X(3);
+  auto geom = entity.AddComponent<gazebo::components::Geometry>();
+  geom->type = gazebo::components::Geometry::SPHERE;
+  geom->sphere.radius = 0.5;
+
+  // Indexed before systems run in the update that adds the components
+  mgr.UpdateOnce();
+  EXPECT_EQ(std::vector<gzecs::EntityId>({id}),
+      index->Within(ignition::math::Vector3d(2, 0, 0), 0.6));
+
+  mgr.Entity(id).ComponentMutable<gazebo::components::WorldPose>()
+    ->position.X(-3);
+  mgr.UpdateOnce();
+  EXPECT_TRUE(index->Within(ignition::math::Vector3d(2, 0, 0), 0.6).empty());
+  EXPECT_EQ(std::vector<gzecs::EntityId>({id}),
+      index->Nearest(ignition::math::Vector3d(0, 0, 0), 1));
+}
+
+/////////////////////////////////////////////////
+TEST(Manager, ParallelForEach)
+{
+  gzecs::Manager mgr;
+  ParallelSystem *raw = new ParallelSystem;
+  std::unique_ptr<gzecs::System> sys(dynamic_cast<gzecs::System*>(raw));
+  mgr.LoadSystem("Parallel system", std::move(sys));
+
+  const int numEntities = 10000;
+  auto batch = mgr.CreateEntities<TC1>(numEntities);
+  auto tc1s = batch.Components<TC1>();
+  for (int i = 0; i < numEntities; ++i)
+    tc1s[i].itemOne = i;
+  std::vector<gzecs::EntityId> ids;
+  for (int i = 0; i < numEntities; ++i)
+    ids.push_back(batch.Id(i));
+
+  // Many chunks, each of them visited once
+  gzecs::EntityQuery q;
+  q.AddComponent("TC1");
+  ASSERT_LT(q.ChunkSize(), static_cast<std::size_t>(numEntities / 4));
+
+  mgr.UpdateOnce();
+  EXPECT_EQ(numEntities, raw->visited);
+  mgr.UpdateOnce();
+  EXPECT_EQ(numEntities, raw->visited);
+  for (int i = 0; i < numEntities; ++i)
+  {
+    ASSERT_EQ(i + 1, mgr.Entity(ids[i]).Component<TC1>()->itemOne);
+  }
+
+  // The system itself runs on a worker, which must not wait for workers
+  EXPECT_FALSE(raw->threads.empty());
+}
+
+/////////////////////////////////////////////////
+TEST(Manager, NoWorkerThreads)
+{
+  gzecs::Manager mgr(0);
+  EXPECT_EQ(0u, mgr.Scheduler().ThreadCount());
+  ParallelSystem *raw = new ParallelSystem;
+  mgr.LoadSystem("Parallel system", std::unique_ptr<gzecs::System>(raw));
+  mgr.CreateEntities<TC1>(1000);
+
+  // Systems and their tasks run on the thread updating the manager
+  mgr.UpdateOnce();
+  EXPECT_EQ(1000, raw->visited);
+  EXPECT_EQ(std::set<std::thread::id>({std::this_thread::get_id()}),
+      raw->threads);
+}
+
+/////////////////////////////////////////////////
+TEST(Manager, TypedCallbacks)
+{
+  gzecs::Manager mgr;
+  TypedSystem *raw = new TypedSystem;
+  std::unique_ptr<gzecs::System> sys(dynamic_cast<gzecs::System*>(raw));
+  mgr.LoadSystem("Typed system", std::move(sys));
+
+  auto both = mgr.CreateEntities<TC1, TC2>(10);
+  for (std::size_t i = 0; i < both.Size(); ++i)
+  {
+    both.Components<TC1>()[i].itemOne = 1;
+    both.Components<TC2>()[i].itemTwo = 2;
+  }
+  mgr.CreateEntities<TC1>(5);
+  mgr.UpdateOnce();
+  EXPECT_FLOAT_EQ(30, raw->sum);
+  EXPECT_EQ(15, raw->visited);
+
+  // Modified components were committed
+  raw->sum = 0;
+  mgr.UpdateOnce();
+  EXPECT_FLOAT_EQ(40, raw->sum);
+}
+
 /////////////////////////////////////////////////
 TEST(Manager, LoadComponentizer)
 {
@@ -180,6 +565,227 @@ TEST(Manager, PauseUnpause)
   EXPECT_FALSE(mgr.Paused());
 }
 
+/////////////////////////////////////////////////
+TEST(Manager, Step)
+{
+  gzecs::Manager mgr;
+  TickSystem *tick = new TickSystem;
+  mgr.LoadSystem("Tick", std::unique_ptr<gzecs::System>(tick));
+
+  mgr.Step(0);
+  EXPECT_EQ(0, tick->updates);
+
+  mgr.Step(1500);
+  EXPECT_EQ(1500, tick->updates);
+  ignition::common::Time simTime = mgr.SimulationTime();
+  EXPECT_EQ(1, simTime.sec);
+  EXPECT_EQ(500000000, simTime.nsec);
+
+  mgr.UpdateOnce();
+  EXPECT_EQ(1501, tick->updates);
+}
+
+/////////////////////////////////////////////////
+TEST(Manager, RealTimeFactor)
+{
+  gzecs::Manager mgr;
+  TickSystem *tick = new TickSystem;
+  mgr.LoadSystem("Tick", std::unique_ptr<gzecs::System>(tick));
+
+  // 1 ms of sim time per update, at half speed
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 100; ++i)
+    mgr.UpdateOnce(0.5);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_GE(elapsed, std::chrono::milliseconds(199));
+  EXPECT_LT(elapsed, std::chrono::seconds(1));
+
+  // A slow update is made up by the ones after it returning without
+  // sleeping, instead of each taking its 1 ms
+  tick->slowUpdate = tick->updates + 10;
+  std::chrono::steady_clock::duration afterSlow(0);
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 200; ++i)
+  {
+    auto updateStart = std::chrono::steady_clock::now();
+    mgr.UpdateOnce(1.0);
+    if (i > 10 && i <= 50)
+      afterSlow += std::chrono::steady_clock::now() - updateStart;
+  }
+  elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_GE(elapsed, std::chrono::milliseconds(199));
+  EXPECT_LT(afterSlow, std::chrono::milliseconds(40));
+
+  // No sleeping
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 100; ++i)
+    mgr.UpdateOnce(0);
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+      std::chrono::milliseconds(50));
+}
+
+/////////////////////////////////////////////////
+TEST(Manager, PacingRestartsAfterUnpacedUpdates)
+{
+  gzecs::Manager mgr;
+  mgr.LoadSystem("Tick", std::unique_ptr<gzecs::System>(new TickSystem));
+
+  // Seconds of sim time pass without pacing, the next paced update
+  // doesn't wait for the wall clock to catch up
+  mgr.UpdateOnce(1.0);
+  mgr.Step(5000);
+  auto start = std::chrono::steady_clock::now();
+  mgr.UpdateOnce(1.0);
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+      std::chrono::seconds(1));
+
+  for (int i = 0; i < 5000; ++i)
+    mgr.UpdateOnce();
+  start = std::chrono::steady_clock::now();
+  mgr.UpdateOnce(1.0);
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+      std::chrono::seconds(1));
+
+  // Same when sim time is set forward
+  gzecs::Manager jump;
+  jump.UpdateOnce(1.0);
+  jump.SimulationTime(jump.SimulationTime() +
+      ignition::common::Time(100, 0));
+  start = std::chrono::steady_clock::now();
+  jump.UpdateOnce(1.0);
+  jump.UpdateOnce(1.0);
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+      std::chrono::seconds(1));
+  EXPECT_EQ(100, jump.SimulationTime().sec);
+}
+
+/////////////////////////////////////////////////
+TEST(Manager, Pipelined)
+{
+  gzecs::Manager mgr;
+  EXPECT_FALSE(mgr.Pipelined());
+  mgr.Pipelined(true);
+  EXPECT_TRUE(mgr.Pipelined());
+
+  auto batch = mgr.CreateEntities<TC1, TC2>(1000);
+  for (std::size_t i = 0; i < batch.Size(); ++i)
+  {
+    batch.Components<TC1>()[i].itemOne = 0;
+    batch.Components<TC2>()[i].itemTwo = 0;
+  }
+  // The batch can't be used after the next update
+  const gzecs::EntityId first = batch.Id(0);
+
+  // Every update one system increments TC1 and TC2, the others check
+  // they see the values the update before left
+  struct Counts
+  {
+    public: std::atomic<int> badTC1{0};
+    public: std::atomic<int> badTC2{0};
+    public: int expected = 0;
+  };
+  Counts counts;
+  auto increment = [](gzecs::QueryRegistrar &_registrar)
+  {
+    _registrar.RegisterMutable<TC1, TC2>(
+        [](gzecs::EntityId, TC1 &_tc1, TC2 &_tc2)
+        {
+          _tc1.itemOne += 1;
+          _tc2.itemTwo += 1;
+        });
+  };
+  auto checkTC1 = [&counts](gzecs::QueryRegistrar &_registrar)
+  {
+    _registrar.Register<TC1>([&counts](gzecs::EntityId, const TC1 &_tc1)
+        {
+          if (_tc1.itemOne != counts.expected)
+            ++counts.badTC1;
+        });
+  };
+  auto checkTC2 = [&counts](gzecs::QueryRegistrar &_registrar)
+  {
+    _registrar.Register<TC2>([&counts](gzecs::EntityId, const TC2 &_tc2)
+        {
+          if (_tc2.itemTwo != counts.expected)
+            ++counts.badTC2;
+        });
+  };
+  Schedule schedule;
+  mgr.LoadSystem("checkTC1", std::unique_ptr<gzecs::System>(
+        new ScheduledSystem("checkTC1", &schedule, checkTC1, 0)));
+  mgr.LoadSystem("increment", std::unique_ptr<gzecs::System>(
+        new ScheduledSystem("increment", &schedule, increment, 0)));
+  mgr.LoadSystem("checkTC2", std::unique_ptr<gzecs::System>(
+        new ScheduledSystem("checkTC2", &schedule, checkTC2, 0)));
+
+  for (; counts.expected < 20; ++counts.expected)
+    mgr.UpdateOnce();
+  EXPECT_EQ(0, counts.badTC1);
+  EXPECT_EQ(0, counts.badTC2);
+
+  // Turning it off again doesn't lose modifications
+  mgr.Pipelined(false);
+  mgr.UpdateOnce();
+  EXPECT_EQ(0, counts.badTC1);
+  EXPECT_EQ(0, counts.badTC2);
+  EXPECT_FLOAT_EQ(20, mgr.Entity(first).Component<TC1>()->itemOne);
+}
+
+/////////////////////////////////////////////////
+TEST(Manager, MultiRate)
+{
+  gzecs::Manager mgr;
+  Schedule schedule;
+  auto every = [](unsigned int _steps)
+    -> std::function<void(gzecs::QueryRegistrar &)>
+  {
+    return [_steps](gzecs::QueryRegistrar &_registrar)
+      {
+        _registrar.Writes<TC1>();
+        _registrar.UpdateEvery(_steps);
+      };
+  };
+  for (auto const &name : {"a", "b", "c", "d"})
+  {
+    const unsigned int steps = name[0] == 'a' ? 1 : name[0] == 'd' ? 4 : 2;
+    mgr.LoadSystem(name, std::unique_ptr<gzecs::System>(
+          new ScheduledSystem(name, &schedule, every(steps), 0)));
+  }
+
+  // Systems with the same period update on different steps, and the ones
+  // skipped don't hold up the ones after them
+  std::vector<std::vector<std::string> > expected = {
+    {"a", "b", "d"}, {"a", "c"}, {"a", "b"}, {"a", "c"}, {"a", "b", "d"}};
+  for (auto const &names : expected)
+  {
+    schedule.order.clear();
+    mgr.UpdateOnce();
+    EXPECT_EQ(names, schedule.order);
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(Manager, UpdateRate)
+{
+  gzecs::Manager mgr;
+  mgr.LoadSystem("Tick", std::unique_ptr<gzecs::System>(new TickSystem));
+  Schedule schedule;
+  auto rate = [](gzecs::QueryRegistrar &_registrar)
+  {
+    _registrar.Reads<TC2>();
+    _registrar.UpdateRate(250);
+  };
+  mgr.LoadSystem("250Hz", std::unique_ptr<gzecs::System>(
+        new ScheduledSystem("250Hz", &schedule, rate, 0)));
+
+  // Every update until the step is known to be 1 ms
+  mgr.UpdateOnce();
+  EXPECT_EQ(1u, schedule.order.size());
+
+  mgr.Step(400);
+  EXPECT_EQ(101u, schedule.order.size());
+}
+
 /////////////////////////////////////////////////
 TEST(Manager, InitialTimeZero)
 {
@@ -241,6 +847,10 @@ int main(int argc, char **argv)
   gazebo::ecs::ComponentFactory::Register<TC1>("TC1");
   gazebo::ecs::ComponentFactory::Register<TC2>("TC2");
   gazebo::ecs::ComponentFactory::Register<TC3>("TC3");
+  gazebo::ecs::ComponentFactory::Register<gazebo::components::WorldPose>(
+      "gazebo::components::WorldPose");
+  gazebo::ecs::ComponentFactory::Register<gazebo::components::Geometry>(
+      "gazebo::components::Geometry");
 
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
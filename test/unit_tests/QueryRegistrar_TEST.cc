@@ -38,6 +38,12 @@ struct TC3
   double itemThree;
 };
 
+/// \brief Never registered
+struct TC4
+{
+  int itemOne;
+};
+
 /////////////////////////////////////////////////
 TEST(QueryRegistrar, InitiallyNoRegistrations)
 {
@@ -90,6 +96,81 @@ TEST(QueryRegistrar, QueryOrderIsPreserved)
   EXPECT_EQ(std::string("second callback"), sentinel);
 }
 
+/////////////////////////////////////////////////
+TEST(QueryRegistrar, RegisterByType)
+{
+  gazebo::ecs::QueryRegistrar r;
+  EXPECT_TRUE((r.Register<TC1, TC3>(
+      [](gazebo::ecs::EntityId, const TC1 &, const TC3 &) {})));
+  ASSERT_EQ(1u, r.Registrations().size());
+
+  gazebo::ecs::EntityQuery q = r.Registrations()[0].first;
+  EXPECT_EQ(2u, q.Mask().count());
+  EXPECT_TRUE(q.Mask().test(gazebo::ecs::ComponentFactory::Type<TC1>()));
+  EXPECT_TRUE(q.Mask().test(gazebo::ecs::ComponentFactory::Type<TC3>()));
+
+  // No results, no calls
+  (r.Registrations()[0].second)(q);
+
+  // Types must be registered
+  EXPECT_FALSE((r.Register<TC1, TC4>(
+      [](gazebo::ecs::EntityId, const TC1 &, const TC4 &) {})));
+
+  EXPECT_TRUE(r.RegisterMutable<TC1>([](gazebo::ecs::EntityId, TC1 &) {}));
+  EXPECT_EQ(2u, r.Registrations().size());
+  EXPECT_TRUE(r.WriteMask().test(gazebo::ecs::ComponentFactory::Type<TC1>()));
+}
+
+/////////////////////////////////////////////////
+TEST(QueryRegistrar, DeclareAccess)
+{
+  gazebo::ecs::QueryRegistrar r;
+  EXPECT_FALSE(r.Declared());
+  EXPECT_FALSE(r.Reads(gazebo::ecs::NO_COMPONENT));
+  EXPECT_FALSE(r.Declared());
+
+  // Typed callbacks record what they read, but their systems may access
+  // more, so they don't declare
+  EXPECT_TRUE(r.Register<TC1>([](gazebo::ecs::EntityId, const TC1 &) {}));
+  EXPECT_FALSE(r.Declared());
+  EXPECT_TRUE(r.Writes<TC2>());
+  EXPECT_TRUE(r.Declared());
+
+  auto tc1 = gazebo::ecs::ComponentFactory::Type<TC1>();
+  auto tc2 = gazebo::ecs::ComponentFactory::Type<TC2>();
+  EXPECT_TRUE(r.ReadMask().test(tc1));
+  EXPECT_FALSE(r.ReadMask().test(tc2));
+  EXPECT_FALSE(r.WriteMask().test(tc1));
+  EXPECT_TRUE(r.WriteMask().test(tc2));
+
+  // Systems can declare they access nothing
+  gazebo::ecs::QueryRegistrar none;
+  none.DeclareNone();
+  EXPECT_TRUE(none.Declared());
+  EXPECT_TRUE(none.ReadMask().none());
+  EXPECT_TRUE(none.WriteMask().none());
+}
+
+/////////////////////////////////////////////////
+TEST(QueryRegistrar, DeclareRate)
+{
+  gazebo::ecs::QueryRegistrar r;
+  EXPECT_EQ(1u, r.UpdateEvery());
+  EXPECT_DOUBLE_EQ(0, r.UpdateRate());
+
+  EXPECT_FALSE(r.UpdateEvery(0));
+  EXPECT_TRUE(r.UpdateEvery(4));
+  EXPECT_EQ(4u, r.UpdateEvery());
+
+  // The last declaration wins
+  EXPECT_FALSE(r.UpdateRate(0));
+  EXPECT_TRUE(r.UpdateRate(30));
+  EXPECT_EQ(1u, r.UpdateEvery());
+  EXPECT_DOUBLE_EQ(30, r.UpdateRate());
+  EXPECT_TRUE(r.UpdateEvery(2));
+  EXPECT_DOUBLE_EQ(0, r.UpdateRate());
+}
+
 int main(int argc, char **argv)
 {
   // Register types with the factory
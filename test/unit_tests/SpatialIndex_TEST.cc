@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2017 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <algorithm>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "gazebo/components/Geometry.hh"
+#include "gazebo/components/WorldPose.hh"
+#include "gazebo/ecs/ComponentFactory.hh"
+#include "gazebo/ecs/EntityComponentDatabase.hh"
+#include "gazebo/ecs/EntityQuery.hh"
+#include "gazebo/ecs/SpatialIndex.hh"
+
+namespace gzecs = gazebo::ecs;
+typedef std::vector<gzecs::EntityId> Ids;
+typedef ignition::math::Vector3d V3;
+
+/////////////////////////////////////////////////
+TEST(SpatialIndex, SetAndRemove)
+{
+  gzecs::SpatialIndex uut(1.0);
+  EXPECT_DOUBLE_EQ(1.0, uut.CellSize());
+  EXPECT_EQ(0u, uut.Size());
+
+  uut.Set(1, V3(0, 0, 0), 0.5);
+  uut.Set(2, V3(5, 0, 0), 0.5);
+  EXPECT_EQ(2u, uut.Size());
+  EXPECT_EQ(Ids({1}), uut.Within(V3(0, 0, 0), 1.0));
+
+  // Moving an entity to another cell
+  uut.Set(1, V3(5, 1, 0), 0.5);
+  EXPECT_EQ(2u, uut.Size());
+  EXPECT_TRUE(uut.Within(V3(0, 0, 0), 1.0).empty());
+  EXPECT_EQ(Ids({1, 2}), uut.Within(V3(5, 0.5, 0), 0.1));
+
+  EXPECT_TRUE(uut.Remove(2));
+  EXPECT_FALSE(uut.Remove(2));
+  EXPECT_EQ(1u, uut.Size());
+  EXPECT_EQ(Ids({1}), uut.Within(V3(5, 0.5, 0), 0.1));
+}
+
+/////////////////////////////////////////////////
+TEST(SpatialIndex, Within)
+{
+  gzecs::SpatialIndex uut(1.0);
+  uut.Set(1, V3(0, 0, 0), 0.1);
+  uut.Set(2, V3(2, 0, 0), 0.1);
+  uut.Set(3, V3(-2.5, 0, 0), 1.0);
+  // Larger than a cell
+  uut.Set(4, V3(0, 20, 0), 19.5);
+  uut.Set(5, V3(100, 100, 100), 0.1);
+
+  // Touching the bounds is enough
+  EXPECT_EQ(Ids({1, 3, 4}), uut.Within(V3(0, 0, 0), 1.5));
+  EXPECT_EQ(Ids({1, 4}), uut.Within(V3(0, 0, 0), 0.5));
+  EXPECT_EQ(Ids({2}), uut.Within(V3(2.15, 0, 0), 0.1));
+  EXPECT_TRUE(uut.Within(V3(2.5, 0, 0), 0.1).empty());
+
+  // A radius covering more cells than are used
+  EXPECT_EQ(Ids({1, 2, 3, 4, 5}), uut.Within(V3(0, 0, 0), 1000));
+}
+
+/////////////////////////////////////////////////
+TEST(SpatialIndex, Nearest)
+{
+  gzecs::SpatialIndex uut(1.0);
+  EXPECT_TRUE(uut.Nearest(V3(0, 0, 0), 3).empty());
+
+  for (int i = 0; i < 10; ++i)
+    uut.Set(i, V3(i * 1.5, 0, 0), 0.25);
+  uut.Set(10, V3(-50, 0, 0), 40);
+
+  EXPECT_EQ(Ids({0}), uut.Nearest(V3(-0.1, 0, 0), 1));
+  EXPECT_EQ(Ids({4, 5, 3}), uut.Nearest(V3(6.5, 0, 0), 3));
+  // Distance is to the bounds
+  EXPECT_EQ(Ids({10, 0}), uut.Nearest(V3(-9, 0, 0), 2));
+  // Far away from everything
+  EXPECT_EQ(Ids({9, 8}), uut.Nearest(V3(500, 0, 0), 2));
+  EXPECT_EQ(11u, uut.Nearest(V3(0, 0, 0), 20).size());
+  EXPECT_TRUE(uut.Nearest(V3(0, 0, 0), 0).empty());
+}
+
+/////////////////////////////////////////////////
+TEST(SpatialIndex, Raycast)
+{
+  gzecs::SpatialIndex uut(1.0);
+  uut.Set(1, V3(3, 0, 0), 0.5);
+  uut.Set(2, V3(6, 0.4, 0), 0.5);
+  uut.Set(3, V3(6, 3, 0), 0.5);
+  uut.Set(4, V3(-3, 0, 0), 0.5);
+  uut.Set(5, V3(50, 0, 0), 10);
+
+  auto hits = uut.Raycast(V3(0, 0, 0), V3(2, 0, 0), 100);
+  ASSERT_EQ(3u, hits.size());
+  EXPECT_EQ(1, hits[0].id);
+  EXPECT_NEAR(2.5, hits[0].distance, 1e-9);
+  EXPECT_EQ(2, hits[1].id);
+  EXPECT_EQ(5, hits[2].id);
+  EXPECT_NEAR(40, hits[2].distance, 1e-9);
+
+  // Limited distance
+  hits = uut.Raycast(V3(0, 0, 0), V3(1, 0, 0), 5.8);
+  ASSERT_EQ(2u, hits.size());
+  EXPECT_EQ(1, hits[0].id);
+  EXPECT_EQ(2, hits[1].id);
+
+  // Diagonal
+  hits = uut.Raycast(V3(0, 0, 0), V3(2, 1, 0), 100);
+  ASSERT_EQ(1u, hits.size());
+  EXPECT_EQ(3, hits[0].id);
+
+  // Starting inside
+  hits = uut.Raycast(V3(-3.1, 0, 0), V3(0, 0, 1), 100);
+  ASSERT_EQ(1u, hits.size());
+  EXPECT_EQ(4, hits[0].id);
+  EXPECT_DOUBLE_EQ(0, hits[0].distance);
+
+  // Starting outside the grid pointing away
+  EXPECT_TRUE(uut.Raycast(V3(-100, 0, 0), V3(-1, 0, 0), 1000).empty());
+}
+
+/////////////////////////////////////////////////
+TEST(SpatialIndex, UpdateFromQuery)
+{
+  gzecs::EntityComponentDatabase db;
+  auto addSphere = [&db](const V3 &_position, double _radius)
+  {
+    gzecs::EntityId id = db.CreateEntity();
+    db.AddComponent<gazebo::components::WorldPose>(id)->position = _position;
+    auto geom = db.AddComponent<gazebo::components::Geometry>(id);
+    geom->type = gazebo::components::Geometry::SPHERE;
+    geom->sphere.radius = _radius;
+    return id;
+  };
+  gzecs::EntityId near = addSphere(V3(0, 0, 0), 0.5);
+  gzecs::EntityId far = addSphere(V3(10, 0, 0), 0.5);
+  // Without a geometry
+  gzecs::EntityId pointId = db.CreateEntity();
+  db.AddComponent<gazebo::components::WorldPose>(pointId);
+  db.Update();
+
+  gzecs::EntityQuery query;
+  query.AddComponent<gazebo::components::WorldPose>();
+  query.AddComponent<gazebo::components::Geometry>();
+  query.Reactive(true);
+  auto queryId = db.AddQuery(query).first;
+  db.Update();
+
+  gzecs::SpatialIndex uut(1.0);
+  uut.Update(db.Query(queryId));
+  EXPECT_EQ(2u, uut.Size());
+  EXPECT_EQ(Ids({near}), uut.Within(V3(0, 0, 0), 1));
+
+  // Moving, adding and deleting
+  db.EntityComponentMutable<gazebo::components::WorldPose>(far)->position =
+    V3(1, 0, 0);
+  gzecs::EntityId added = addSphere(V3(-1, 0, 0), 0.5);
+  db.DeleteEntity(near);
+  db.Update();
+  uut.Update(db.Query(queryId));
+  EXPECT_EQ(Ids({far, added}), uut.Within(V3(0, 0, 0), 1));
+
+  // Entities leave the results an update after their components do
+  db.Update();
+  uut.Update(db.Query(queryId));
+  EXPECT_EQ(2u, uut.Size());
+}
+
+int main(int argc, char **argv)
+{
+  gzecs::ComponentFactory::Register<gazebo::components::WorldPose>(
+      "gazebo::components::WorldPose");
+  gzecs::ComponentFactory::Register<gazebo::components::Geometry>(
+      "gazebo::components::Geometry");
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
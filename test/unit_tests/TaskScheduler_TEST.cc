@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2017 Open Source Robotics Foundation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+*/
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "gazebo/ecs/TaskScheduler.hh"
+
+namespace gzecs = gazebo::ecs;
+
+/////////////////////////////////////////////////
+TEST(TaskScheduler, ThreadCount)
+{
+  EXPECT_LE(1u, gzecs::TaskScheduler::DefaultThreadCount());
+  gzecs::TaskScheduler uut(3);
+  EXPECT_EQ(3u, uut.ThreadCount());
+  EXPECT_FALSE(uut.Pinned());
+}
+
+/////////////////////////////////////////////////
+TEST(TaskScheduler, NoWorkers)
+{
+  gzecs::TaskScheduler uut(0);
+  gzecs::TaskGroup group;
+  EXPECT_TRUE(group.Done());
+
+  std::vector<std::thread::id> threads;
+  for (int i = 0; i < 10; ++i)
+  {
+    uut.Spawn(group, [&threads]()
+        {
+          threads.push_back(std::this_thread::get_id());
+        });
+  }
+  EXPECT_FALSE(group.Done());
+
+  // Tasks only run on the waiting thread
+  uut.Wait(group);
+  EXPECT_TRUE(group.Done());
+  EXPECT_EQ(std::vector<std::thread::id>(10, std::this_thread::get_id()),
+      threads);
+}
+
+/////////////////////////////////////////////////
+TEST(TaskScheduler, ManyTasks)
+{
+  gzecs::TaskScheduler uut(3);
+  for (int update = 0; update < 10; ++update)
+  {
+    gzecs::TaskGroup group;
+    std::atomic<int> count{0};
+    for (int i = 0; i < 1000; ++i)
+      uut.Spawn(group, [&count]() {++count;});
+    uut.Wait(group);
+    EXPECT_EQ(1000, count);
+  }
+}
+
+/////////////////////////////////////////////////
+TEST(TaskScheduler, NestedTasks)
+{
+  gzecs::TaskScheduler uut(2);
+
+  // Every task splits its range in two and waits for the halves
+  std::atomic<int> leaves{0};
+  std::function<void(int)> split = [&](int _size)
+  {
+    if (_size == 1)
+    {
+      ++leaves;
+      return;
+    }
+    gzecs::TaskGroup halves;
+    uut.Spawn(halves, [&split, _size]() {split(_size / 2);});
+    uut.Spawn(halves, [&split, _size]() {split(_size - _size / 2);});
+    uut.Wait(halves);
+  };
+
+  gzecs::TaskGroup group;
+  uut.Spawn(group, [&split]() {split(1000);});
+  uut.Wait(group);
+  EXPECT_EQ(1000, leaves);
+}
+
+/////////////////////////////////////////////////
+TEST(TaskScheduler, Affinity)
+{
+  gzecs::TaskScheduler uut(2, {0});
+#ifdef __linux__
+  EXPECT_TRUE(uut.Pinned());
+
+  std::atomic<int> elsewhere{0};
+  gzecs::TaskGroup group;
+  const std::thread::id self = std::this_thread::get_id();
+  for (int i = 0; i < 100; ++i)
+  {
+    uut.Spawn(group, [&, self]()
+        {
+          if (std::this_thread::get_id() == self)
+            return;
+          if (sched_getcpu() != 0)
+            ++elsewhere;
+        });
+  }
+  uut.Wait(group);
+  EXPECT_EQ(0, elsewhere);
+#else
+  EXPECT_FALSE(uut.Pinned());
+#endif
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}